@@ -0,0 +1,890 @@
+#include "benchmark.h"
+#include "vecmath.h"
+#include "transform_hierarchy.h"
+#include "frustum_cull.h"
+#include "bvh.h"
+#include "occlusion_cull.h"
+#include "mesh_lod.h"
+#include "image_diff.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------
+
+// Deterministic xorshift, so failures reproduce
+struct Random
+{
+    uint32_t state;
+
+    Random(uint32_t seed = 2463534242u) : state(seed) {}
+
+    float uniform(float low, float high)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return low + (high - low) * (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    Vec3 vec3(float low, float high) { return Vec3(uniform(low, high), uniform(low, high), uniform(low, high)); }
+
+    Quat rotation()
+    {
+        return quat_from_axis_angle(vec3(-1.0f, 1.0f), uniform(-3.14159f, 3.14159f));
+    }
+};
+
+static double seconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Best of a few runs, in seconds per call
+template <typename Function>
+static double time_best(Function function, int runs = 5)
+{
+    double best = 1e30;
+
+    for (int r = 0; r < runs; r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        function();
+        best = min(best, seconds_since(start));
+    }
+
+    return best;
+}
+
+static float max_difference(const float *a, const float *b, size_t count)
+{
+    float worst = 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Relative for large values, absolute near zero
+        float scale = max(1.0f, max(fabs(a[i]), fabs(b[i])));
+        worst = max(worst, fabs(a[i] - b[i]) / scale);
+    }
+
+    return worst;
+}
+
+static bool check(ostream &out, const char *what, float error, float tolerance)
+{
+    bool passed = error <= tolerance;
+    out << "  " << (passed ? "ok   " : "FAIL ") << what << ": max error " << error << endl;
+    return passed;
+}
+
+static void report_speed(ostream &out, const char *what, double optimized, double reference, size_t items)
+{
+    out << "  " << what << ": " << items / optimized / 1e6 << " M/s ("
+        << reference / optimized << "x the reference)" << endl;
+}
+
+//--------------------------------------------------------------
+// Benchmarks
+//--------------------------------------------------------------
+
+static bool bench_math(ostream &out)
+{
+    out << "math (" << vecmath_instruction_set() << ")" << endl;
+
+    const size_t MatrixCount = 1 << 16;
+    const size_t PointCount = 1 << 20;
+    const size_t BlockCount = PointCount / Vec3BlockWidth;
+
+    // The kernels sum in a different order, which matters when the
+    // translation cancels large coordinates
+    const float PointTolerance = 1e-4f;
+
+    Random random;
+    vector<Mat4> a(MatrixCount), b(MatrixCount), product(MatrixCount), expected(MatrixCount);
+
+    for (size_t i = 0; i < MatrixCount; i++)
+    {
+        a[i] = mat4_trs(random.vec3(-100.0f, 100.0f), random.rotation(), random.vec3(0.1f, 10.0f));
+
+        // Every other one a general (projective) matrix
+        for (int e = 0; e < 16; e++)
+        {
+            b[i].m[e] = i % 2 ? random.uniform(-1.0f, 1.0f) + (e % 5 == 0 ? 4.0f : 0.0f) : a[i].m[e];
+        }
+    }
+
+    bool passed = true;
+
+    // Multiply
+    multiply_matrices(&a[0], &b[0], &product[0], MatrixCount);
+
+    float error = 0.0f;
+
+    for (size_t i = 0; i < MatrixCount; i++)
+    {
+        expected[i] = multiply_reference(a[i], b[i]);
+        error = max(error, max_difference(product[i].m, expected[i].m, 16));
+    }
+
+    passed = check(out, "mat4 multiply", error, 1e-5f) && passed;
+
+    // Inverse, against the reference and as M * inverse(M) = I
+    error = 0.0f;
+    float identityError = 0.0f;
+
+    for (size_t i = 0; i < MatrixCount; i++)
+    {
+        Mat4 inv = inverse(b[i]);
+        Mat4 ref = inverse_reference(b[i]);
+        Mat4 identity;
+
+        error = max(error, max_difference(inv.m, ref.m, 16));
+        identityError = max(identityError, max_difference((b[i] * inv).m, identity.m, 16));
+    }
+
+    passed = check(out, "mat4 inverse", error, 1e-3f) && passed;
+    passed = check(out, "mat4 inverse identity", identityError, 1e-3f) && passed;
+
+    // Point transforms in all three layouts
+    vector<Vec3> points(PointCount), transformed(PointCount), reference(PointCount);
+    vector<float> x(PointCount), y(PointCount), z(PointCount), ox(PointCount), oy(PointCount), oz(PointCount);
+    vector<Vec3Block> blocks(BlockCount), blocksOut(BlockCount);
+
+    for (size_t i = 0; i < PointCount; i++)
+    {
+        points[i] = random.vec3(-1000.0f, 1000.0f);
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+        blocks[i / Vec3BlockWidth].x[i % Vec3BlockWidth] = points[i].x;
+        blocks[i / Vec3BlockWidth].y[i % Vec3BlockWidth] = points[i].y;
+        blocks[i / Vec3BlockWidth].z[i % Vec3BlockWidth] = points[i].z;
+    }
+
+    const Mat4 &matrix = a[0];
+
+    transform_points_reference(matrix, &points[0], &reference[0], PointCount);
+
+    // An odd count exercises the scalar tail
+    transform_points(matrix, &points[0], &transformed[0], PointCount - 3);
+    transform_points_reference(matrix, &points[PointCount - 3], &transformed[PointCount - 3], 3);
+    passed = check(out, "transform points (AoS)", max_difference(&transformed[0].x, &reference[0].x, PointCount * 3), PointTolerance) && passed;
+
+    transform_points_soa(matrix, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], PointCount - 5);
+    transform_points_soa(matrix, &x[PointCount - 5], &y[PointCount - 5], &z[PointCount - 5],
+                         &ox[PointCount - 5], &oy[PointCount - 5], &oz[PointCount - 5], 5);
+
+    transform_blocks(matrix, &blocks[0], &blocksOut[0], BlockCount);
+
+    error = 0.0f;
+    float blockError = 0.0f;
+
+    for (size_t i = 0; i < PointCount; i++)
+    {
+        const Vec3Block &block = blocksOut[i / Vec3BlockWidth];
+        float soa[3] = { ox[i], oy[i], oz[i] };
+        float aosoa[3] = { block.x[i % Vec3BlockWidth], block.y[i % Vec3BlockWidth], block.z[i % Vec3BlockWidth] };
+
+        error = max(error, max_difference(soa, &reference[i].x, 3));
+        blockError = max(blockError, max_difference(aosoa, &reference[i].x, 3));
+    }
+
+    passed = check(out, "transform points (SoA)", error, PointTolerance) && passed;
+    passed = check(out, "transform points (AoSoA)", blockError, PointTolerance) && passed;
+
+    // Timings
+    double referenceMultiply = time_best([&]()
+    {
+        for (size_t i = 0; i < MatrixCount; i++)
+        {
+            expected[i] = multiply_reference(a[i], b[i]);
+        }
+    });
+    double simdMultiply = time_best([&]() { multiply_matrices(&a[0], &b[0], &product[0], MatrixCount); });
+
+    double referenceInverse = time_best([&]()
+    {
+        for (size_t i = 0; i < MatrixCount; i++)
+        {
+            expected[i] = inverse_reference(b[i]);
+        }
+    });
+    double simdInverse = time_best([&]()
+    {
+        for (size_t i = 0; i < MatrixCount; i++)
+        {
+            product[i] = inverse(b[i]);
+        }
+    });
+
+    double referencePoints = time_best([&]() { transform_points_reference(matrix, &points[0], &reference[0], PointCount); });
+    double aosPoints = time_best([&]() { transform_points(matrix, &points[0], &transformed[0], PointCount); });
+    double soaPoints = time_best([&]()
+    {
+        transform_points_soa(matrix, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], PointCount);
+    });
+    double blockPoints = time_best([&]() { transform_blocks(matrix, &blocks[0], &blocksOut[0], BlockCount); });
+
+    report_speed(out, "mat4 multiply", simdMultiply, referenceMultiply, MatrixCount);
+    report_speed(out, "mat4 inverse", simdInverse, referenceInverse, MatrixCount);
+    report_speed(out, "transform points (AoS)", aosPoints, referencePoints, PointCount);
+    report_speed(out, "transform points (SoA)", soaPoints, referencePoints, PointCount);
+    report_speed(out, "transform points (AoSoA)", blockPoints, referencePoints, PointCount);
+
+    return passed;
+}
+
+// A random forest: every node hangs off an earlier one, so depth
+// grows roughly with the log of the node count. locals receives each
+// node's local matrix for the reference.
+static void build_random_hierarchy(TransformHierarchy &hierarchy, vector<TransformHandle> &nodes,
+                                   vector<int> &parents, vector<Mat4> &locals, size_t count, Random &random)
+{
+    const size_t RootCount = 64;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int parent = i < RootCount ? -1 : min((int) random.uniform(0.0f, (float) i), (int) i - 1);
+        Vec3 translation = random.vec3(-10.0f, 10.0f);
+        Quat rotation = random.rotation();
+        Vec3 scale = random.vec3(0.9f, 1.1f);
+
+        parents.push_back(parent);
+        locals.push_back(mat4_trs(translation, rotation, scale));
+        nodes.push_back(hierarchy.add_node(parent >= 0 ? nodes[parent] : -1, translation, rotation, scale));
+    }
+}
+
+// Against world matrices recomputed from scratch in plain C++
+static float check_hierarchy(const TransformHierarchy &hierarchy, const vector<TransformHandle> &nodes,
+                             const vector<int> &parents, const vector<Mat4> &locals)
+{
+    vector<Mat4> worlds(nodes.size());
+    float error = 0.0f;
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        worlds[i] = parents[i] >= 0 ? multiply_reference(worlds[parents[i]], locals[i]) : locals[i];
+        error = max(error, max_difference(hierarchy.world_matrix(nodes[i]).m, worlds[i].m, 16));
+    }
+
+    return error;
+}
+
+static bool bench_transforms(ostream &out)
+{
+    const size_t NodeCount = 1 << 20;
+    const size_t MovedNodes = NodeCount / 100;
+    const int Runs = 5;
+
+    WorkerPool pool;
+    out << "transforms (" << NodeCount << " nodes, " << pool.thread_count() << " threads)" << endl;
+
+    Random random;
+    TransformHierarchy hierarchy;
+    vector<TransformHandle> nodes;
+    vector<int> parents;
+    vector<Mat4> locals;
+    build_random_hierarchy(hierarchy, nodes, parents, locals, NodeCount, random);
+
+    // Matrices are products down long chains of near-unit scales
+    const float HierarchyTolerance = 1e-4f;
+    bool passed = true;
+
+    TransformUpdateStats stats = hierarchy.update(&pool);
+    passed = check(out, "initial update", check_hierarchy(hierarchy, nodes, parents, locals), HierarchyTolerance) && passed;
+
+    // Moves a random 1% of the nodes, mirrored in the reference locals
+    auto move_some = [&]()
+    {
+        for (size_t i = 0; i < MovedNodes; i++)
+        {
+            size_t node = (size_t) random.uniform(0.0f, (float) NodeCount) % NodeCount;
+            Vec3 translation = random.vec3(-10.0f, 10.0f);
+
+            locals[node].m[12] = translation.x;
+            locals[node].m[13] = translation.y;
+            locals[node].m[14] = translation.z;
+            hierarchy.set_translation(nodes[node], translation);
+        }
+    };
+
+    move_some();
+    stats = hierarchy.update(&pool);
+    passed = check(out, "partial update", check_hierarchy(hierarchy, nodes, parents, locals), HierarchyTolerance) && passed;
+
+    move_some();
+    hierarchy.update();
+    passed = check(out, "partial update, one thread", check_hierarchy(hierarchy, nodes, parents, locals), HierarchyTolerance) && passed;
+
+    // Timings: everything dirty, 1% moved, nothing moved
+    double full[2] = { 1e30, 1e30 };
+    double partial[2] = { 1e30, 1e30 };
+    double idle[2] = { 1e30, 1e30 };
+    size_t partialNodes = 0;
+
+    for (int threaded = 0; threaded < 2; threaded++)
+    {
+        WorkerPool *workers = threaded ? &pool : NULL;
+
+        for (int r = 0; r < Runs; r++)
+        {
+            for (size_t i = 0; i < NodeCount; i++)
+            {
+                hierarchy.set_translation(nodes[i], Vec3(locals[i].m[12], locals[i].m[13], locals[i].m[14]));
+            }
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            hierarchy.update(workers);
+            full[threaded] = min(full[threaded], seconds_since(start));
+
+            move_some();
+            start = chrono::steady_clock::now();
+            partialNodes = hierarchy.update(workers).nodesUpdated;
+            partial[threaded] = min(partial[threaded], seconds_since(start));
+
+            start = chrono::steady_clock::now();
+            hierarchy.update(workers);
+            idle[threaded] = min(idle[threaded], seconds_since(start));
+        }
+    }
+
+    out << "  full update: " << full[0] * 1000.0 << " ms, " << full[1] * 1000.0 << " ms threaded ("
+        << stats.parallelTasks << " tasks)" << endl
+        << "  1% moved (" << partialNodes << " nodes updated): " << partial[0] * 1000.0 << " ms, "
+        << partial[1] * 1000.0 << " ms threaded" << endl
+        << "  nothing moved: " << idle[0] * 1000.0 << " ms, " << idle[1] * 1000.0 << " ms threaded" << endl;
+
+    return passed;
+}
+
+static bool bench_cull(ostream &out)
+{
+    const size_t ObjectCount = 1 << 20;
+
+    WorkerPool pool;
+    out << "cull (" << ObjectCount << " objects, " << pool.thread_count() << " threads, "
+        << vecmath_instruction_set() << ")" << endl;
+
+    // Unit boxes placed by a random scene, as the draw queue would see them
+    Random random;
+    TransformHierarchy hierarchy;
+    vector<TransformHandle> nodes;
+    vector<int> parents;
+    vector<Mat4> locals;
+    build_random_hierarchy(hierarchy, nodes, parents, locals, ObjectCount, random);
+    hierarchy.update(&pool);
+
+    CullBounds bounds;
+    bounds.resize(ObjectCount);
+
+    for (size_t i = 0; i < ObjectCount; i++)
+    {
+        Vec3 center, extents;
+        transform_bounds(hierarchy.world_matrices()[i], Vec3(), Vec3(0.5f, 0.5f, 0.5f), center, extents);
+        bounds.set(i, center, extents);
+    }
+
+    Mat4 viewProjection = mat4_perspective(1.0f, 16.0f / 9.0f, 0.1f, 200.0f) *
+                          mat4_look_at(Vec3(0.0f, 20.0f, -60.0f), Vec3(30.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = frustum_from_matrix(viewProjection);
+
+    vector<uint32_t> expected, simd, threaded;
+    cull_bounds_reference(frustum, bounds, 0, ObjectCount, expected);
+    cull_bounds(frustum, bounds, 0, ObjectCount, simd);
+
+    FrustumCuller culler(&pool);
+    culler.cull(frustum, bounds, threaded);
+
+    // The lists must match exactly, order included
+    bool passed = check(out, "visible list", simd == expected ? 0.0f : 1.0f, 0.0f);
+    passed = check(out, "visible list, threaded", threaded == expected ? 0.0f : 1.0f, 0.0f) && passed;
+
+    double reference = time_best([&]() { expected.clear(); cull_bounds_reference(frustum, bounds, 0, ObjectCount, expected); });
+    double single = time_best([&]() { simd.clear(); cull_bounds(frustum, bounds, 0, ObjectCount, simd); });
+    double parallel = time_best([&]() { culler.cull(frustum, bounds, threaded); });
+
+    out << "  " << expected.size() << " of " << ObjectCount << " visible ("
+        << 100.0 * expected.size() / ObjectCount << "%)" << endl;
+    report_speed(out, "cull", single, reference, ObjectCount);
+    report_speed(out, "cull threaded", parallel, reference, ObjectCount);
+    out << "  ";
+    culler.report(out);
+
+    return passed;
+}
+
+// Boxes of 0.5 to 2 units, spread so the density is the same at any count
+static void build_random_boxes(vector<Aabb> &boxes, size_t count, Random &random)
+{
+    float side = 4.0f * cbrt((float) count);
+
+    boxes.resize(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Vec3 center = random.vec3(-0.5f * side, 0.5f * side);
+        Vec3 half = random.vec3(0.25f, 1.0f);
+        boxes[i] = Aabb(center - half, center + half);
+    }
+}
+
+// BVH queries against brute force over the same boxes
+static bool check_bvh(ostream &out, const char *what, const Bvh &bvh, const vector<Aabb> &boxes,
+                      const Frustum &frustum, Random &random)
+{
+    const int Queries = 64;
+    size_t mismatches = 0;
+
+    vector<uint32_t> expected, found;
+    cull_boxes_reference(frustum, boxes, expected);
+    bvh.cull(frustum, found);
+    sort(found.begin(), found.end());
+    mismatches += found != expected;
+
+    for (int q = 0; q < Queries; q++)
+    {
+        Vec3 center = boxes[(size_t) random.uniform(0.0f, (float) boxes.size()) % boxes.size()].lower;
+        Aabb query(center - random.vec3(0.0f, 8.0f), center + random.vec3(0.0f, 8.0f));
+
+        expected.clear();
+        found.clear();
+        query_box_reference(boxes, query, expected);
+        bvh.query_box(query, found);
+        sort(found.begin(), found.end());
+        mismatches += found != expected;
+
+        Vec3 direction = random.vec3(-1.0f, 1.0f);
+        BvhRayHit expectedHit, hit;
+        bool expectedFound = raycast_reference(boxes, center - direction * 50.0f, direction, 1e30f, expectedHit);
+        bool hitFound = bvh.raycast(center - direction * 50.0f, direction, 1e30f, hit);
+        mismatches += expectedFound != hitFound || (hitFound && hit.distance != expectedHit.distance);
+    }
+
+    string label = string(what) + " (cull, " + to_string(Queries) + " box queries and rays)";
+    return check(out, label.c_str(), (float) mismatches, 0.0f);
+}
+
+static bool bench_bvh(ostream &out)
+{
+    const size_t CheckedCount = 100000;
+    const size_t Counts[] = { 10000, 100000, 1000000, 10000000 };
+
+    WorkerPool pool;
+    out << "bvh (" << pool.thread_count() << " threads)" << endl;
+
+    bool passed = true;
+    Random random;
+
+    for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); c++)
+    {
+        size_t count = Counts[c];
+        int runs = count >= 1000000 ? 1 : 5;
+
+        vector<Aabb> boxes;
+        build_random_boxes(boxes, count, random);
+
+        // Looking into the scene from one side, at a fraction of it
+        float side = 4.0f * cbrt((float) count);
+        Mat4 viewProjection = mat4_perspective(1.0f, 16.0f / 9.0f, 0.1f, 0.5f * side) *
+                              mat4_look_at(Vec3(-0.5f * side, 0.0f, 0.0f), Vec3(), Vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = frustum_from_matrix(viewProjection);
+
+        Bvh bvh;
+        double build = time_best([&]() { bvh.build(boxes); }, runs);
+        double buildThreaded = time_best([&]() { bvh.build(boxes, &pool); }, runs);
+
+        if (count == CheckedCount)
+        {
+            passed = check_bvh(out, "queries", bvh, boxes, frustum, random) && passed;
+        }
+
+        // Every box moves a little, as animated objects would
+        for (size_t i = 0; i < count; i++)
+        {
+            Vec3 offset = random.vec3(-0.5f, 0.5f);
+            boxes[i] = Aabb(boxes[i].lower + offset, boxes[i].upper + offset);
+        }
+
+        double refit = time_best([&]() { bvh.refit(boxes); }, runs);
+        double refitThreaded = time_best([&]() { bvh.refit(boxes, &pool); }, runs);
+
+        if (count == CheckedCount)
+        {
+            passed = check_bvh(out, "queries after refit", bvh, boxes, frustum, random) && passed;
+        }
+
+        vector<uint32_t> visible;
+        BvhCullStats stats;
+        double cull = time_best([&]() { visible.clear(); stats = bvh.cull(frustum, visible); }, runs);
+        double flat = time_best([&]() { visible.clear(); cull_boxes_reference(frustum, boxes, visible); }, runs);
+
+        out << "  " << count << " boxes (" << bvh.node_count() << " nodes, depth " << bvh.depth() << ")" << endl
+            << "    build " << build * 1000.0 << " ms, " << buildThreaded * 1000.0 << " ms threaded" << endl
+            << "    refit " << refit * 1000.0 << " ms, " << refitThreaded * 1000.0 << " ms threaded" << endl
+            << "    cull " << cull * 1000.0 << " ms (flat " << flat * 1000.0 << " ms), " << visible.size()
+            << " visible, " << stats.nodesVisited << " nodes visited, " << stats.nodesAccepted
+            << " accepted whole" << endl;
+    }
+
+    return passed;
+}
+
+// Unit cube, counter-clockwise from outside
+const Vec3 CubeVertices[8] = {
+    Vec3(-1.0f, -1.0f, -1.0f), Vec3(1.0f, -1.0f, -1.0f), Vec3(1.0f, 1.0f, -1.0f), Vec3(-1.0f, 1.0f, -1.0f),
+    Vec3(-1.0f, -1.0f, 1.0f), Vec3(1.0f, -1.0f, 1.0f), Vec3(1.0f, 1.0f, 1.0f), Vec3(-1.0f, 1.0f, 1.0f),
+};
+
+const uint32_t CubeIndices[36] = {
+    0, 3, 2, 0, 2, 1,       // -z
+    4, 5, 6, 4, 6, 7,       // +z
+    0, 4, 7, 0, 7, 3,       // -x
+    1, 2, 6, 1, 6, 5,       // +x
+    0, 1, 5, 0, 5, 4,       // -y
+    3, 7, 6, 3, 6, 2,       // +y
+};
+
+static bool bench_occlusion(ostream &out)
+{
+    const size_t ObjectCount = 100000;
+    const int BlocksX = 17;
+    const int BlocksZ = 16;
+
+    WorkerPool pool;
+    out << "occlusion (" << ObjectCount << " objects, " << BlocksX * BlocksZ << " buildings, "
+        << pool.thread_count() << " threads)" << endl;
+
+    // Street level in a grid of buildings, small objects scattered between
+    Random random;
+    vector<Mat4> buildings;
+
+    for (int bz = 0; bz < BlocksZ; bz++)
+    {
+        for (int bx = 0; bx < BlocksX; bx++)
+        {
+            float height = random.uniform(10.0f, 40.0f);
+            buildings.push_back(mat4_translation(Vec3((bx - BlocksX / 2) * 24.0f, height * 0.5f, 12.0f + bz * 24.0f)) *
+                                mat4_scale(Vec3(8.0f, height * 0.5f, 8.0f)));
+        }
+    }
+
+    CullBounds bounds;
+    bounds.resize(ObjectCount);
+
+    for (size_t i = 0; i < ObjectCount; i++)
+    {
+        Vec3 center(random.uniform(-200.0f, 200.0f), random.uniform(0.5f, 3.0f), random.uniform(0.0f, 400.0f));
+        bounds.set(i, center, random.vec3(0.25f, 1.0f));
+    }
+
+    Mat4 viewProjection = mat4_perspective(1.0f, 2.0f, 0.1f, 500.0f) *
+                          mat4_look_at(Vec3(12.0f, 1.7f, 0.0f), Vec3(10.0f, 1.7f, 40.0f), Vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = frustum_from_matrix(viewProjection);
+
+    vector<uint32_t> candidates;
+    FrustumCuller frustumCuller(&pool);
+    frustumCuller.cull(frustum, bounds, candidates);
+
+    OcclusionCuller serial(256, 128);
+    OcclusionCuller threaded(256, 128, &pool);
+    vector<uint32_t> visible;
+
+    auto draw_occluders = [&](OcclusionCuller &culler)
+    {
+        culler.begin_frame(viewProjection);
+
+        for (size_t b = 0; b < buildings.size(); b++)
+        {
+            culler.add_occluder(CubeVertices, CubeIndices, 36, buildings[b]);
+        }
+
+        culler.rasterize();
+    };
+
+    draw_occluders(threaded);
+    threaded.cull(bounds, candidates, visible);
+
+    // Same depth as drawing every triangle pixel by pixel
+    vector<float> depth;
+    threaded.rasterize_reference(depth);
+    bool passed = check(out, "depth buffer", max_difference(threaded.depth_buffer(), &depth[0], depth.size()), 0.0f);
+
+    // The pyramid may keep more objects than a per-pixel test, never fewer
+    size_t hiddenExactly = 0;
+    size_t wronglyHidden = 0;
+
+    for (size_t i = 0, v = 0; i < candidates.size(); i++)
+    {
+        uint32_t object = candidates[i];
+        bool kept = v < visible.size() && visible[v] == object;
+        Vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+        Vec3 extents(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+        bool visibleExactly = threaded.is_visible_reference(depth, center, extents);
+
+        v += kept ? 1 : 0;
+        hiddenExactly += visibleExactly ? 0 : 1;
+        wronglyHidden += visibleExactly && !kept ? 1 : 0;
+    }
+
+    passed = check(out, "no visible object hidden", (float) wronglyHidden, 0.0f) && passed;
+
+    double raster = time_best([&]() { draw_occluders(serial); });
+    double rasterThreaded = time_best([&]() { draw_occluders(threaded); });
+    double test = time_best([&]() { serial.cull(bounds, candidates, visible); });
+    double testThreaded = time_best([&]() { threaded.cull(bounds, candidates, visible); });
+
+    out << "  " << candidates.size() << " in the frustum, " << candidates.size() - visible.size()
+        << " occluded (" << hiddenExactly << " with per-pixel tests), " << visible.size() << " drawn" << endl
+        << "  raster " << raster * 1000.0 << " ms, " << rasterThreaded * 1000.0 << " ms threaded" << endl
+        << "  test " << test * 1000.0 << " ms, " << testThreaded * 1000.0 << " ms threaded" << endl;
+    out << "  ";
+    threaded.report(out);
+
+    return passed;
+}
+
+static bool bench_lod(ostream &out)
+{
+    const int GridSize = 384;
+    const int Runs = 3;
+
+    out << "lod (" << GridSize << "x" << GridSize << " terrain, " << 2 * (GridSize - 1) * (GridSize - 1)
+        << " triangles)" << endl;
+
+    // Rolling hills with a little noise, counter-clockwise seen from above
+    Random random;
+    vector<Vec3> positions;
+    vector<uint32_t> indices;
+
+    for (int z = 0; z < GridSize; z++)
+    {
+        for (int x = 0; x < GridSize; x++)
+        {
+            float height = 8.0f * sin(x * 0.03f) * cos(z * 0.05f) + 2.0f * sin(x * 0.2f + z * 0.1f) +
+                           random.uniform(-0.05f, 0.05f);
+            positions.push_back(Vec3((float) x, height, (float) z));
+        }
+    }
+
+    for (int z = 0; z + 1 < GridSize; z++)
+    {
+        for (int x = 0; x + 1 < GridSize; x++)
+        {
+            uint32_t a = z * GridSize + x, b = a + 1, c = a + GridSize, d = c + 1;
+            uint32_t quad[6] = { a, c, b, b, c, d };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    LodMesh mesh;
+    bool passed = build_lod_chain(positions, indices, mesh);
+    const LodTable &table = mesh.table;
+
+    // Levels get coarser in order, every triangle stays upright and the
+    // corners of the border stay in place
+    const uint32_t Corners[4] = { 0, GridSize - 1, GridSize * (GridSize - 1), GridSize * GridSize - 1 };
+    size_t misordered = table.levelCount < 2 ? 1 : 0;
+    size_t badTriangles = 0;
+    size_t missingCorners = 0;
+
+    for (uint32_t l = 0; passed && l < table.levelCount; l++)
+    {
+        const LodLevel &level = table.levels[l];
+        const uint32_t *levelIndices = &mesh.indices[level.firstIndex];
+        bool corners[4] = { false, false, false, false };
+
+        if (l > 0 && (level.indexCount >= table.levels[l - 1].indexCount || level.error < table.levels[l - 1].error))
+        {
+            misordered++;
+        }
+
+        for (uint32_t i = 0; i < level.indexCount; i += 3)
+        {
+            uint32_t a = levelIndices[i], b = levelIndices[i + 1], c = levelIndices[i + 2];
+            Vec3 normal = cross(positions[b] - positions[a], positions[c] - positions[a]);
+            badTriangles += a == b || b == c || a == c || normal.y <= 0.0f ? 1 : 0;
+
+            for (int k = 0; k < 4; k++)
+            {
+                corners[k] = corners[k] || a == Corners[k] || b == Corners[k] || c == Corners[k];
+            }
+        }
+
+        for (int k = 0; k < 4; k++)
+        {
+            missingCorners += corners[k] ? 0 : 1;
+        }
+    }
+
+    passed = check(out, "levels in order", (float) misordered, 0.0f) && passed;
+    passed = check(out, "no degenerate or flipped triangles", (float) badTriangles, 0.0f) && passed;
+    passed = check(out, "border corners kept", (float) missingCorners, 0.0f) && passed;
+
+    // Walking away with jittered distances: hysteresis never steps back
+    // to a finer level, choosing afresh every frame does
+    float pixelScale = lod_pixel_scale(mat4_perspective(1.0f, 16.0f / 9.0f, 0.1f, 10000.0f), 1080);
+    int held = -1, fresh = -1;
+    size_t heldSwitches = 0, heldReversals = 0, freshSwitches = 0;
+
+    for (float distance = 50.0f; distance < 1e6f; distance *= 1.002f)
+    {
+        float jittered = distance * random.uniform(0.98f, 1.02f);
+        int level = select_lod(table, pixelScale, jittered, held);
+        int freshLevel = select_lod(table, pixelScale, jittered, -1);
+
+        heldSwitches += held >= 0 && level != held ? 1 : 0;
+        heldReversals += level < held ? 1 : 0;
+        freshSwitches += fresh >= 0 && freshLevel != fresh ? 1 : 0;
+        held = level;
+        fresh = freshLevel;
+    }
+
+    passed = check(out, "no level flicker", (float) heldReversals, 0.0f) && passed;
+
+    for (uint32_t l = 0; l < table.levelCount; l++)
+    {
+        const LodLevel &level = table.levels[l];
+        out << "  level " << l << ": " << level.indexCount / 3 << " triangles, error " << level.error
+            << ", a pixel of error " << level.error * pixelScale << " units away" << endl;
+    }
+
+    double build = time_best([&]() { build_lod_chain(positions, indices, mesh); }, Runs);
+
+    const size_t Selections = 1 << 20;
+    vector<float> distances(Selections);
+    vector<int> levels(Selections, -1);
+
+    for (size_t i = 0; i < Selections; i++)
+    {
+        distances[i] = random.uniform(10.0f, 100000.0f);
+    }
+
+    double select = time_best([&]()
+    {
+        for (size_t i = 0; i < Selections; i++)
+        {
+            levels[i] = select_lod(table, pixelScale, distances[i], levels[i]);
+        }
+    });
+
+    out << "  " << heldSwitches << " switches walking away (" << freshSwitches << " without hysteresis)" << endl
+        << "  build " << build * 1000.0 << " ms (" << indices.size() / 3 / build / 1e6 << " M triangles/s)" << endl
+        << "  select " << select / Selections * 1e9 << " ns per mesh" << endl;
+
+    return passed;
+}
+
+static bool bench_diff(ostream &out)
+{
+    const int Width = 1920;
+    const int Height = 1080;
+    const size_t PixelCount = (size_t) Width * Height;
+    const int Tolerances[] = { 0, 2, 40, 255 };
+
+#if !defined(VECMATH_SCALAR) && defined(__AVX2__)
+    out << "diff (" << Width << "x" << Height << ", avx2)" << endl;
+#elif !defined(VECMATH_SCALAR) && defined(__SSE2__)
+    out << "diff (" << Width << "x" << Height << ", sse2)" << endl;
+#else
+    out << "diff (" << Width << "x" << Height << ", scalar)" << endl;
+#endif
+
+    // A rendered image against a copy with small noise on most pixels
+    // and large errors on a few; extra pixels give the SIMD paths a tail
+    Random random;
+    vector<unsigned char> a((PixelCount + 7) * 4), b(a.size());
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        a[i] = (unsigned char) random.uniform(0.0f, 255.99f);
+        int noise = random.uniform(0.0f, 1.0f) < 0.01f ? (int) random.uniform(-255.0f, 255.0f)
+                                                        : (int) random.uniform(-2.99f, 2.99f);
+        b[i] = (unsigned char) min(max(a[i] + noise, 0), 255);
+    }
+
+    bool passed = true;
+    size_t mismatches = 0;
+
+    for (size_t t = 0; t < sizeof(Tolerances) / sizeof(Tolerances[0]); t++)
+    {
+        for (size_t extra = 0; extra < 8; extra++)
+        {
+            // Odd start offsets keep the loads unaligned
+            size_t offset = extra % 2 ? 4 : 0;
+            size_t count = PixelCount - 1 + extra - offset / 4;
+            ImageDiffResult fast = diff_rgba(&a[offset], &b[offset], count, Tolerances[t]);
+            ImageDiffResult reference = diff_rgba_scalar(&a[offset], &b[offset], count, Tolerances[t]);
+
+            mismatches += fast.differingPixels != reference.differingPixels ||
+                          fast.maxChannelDifference != reference.maxChannelDifference ? 1 : 0;
+        }
+    }
+
+    passed = check(out, "diff_rgba matches scalar", (float) mismatches, 0.0f) && passed;
+
+    ImageDiffResult result;
+    double fast = time_best([&]() { result = diff_rgba(&a[0], &b[0], PixelCount, 2); });
+    double reference = time_best([&]() { result = diff_rgba_scalar(&a[0], &b[0], PixelCount, 2); });
+
+    out << "  " << result.differingPixels << " pixels beyond tolerance 2, max difference "
+        << result.maxChannelDifference << endl;
+    report_speed(out, "diff_rgba", fast, reference, PixelCount);
+
+    return passed;
+}
+
+//--------------------------------------------------------------
+// Benchmark table
+//--------------------------------------------------------------
+
+struct BenchmarkInfo
+{
+    const char *name;
+    bool (*run)(ostream &out);
+};
+
+const BenchmarkInfo Benchmarks[] = {
+    { "math", bench_math },
+    { "transforms", bench_transforms },
+    { "cull", bench_cull },
+    { "bvh", bench_bvh },
+    { "occlusion", bench_occlusion },
+    { "lod", bench_lod },
+    { "diff", bench_diff },
+};
+
+bool run_benchmarks(const vector<string> &names, ostream &out)
+{
+    bool passed = true;
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const BenchmarkInfo *found = NULL;
+
+        for (size_t b = 0; b < sizeof(Benchmarks) / sizeof(Benchmarks[0]); b++)
+        {
+            if (names[i] == Benchmarks[b].name || names[i] == "all")
+            {
+                found = &Benchmarks[b];
+                passed = Benchmarks[b].run(out) && passed;
+            }
+        }
+
+        if (!found)
+        {
+            out << "Unknown benchmark " << names[i] << endl;
+            passed = false;
+        }
+    }
+
+    return passed;
+}
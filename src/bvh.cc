@@ -0,0 +1,774 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// Centroid bins per axis when evaluating splits; small nodes use
+// one per primitive
+const int MaxBinCount = 16;
+
+// Leaves always split above this size, and never below two
+const uint32_t MaxLeafPrimitives = 8;
+
+// Cost of visiting a node, relative to testing one primitive
+const float TraversalCost = 1.0f;
+
+// Nodes at least this large bin their primitives in parallel
+const uint32_t ParallelBinMinimum = 1 << 16;
+const uint32_t BinChunkSize = 1 << 15;
+
+// Subtrees handed to each thread while building
+const int TasksPerThread = 4;
+const uint32_t MinimumTaskSize = 4096;
+
+// Ranges this deep become leaves whatever their size, which bounds
+// the traversal stacks
+const int MaxDepth = 64;
+const int StackSize = MaxDepth + 2;
+
+//--------------------------------------------------------------
+// Box helpers
+//--------------------------------------------------------------
+
+static inline Aabb empty_box()
+{
+    return Aabb(Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+}
+
+static inline void grow(Aabb &box, const Vec3 &point)
+{
+    box.lower = Vec3(min(box.lower.x, point.x), min(box.lower.y, point.y), min(box.lower.z, point.z));
+    box.upper = Vec3(max(box.upper.x, point.x), max(box.upper.y, point.y), max(box.upper.z, point.z));
+}
+
+static inline void grow(Aabb &box, const Aabb &other)
+{
+    box.lower = Vec3(min(box.lower.x, other.lower.x), min(box.lower.y, other.lower.y), min(box.lower.z, other.lower.z));
+    box.upper = Vec3(max(box.upper.x, other.upper.x), max(box.upper.y, other.upper.y), max(box.upper.z, other.upper.z));
+}
+
+static inline float surface_area(const Aabb &box)
+{
+    Vec3 size = box.upper - box.lower;
+    return size.x < 0.0f ? 0.0f : 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static inline float component(const Vec3 &v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+static inline bool overlaps(const Aabb &a, const Aabb &b)
+{
+    return a.lower.x <= b.upper.x && b.lower.x <= a.upper.x &&
+           a.lower.y <= b.upper.y && b.lower.y <= a.upper.y &&
+           a.lower.z <= b.upper.z && b.lower.z <= a.upper.z;
+}
+
+//--------------------------------------------------------------
+// Frustum and ray tests
+//--------------------------------------------------------------
+
+const int AllPlanes = 0x3f;
+
+// Tests the box against the planes in mask. Returns false when it is
+// outside one of them, otherwise clears the planes it is fully inside.
+static inline bool box_in_frustum(const Frustum &frustum, const Vec3 &lower, const Vec3 &upper, int &mask)
+{
+    Vec3 center = (lower + upper) * 0.5f;
+    Vec3 extents = (upper - lower) * 0.5f;
+
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(mask & (1 << p)))
+        {
+            continue;
+        }
+
+        const Vec4 &plane = frustum.planes[p];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float reach = fabs(plane.x) * extents.x + fabs(plane.y) * extents.y + fabs(plane.z) * extents.z;
+
+        if (distance < -reach)
+        {
+            return false;
+        }
+
+        if (distance >= reach)
+        {
+            mask &= ~(1 << p);
+        }
+    }
+
+    return true;
+}
+
+struct Ray
+{
+    Vec3 origin;
+    Vec3 inverseDirection;
+    float maxDistance;
+
+    Ray(const Vec3 &origin, const Vec3 &direction, float maxDistance)
+        : origin(origin), maxDistance(maxDistance)
+    {
+        // A tiny component instead of zero keeps the slabs free of 0 * inf
+        inverseDirection = Vec3(1.0f / (fabs(direction.x) > 1e-20f ? direction.x : 1e-20f),
+                                1.0f / (fabs(direction.y) > 1e-20f ? direction.y : 1e-20f),
+                                1.0f / (fabs(direction.z) > 1e-20f ? direction.z : 1e-20f));
+    }
+};
+
+// Entry distance of the ray into the box, or FLT_MAX if it misses or
+// enters no nearer than limit
+static inline float ray_box(const Ray &ray, const Vec3 &lower, const Vec3 &upper, float limit)
+{
+    Vec3 toLower = (lower - ray.origin) * ray.inverseDirection;
+    Vec3 toUpper = (upper - ray.origin) * ray.inverseDirection;
+
+    float entry = max(max(min(toLower.x, toUpper.x), min(toLower.y, toUpper.y)), max(min(toLower.z, toUpper.z), 0.0f));
+    float exit = min(min(max(toLower.x, toUpper.x), max(toLower.y, toUpper.y)), max(toLower.z, toUpper.z));
+
+    return entry <= exit && entry < limit ? entry : FLT_MAX;
+}
+
+//--------------------------------------------------------------
+// Build
+//--------------------------------------------------------------
+
+Bvh::Bvh()
+    : topNodes(0), taskSize(0)
+{
+}
+
+void Bvh::build(const vector<Aabb> &boxes, WorkerPool *pool)
+{
+    uint32_t count = (uint32_t) boxes.size();
+
+    primitives.resize(count);
+    primitiveBoxes = boxes;
+    centroids.resize(count);
+    nodes.clear();
+    subtrees.clear();
+    pending.clear();
+    topNodes = 0;
+
+    if (!count)
+    {
+        return;
+    }
+
+    Aabb bounds = empty_box();
+    Aabb centroidBounds = empty_box();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        primitives[i] = i;
+        centroids[i] = (boxes[i].lower + boxes[i].upper) * 0.5f;
+        grow(bounds, boxes[i]);
+        grow(centroidBounds, centroids[i]);
+    }
+
+    // At most 2n - 1 nodes, and far fewer with several per leaf
+    nodes.reserve(2 * (count / 2 + 1));
+    nodes.resize(1);
+
+    if (!pool || pool->thread_count() == 1 || count < 2 * MinimumTaskSize)
+    {
+        build_node(0, 0, count, 0, bounds, centroidBounds, nodes, NULL);
+        topNodes = (uint32_t) nodes.size();
+        centroids.clear();
+        return;
+    }
+
+    // Split the top on this thread until the ranges are task sized
+    taskSize = max(MinimumTaskSize, count / (uint32_t) (pool->thread_count() * TasksPerThread));
+    build_node(0, 0, count, 0, bounds, centroidBounds, nodes, pool);
+    topNodes = (uint32_t) nodes.size();
+
+    // Largest first, so the last tasks to finish are short ones
+    sort(pending.begin(), pending.end(), [](const PendingTask &a, const PendingTask &b) { return a.count > b.count; });
+
+    vector<vector<BvhNode> > taskNodes(pending.size());
+
+    pool->run(pending.size(), [this, &taskNodes](size_t t)
+    {
+        const PendingTask &task = pending[t];
+
+        taskNodes[t].reserve(task.count);
+        taskNodes[t].resize(1);
+        build_node(0, task.first, task.count, task.depth, task.bounds, task.centroidBounds, taskNodes[t], NULL);
+    });
+
+    // Each task's root takes its placeholder, the rest go after the top
+    for (size_t t = 0; t < pending.size(); t++)
+    {
+        const vector<BvhNode> &local = taskNodes[t];
+        uint32_t base = (uint32_t) nodes.size();
+
+        for (size_t i = 0; i < local.size(); i++)
+        {
+            BvhNode node = local[i];
+
+            if (!node.count)
+            {
+                node.leftOrFirst = base + node.leftOrFirst - 1;
+            }
+
+            if (i == 0)
+            {
+                nodes[pending[t].node] = node;
+            }
+            else
+            {
+                nodes.push_back(node);
+            }
+        }
+
+        Subtree subtree = { base, (uint32_t) nodes.size() };
+        subtrees.push_back(subtree);
+    }
+
+    pending.clear();
+    centroids.clear();
+}
+
+void Bvh::build_node(uint32_t index, uint32_t first, uint32_t count, int depth, const Aabb &bounds,
+                     const Aabb &centroidBounds, vector<BvhNode> &out, WorkerPool *pool)
+{
+    out[index].lower = bounds.lower;
+    out[index].upper = bounds.upper;
+
+    if (pool && count <= taskSize)
+    {
+        PendingTask task = { index, first, count, depth, bounds, centroidBounds };
+        pending.push_back(task);
+        return;
+    }
+
+    Split split;
+    bool found = count > 2 && depth < MaxDepth && find_split(first, count, bounds, centroidBounds, pool, split);
+
+    if (!found || (split.cost >= (float) count && count <= MaxLeafPrimitives))
+    {
+        if (found || count <= MaxLeafPrimitives || depth >= MaxDepth)
+        {
+            out[index].leftOrFirst = first;
+            out[index].count = count;
+            return;
+        }
+
+        // Every centroid in one place: split the range in half
+        split.leftCount = count / 2;
+        split.leftBounds = split.rightBounds = empty_box();
+        split.leftCentroids = split.rightCentroids = centroidBounds;
+
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            grow(i < first + split.leftCount ? split.leftBounds : split.rightBounds, primitiveBoxes[i]);
+        }
+    }
+    else
+    {
+        partition(first, count, centroidBounds, split);
+    }
+
+    uint32_t left = (uint32_t) out.size();
+    out.resize(left + 2);
+    out[index].leftOrFirst = left;
+    out[index].count = 0;
+
+    build_node(left, first, split.leftCount, depth + 1, split.leftBounds, split.leftCentroids, out, pool);
+    build_node(left + 1, first + split.leftCount, count - split.leftCount, depth + 1, split.rightBounds,
+               split.rightCentroids, out, pool);
+}
+
+static inline int bin_of(float value, float lower, float scale, int binCount)
+{
+    return min(binCount - 1, (int) ((value - lower) * scale));
+}
+
+static inline float bin_scale(const Aabb &centroidBounds, int axis, int binCount)
+{
+    float extent = component(centroidBounds.upper, axis) - component(centroidBounds.lower, axis);
+    return extent > 0.0f ? binCount / extent : 0.0f;
+}
+
+void Bvh::bin_primitives(uint32_t first, uint32_t count, const Aabb &centroidBounds, int binCount, Bin *bins) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int b = 0; b < binCount; b++)
+        {
+            bins[axis * MaxBinCount + b].bounds = bins[axis * MaxBinCount + b].centroids = empty_box();
+            bins[axis * MaxBinCount + b].count = 0;
+        }
+    }
+
+    float scale[3] = { bin_scale(centroidBounds, 0, binCount), bin_scale(centroidBounds, 1, binCount),
+                       bin_scale(centroidBounds, 2, binCount) };
+
+    // All three axes in one pass, so each primitive is read once
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const Aabb &box = primitiveBoxes[i];
+        const Vec3 &centroid = centroids[i];
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (scale[axis] == 0.0f)
+            {
+                continue;
+            }
+
+            float lower = component(centroidBounds.lower, axis);
+            Bin &bin = bins[axis * MaxBinCount + bin_of(component(centroid, axis), lower, scale[axis], binCount)];
+            grow(bin.bounds, box);
+            grow(bin.centroids, centroid);
+            bin.count++;
+        }
+    }
+}
+
+bool Bvh::find_split(uint32_t first, uint32_t count, const Aabb &bounds, const Aabb &centroidBounds,
+                     WorkerPool *pool, Split &split)
+{
+    Bin bins[3 * MaxBinCount];
+    int binCount = (int) min((uint32_t) MaxBinCount, count);
+
+    if (pool && count >= ParallelBinMinimum)
+    {
+        // Each chunk bins on its own, then the chunks are merged
+        size_t chunks = (count + BinChunkSize - 1) / BinChunkSize;
+        vector<Bin> chunkBins(chunks * 3 * MaxBinCount);
+
+        pool->run(chunks, [&](size_t c)
+        {
+            uint32_t begin = first + (uint32_t) c * BinChunkSize;
+            bin_primitives(begin, min(BinChunkSize, first + count - begin), centroidBounds, binCount,
+                           &chunkBins[c * 3 * MaxBinCount]);
+        });
+
+        for (int b = 0; b < 3 * MaxBinCount; b++)
+        {
+            bins[b] = chunkBins[b];
+
+            for (size_t c = 1; c < chunks; c++)
+            {
+                const Bin &other = chunkBins[c * 3 * MaxBinCount + b];
+                grow(bins[b].bounds, other.bounds);
+                grow(bins[b].centroids, other.centroids);
+                bins[b].count += other.count;
+            }
+        }
+    }
+    else
+    {
+        bin_primitives(first, count, centroidBounds, binCount, bins);
+    }
+
+    // Sweep each axis from both ends: cost of splitting after bin b
+    float inverseArea = 1.0f / max(surface_area(bounds), FLT_MIN);
+    bool found = false;
+    split.cost = FLT_MAX;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (bin_scale(centroidBounds, axis, binCount) == 0.0f)
+        {
+            continue;
+        }
+
+        const Bin *axisBins = bins + axis * MaxBinCount;
+        float rightCost[MaxBinCount];
+        Aabb box = empty_box();
+        uint32_t primitivesRight = 0;
+
+        for (int b = binCount - 1; b > 0; b--)
+        {
+            grow(box, axisBins[b].bounds);
+            primitivesRight += axisBins[b].count;
+            rightCost[b - 1] = primitivesRight ? primitivesRight * surface_area(box) : -1.0f;
+        }
+
+        box = empty_box();
+        uint32_t primitivesLeft = 0;
+
+        for (int b = 0; b < binCount - 1; b++)
+        {
+            grow(box, axisBins[b].bounds);
+            primitivesLeft += axisBins[b].count;
+
+            if (!primitivesLeft || rightCost[b] < 0.0f)
+            {
+                continue;
+            }
+
+            float cost = TraversalCost + (primitivesLeft * surface_area(box) + rightCost[b]) * inverseArea;
+
+            if (cost < split.cost)
+            {
+                split.axis = axis;
+                split.bin = b;
+                split.binCount = binCount;
+                split.cost = cost;
+                split.leftCount = primitivesLeft;
+                found = true;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        return false;
+    }
+
+    const Bin *axisBins = bins + split.axis * MaxBinCount;
+    split.leftBounds = split.rightBounds = empty_box();
+    split.leftCentroids = split.rightCentroids = empty_box();
+
+    for (int b = 0; b < binCount; b++)
+    {
+        grow(b <= split.bin ? split.leftBounds : split.rightBounds, axisBins[b].bounds);
+        grow(b <= split.bin ? split.leftCentroids : split.rightCentroids, axisBins[b].centroids);
+    }
+
+    return true;
+}
+
+void Bvh::partition(uint32_t first, uint32_t count, const Aabb &centroidBounds, const Split &split)
+{
+    float lower = component(centroidBounds.lower, split.axis);
+    float scale = bin_scale(centroidBounds, split.axis, split.binCount);
+    uint32_t left = first;
+    uint32_t right = first + count;
+
+    while (left < right)
+    {
+        if (bin_of(component(centroids[left], split.axis), lower, scale, split.binCount) <= split.bin)
+        {
+            left++;
+        }
+        else
+        {
+            right--;
+            swap(primitives[left], primitives[right]);
+            swap(primitiveBoxes[left], primitiveBoxes[right]);
+            swap(centroids[left], centroids[right]);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// Refit
+//--------------------------------------------------------------
+
+void Bvh::refit(const vector<Aabb> &boxes, WorkerPool *pool)
+{
+    uint32_t count = (uint32_t) primitives.size();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        primitiveBoxes[i] = boxes[primitives[i]];
+    }
+
+    // Task subtrees are independent; the top joins them afterwards
+    if (pool)
+    {
+        pool->run(subtrees.size(), [this](size_t s) { refit_range(subtrees[s].begin, subtrees[s].end); });
+    }
+    else
+    {
+        for (size_t s = 0; s < subtrees.size(); s++)
+        {
+            refit_range(subtrees[s].begin, subtrees[s].end);
+        }
+    }
+
+    refit_range(0, topNodes);
+}
+
+void Bvh::refit_range(uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = end; i-- > begin;)
+    {
+        BvhNode &node = nodes[i];
+        Aabb box = empty_box();
+
+        if (node.count)
+        {
+            for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; p++)
+            {
+                grow(box, primitiveBoxes[p]);
+            }
+        }
+        else
+        {
+            const BvhNode &left = nodes[node.leftOrFirst];
+            const BvhNode &right = nodes[node.leftOrFirst + 1];
+            grow(box, Aabb(left.lower, left.upper));
+            grow(box, Aabb(right.lower, right.upper));
+        }
+
+        node.lower = box.lower;
+        node.upper = box.upper;
+    }
+}
+
+//--------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------
+
+BvhCullStats Bvh::cull(const Frustum &frustum, vector<uint32_t> &visible) const
+{
+    BvhCullStats stats = { 0, 0, 0 };
+
+    if (nodes.empty())
+    {
+        return stats;
+    }
+
+    // Each entry carries the planes its box may still cross
+    uint32_t stack[StackSize];
+    int stackMasks[StackSize];
+    int top = 0;
+
+    stack[top] = 0;
+    stackMasks[top++] = AllPlanes;
+
+    while (top)
+    {
+        top--;
+        const BvhNode &node = nodes[stack[top]];
+        int mask = stackMasks[top];
+        stats.nodesVisited++;
+
+        if (mask)
+        {
+            if (!box_in_frustum(frustum, node.lower, node.upper, mask))
+            {
+                continue;
+            }
+
+            if (!mask)
+            {
+                stats.nodesAccepted++;
+            }
+        }
+
+        if (!node.count)
+        {
+            stack[top] = node.leftOrFirst;
+            stackMasks[top++] = mask;
+            stack[top] = node.leftOrFirst + 1;
+            stackMasks[top++] = mask;
+            continue;
+        }
+
+        for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; p++)
+        {
+            int primitiveMask = mask;
+
+            if (!mask || box_in_frustum(frustum, primitiveBoxes[p].lower, primitiveBoxes[p].upper, primitiveMask))
+            {
+                visible.push_back(primitives[p]);
+            }
+        }
+
+        stats.primitivesTested += mask ? node.count : 0;
+    }
+
+    return stats;
+}
+
+bool Bvh::raycast(const Vec3 &origin, const Vec3 &direction, float maxDistance, BvhRayHit &hit) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Ray ray(origin, direction, maxDistance);
+    float nearest = maxDistance;
+    uint32_t found = UINT32_MAX;
+    uint32_t stack[StackSize];
+    int top = 0;
+
+    if (ray_box(ray, nodes[0].lower, nodes[0].upper, nearest) != FLT_MAX)
+    {
+        stack[top++] = 0;
+    }
+
+    while (top)
+    {
+        const BvhNode &node = nodes[stack[--top]];
+
+        if (node.count)
+        {
+            for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; p++)
+            {
+                float distance = ray_box(ray, primitiveBoxes[p].lower, primitiveBoxes[p].upper, nearest);
+
+                if (distance < nearest)
+                {
+                    nearest = distance;
+                    found = primitives[p];
+                }
+            }
+
+            continue;
+        }
+
+        // Nearer child on top, so it can shorten the ray for the other
+        uint32_t nearChild = node.leftOrFirst;
+        uint32_t farChild = node.leftOrFirst + 1;
+        float nearDistance = ray_box(ray, nodes[nearChild].lower, nodes[nearChild].upper, nearest);
+        float farDistance = ray_box(ray, nodes[farChild].lower, nodes[farChild].upper, nearest);
+
+        if (farDistance < nearDistance)
+        {
+            swap(nearChild, farChild);
+            swap(nearDistance, farDistance);
+        }
+
+        if (farDistance != FLT_MAX)
+        {
+            stack[top++] = farChild;
+        }
+
+        if (nearDistance != FLT_MAX)
+        {
+            stack[top++] = nearChild;
+        }
+    }
+
+    if (found == UINT32_MAX)
+    {
+        return false;
+    }
+
+    hit.primitive = found;
+    hit.distance = nearest;
+    return true;
+}
+
+void Bvh::query_box(const Aabb &query, vector<uint32_t> &results) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    uint32_t stack[StackSize];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        const BvhNode &node = nodes[stack[--top]];
+
+        if (!overlaps(query, Aabb(node.lower, node.upper)))
+        {
+            continue;
+        }
+
+        if (!node.count)
+        {
+            stack[top++] = node.leftOrFirst;
+            stack[top++] = node.leftOrFirst + 1;
+            continue;
+        }
+
+        for (uint32_t p = node.leftOrFirst; p < node.leftOrFirst + node.count; p++)
+        {
+            if (overlaps(query, primitiveBoxes[p]))
+            {
+                results.push_back(primitives[p]);
+            }
+        }
+    }
+}
+
+int Bvh::depth() const
+{
+    if (nodes.empty())
+    {
+        return 0;
+    }
+
+    vector<pair<uint32_t, int> > stack(1, make_pair(0u, 1));
+    int deepest = 0;
+
+    while (!stack.empty())
+    {
+        pair<uint32_t, int> entry = stack.back();
+        stack.pop_back();
+        deepest = max(deepest, entry.second);
+
+        if (!nodes[entry.first].count)
+        {
+            stack.push_back(make_pair(nodes[entry.first].leftOrFirst, entry.second + 1));
+            stack.push_back(make_pair(nodes[entry.first].leftOrFirst + 1, entry.second + 1));
+        }
+    }
+
+    return deepest;
+}
+
+//--------------------------------------------------------------
+// Brute force
+//--------------------------------------------------------------
+
+void cull_boxes_reference(const Frustum &frustum, const vector<Aabb> &boxes, vector<uint32_t> &visible)
+{
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        int mask = AllPlanes;
+
+        if (box_in_frustum(frustum, boxes[i].lower, boxes[i].upper, mask))
+        {
+            visible.push_back((uint32_t) i);
+        }
+    }
+}
+
+bool raycast_reference(const vector<Aabb> &boxes, const Vec3 &origin, const Vec3 &direction,
+                       float maxDistance, BvhRayHit &hit)
+{
+    Ray ray(origin, direction, maxDistance);
+    float nearest = maxDistance;
+    bool found = false;
+
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        float distance = ray_box(ray, boxes[i].lower, boxes[i].upper, nearest);
+
+        if (distance < nearest)
+        {
+            nearest = distance;
+            hit.primitive = (uint32_t) i;
+            found = true;
+        }
+    }
+
+    hit.distance = nearest;
+    return found;
+}
+
+void query_box_reference(const vector<Aabb> &boxes, const Aabb &query, vector<uint32_t> &results)
+{
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        if (overlaps(query, boxes[i]))
+        {
+            results.push_back((uint32_t) i);
+        }
+    }
+}
@@ -0,0 +1,183 @@
+#include "damage.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static unsigned PendingReasons = 0;
+static unsigned PendingFullReasons = 0;     // Reasons that damage the whole frame
+static double NextWake = -1.0;
+static vector<DamageRect> PendingRects;
+
+//--------------------------------------------------------------
+// Rectangle merging
+//--------------------------------------------------------------
+
+static long area(const DamageRect &rect)
+{
+    return (long) rect.width * rect.height;
+}
+
+static DamageRect bounding(const DamageRect &a, const DamageRect &b)
+{
+    int left = min(a.x, b.x);
+    int bottom = min(a.y, b.y);
+    int right = max(a.x + a.width, b.x + b.width);
+    int top = max(a.y + a.height, b.y + b.height);
+
+    DamageRect result = { left, bottom, right - left, top - bottom };
+    return result;
+}
+
+static bool clip(DamageRect &rect, int width, int height)
+{
+    int left = max(rect.x, 0);
+    int bottom = max(rect.y, 0);
+    int right = min(rect.x + rect.width, width);
+    int top = min(rect.y + rect.height, height);
+
+    rect.x = left;
+    rect.y = bottom;
+    rect.width = right - left;
+    rect.height = top - bottom;
+
+    return rect.width > 0 && rect.height > 0;
+}
+
+// Greedily merges the pair whose bounding box wastes the fewest
+// pixels, as long as merging is free (overlap) or needed to get
+// under maxRegions. Each scissored pass has a fixed cost, so a few
+// slightly larger rectangles beat many tiny ones.
+static void merge_regions(vector<DamageRect> &rects, size_t maxRegions)
+{
+    while (rects.size() > 1)
+    {
+        size_t bestA = 0, bestB = 1;
+        long bestWaste = -1;
+
+        for (size_t a = 0; a < rects.size(); a++)
+        {
+            for (size_t b = a + 1; b < rects.size(); b++)
+            {
+                long waste = area(bounding(rects[a], rects[b])) - area(rects[a]) - area(rects[b]);
+
+                if (bestWaste < 0 || waste < bestWaste)
+                {
+                    bestWaste = waste;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+
+        if (bestWaste > 0 && rects.size() <= maxRegions)
+        {
+            break;
+        }
+
+        rects[bestA] = bounding(rects[bestA], rects[bestB]);
+        rects.erase(rects.begin() + bestB);
+    }
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+void damage_invalidate(unsigned reasons)
+{
+    PendingReasons |= reasons;
+    PendingFullReasons |= reasons;
+}
+
+void damage_invalidate_rect(int x, int y, int width, int height, unsigned reasons)
+{
+    DamageRect rect = { x, y, width, height };
+    PendingRects.push_back(rect);
+    PendingReasons |= DamageRegion | reasons;
+}
+
+unsigned damage_consume(int framebufferWidth, int framebufferHeight, std::vector<DamageRect> &regions,
+                        size_t maxRegions, float fullFrameFraction)
+{
+    bool partial = PendingFullReasons == 0;
+    unsigned reasons = damage_consume();
+
+    regions.clear();
+
+    if (!partial || !(reasons & DamageRegion))
+    {
+        return reasons;
+    }
+
+    for (size_t i = 0; i < PendingRects.size(); i++)
+    {
+        DamageRect rect = PendingRects[i];
+
+        if (clip(rect, framebufferWidth, framebufferHeight))
+        {
+            regions.push_back(rect);
+        }
+    }
+
+    merge_regions(regions, maxRegions > 0 ? maxRegions : 1);
+
+    long covered = 0;
+    for (size_t i = 0; i < regions.size(); i++)
+    {
+        covered += area(regions[i]);
+    }
+
+    if (covered > fullFrameFraction * framebufferWidth * framebufferHeight)
+    {
+        regions.clear();
+    }
+
+    PendingRects.clear();
+
+    return reasons;
+}
+
+unsigned damage_consume()
+{
+    unsigned reasons = PendingReasons;
+
+    if (PendingFullReasons)
+    {
+        PendingRects.clear();
+    }
+
+    PendingReasons = 0;
+    PendingFullReasons = 0;
+
+    return reasons;
+}
+
+bool damage_pending()
+{
+    return PendingReasons != 0;
+}
+
+void damage_schedule(double time)
+{
+    if (NextWake < 0.0 || time < NextWake)
+    {
+        NextWake = time;
+    }
+}
+
+double damage_time_until_wake(double now)
+{
+    if (NextWake < 0.0)
+    {
+        return -1.0;
+    }
+
+    if (now >= NextWake)
+    {
+        NextWake = -1.0;
+        return 0.0;
+    }
+
+    return NextWake - now;
+}
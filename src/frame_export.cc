@@ -0,0 +1,204 @@
+#include "frame_export.h"
+#include "image_io.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// Frames queued per encoder thread before the render thread has to wait
+const size_t QueuedFramesPerThread = 4;
+
+// Encoders spin briefly on an empty queue before sleeping
+const int IdleSpinCount = 64;
+const int IdleSleepMicroseconds = 200;
+
+static int resolve_thread_count(const string &format, const string &pathPattern, int threads)
+{
+    if (format == "raw" || pathPattern == "-")
+    {
+        return 1;
+    }
+
+    if (threads <= 0)
+    {
+        threads = (int) thread::hardware_concurrency();
+    }
+
+    return threads > 0 ? threads : 1;
+}
+
+FrameExporter::FrameExporter(const std::string &format, const std::string &pathPattern, int threads, int pngLevel)
+    : format(format),
+      pathPattern(pathPattern),
+      pngLevel(pngLevel),
+      pending(QueuedFramesPerThread * resolve_thread_count(format, pathPattern, threads)),
+      recycled(QueuedFramesPerThread * resolve_thread_count(format, pathPattern, threads) * 2),
+      closing(false),
+      framesWritten(0),
+      bytesWritten(0),
+      encodeNanoseconds(0),
+      submitStalls(0)
+{
+    int count = resolve_thread_count(format, pathPattern, threads);
+
+    for (int i = 0; i < count; i++)
+    {
+        workers.push_back(thread(&FrameExporter::encode_loop, this));
+    }
+}
+
+FrameExporter::~FrameExporter()
+{
+    finish();
+
+    FrameJob *job;
+    while (recycled.pop(job))
+    {
+        delete job;
+    }
+}
+
+void FrameExporter::submit(const ReadbackImage &image)
+{
+    FrameJob *job;
+
+    if (!recycled.pop(job))
+    {
+        job = new FrameJob;
+    }
+
+    size_t size = (size_t) image.width * image.height * 4;
+    job->pixels.resize(size);
+    memcpy(&job->pixels[0], image.pixels, size);
+    job->width = image.width;
+    job->height = image.height;
+    job->frame = image.tag;
+
+    if (pending.push(job))
+    {
+        return;
+    }
+
+    // Encoders are saturated; the only option left is to wait
+    submitStalls++;
+
+    while (!pending.push(job))
+    {
+        this_thread::yield();
+    }
+}
+
+void FrameExporter::finish()
+{
+    if (workers.empty())
+    {
+        return;
+    }
+
+    closing.store(true);
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    workers.clear();
+}
+
+FrameExportStats FrameExporter::stats() const
+{
+    FrameExportStats result;
+    result.framesWritten = framesWritten.load();
+    result.bytesWritten = bytesWritten.load();
+    result.submitStalls = submitStalls;
+    result.encodeSeconds = encodeNanoseconds.load() / 1.0e9;
+
+    return result;
+}
+
+void FrameExporter::encode_loop()
+{
+    int idle = 0;
+
+    for (;;)
+    {
+        FrameJob *job;
+
+        if (!pending.pop(job))
+        {
+            // Only quit once closing is set and the queue is drained
+            if (closing.load())
+            {
+                if (!pending.pop(job))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                if (++idle < IdleSpinCount)
+                {
+                    this_thread::yield();
+                }
+                else
+                {
+                    this_thread::sleep_for(chrono::microseconds(IdleSleepMicroseconds));
+                }
+                continue;
+            }
+        }
+
+        idle = 0;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool written = encode_and_write(*job);
+        chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - start;
+
+        encodeNanoseconds += chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+
+        if (written)
+        {
+            framesWritten++;
+            bytesWritten += job->encoded.size();
+        }
+
+        if (!recycled.push(job))
+        {
+            delete job;
+        }
+    }
+}
+
+bool FrameExporter::encode_and_write(FrameJob &job)
+{
+    const unsigned char *pixels = &job.pixels[0];
+
+    if (format == "png")
+    {
+        if (!encode_png(pixels, job.width, job.height, pngLevel, job.encoded))
+        {
+            return false;
+        }
+    }
+    else if (format == "ppm")
+    {
+        encode_ppm(pixels, job.width, job.height, job.encoded);
+    }
+    else
+    {
+        encode_raw(pixels, job.width, job.height, job.encoded);
+    }
+
+    if (pathPattern == "-")
+    {
+        return write_file("-", job.encoded);
+    }
+
+    char filename[1024];
+    snprintf(filename, sizeof(filename), pathPattern.c_str(), (int) job.frame);
+
+    return write_file(filename, job.encoded);
+}
@@ -0,0 +1,497 @@
+#include "frame_graph.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// GPU timestamps are read this many frames late, like the profiler's
+// frame timer, so reading them never stalls
+const int TimestampLatency = 4;
+
+//--------------------------------------------------------------
+// Frame graph
+//--------------------------------------------------------------
+
+FrameGraph::FrameGraph(RenderTargetPool *pool)
+    : pool(pool), timestampsAvailable(false), timestampRing(TimestampLatency), frameIndex(0),
+      framesExecuted(0), passesDeclared(0), passesCulled(0), transientsDeclared(0),
+      transientsAllocated(0), framebufferBinds(0)
+{
+    timestampsAvailable = glfwExtensionSupported("GL_ARB_timer_query") == GL_TRUE;
+
+    for (size_t i = 0; i < timestampRing.size(); i++)
+    {
+        timestampRing[i].pending = false;
+    }
+}
+
+FrameGraph::~FrameGraph()
+{
+    for (size_t i = 0; i < timestampRing.size(); i++)
+    {
+        if (!timestampRing[i].queries.empty())
+        {
+            glDeleteQueries((GLsizei) timestampRing[i].queries.size(), &timestampRing[i].queries[0]);
+        }
+    }
+}
+
+void FrameGraph::reset()
+{
+    resources.clear();
+    passes.clear();
+    order.clear();
+    physicals.clear();
+}
+
+FrameResource FrameGraph::create_texture(const string &name, const RenderTargetDesc &desc)
+{
+    Resource resource = { name, desc, false, 0, 0, 1.0f, 1.0f, -1 };
+    resources.push_back(resource);
+
+    return (FrameResource) resources.size() - 1;
+}
+
+FrameResource FrameGraph::import_target(const string &name, GLuint framebuffer, GLuint texture,
+                                        int width, int height, float scaleX, float scaleY)
+{
+    Resource resource = { name, RenderTargetDesc(width, height), true, framebuffer, texture, scaleX, scaleY, -1 };
+    resources.push_back(resource);
+
+    return (FrameResource) resources.size() - 1;
+}
+
+int FrameGraph::add_pass(const string &name, const vector<FrameResource> &reads,
+                         FrameResource write, const ExecuteFunction &execute)
+{
+    Pass pass = { name, reads, write, execute };
+    passes.push_back(pass);
+
+    return (int) passes.size() - 1;
+}
+
+bool FrameGraph::compile()
+{
+    size_t passTotal = passes.size();
+
+    // Culling, back to front: a pass is needed when the value it
+    // writes is read later or is an imported target's final contents.
+    // Its own write hides earlier values of that target unless it
+    // reads them too.
+    vector<bool> needed(resources.size(), false);
+    vector<bool> live(passTotal, false);
+
+    for (size_t r = 0; r < resources.size(); r++)
+    {
+        needed[r] = resources[r].imported;
+    }
+
+    for (size_t p = passTotal; p-- > 0;)
+    {
+        const Pass &pass = passes[p];
+
+        if (pass.write < 0 || !needed[pass.write])
+        {
+            continue;
+        }
+
+        live[p] = true;
+        needed[pass.write] = false;
+
+        for (size_t i = 0; i < pass.reads.size(); i++)
+        {
+            needed[pass.reads[i]] = true;
+        }
+    }
+
+    // Dependencies between live passes in declaration order: readers
+    // wait for the last writer, writers for the last writer and for
+    // every reader of the value they replace
+    vector<vector<int> > successors(passTotal);
+    vector<int> predecessorCount(passTotal, 0);
+    vector<int> lastWriter(resources.size(), -1);
+    vector<vector<int> > readersSinceWrite(resources.size());
+
+    for (size_t p = 0; p < passTotal; p++)
+    {
+        if (!live[p])
+        {
+            continue;
+        }
+
+        const Pass &pass = passes[p];
+        vector<int> before;
+
+        for (size_t i = 0; i < pass.reads.size(); i++)
+        {
+            FrameResource r = pass.reads[i];
+
+            if (lastWriter[r] >= 0)
+            {
+                before.push_back(lastWriter[r]);
+            }
+        }
+
+        FrameResource w = pass.write;
+
+        if (lastWriter[w] >= 0)
+        {
+            before.push_back(lastWriter[w]);
+        }
+
+        before.insert(before.end(), readersSinceWrite[w].begin(), readersSinceWrite[w].end());
+
+        sort(before.begin(), before.end());
+        before.erase(unique(before.begin(), before.end()), before.end());
+
+        for (size_t i = 0; i < before.size(); i++)
+        {
+            if (before[i] != (int) p)
+            {
+                successors[before[i]].push_back((int) p);
+                predecessorCount[p]++;
+            }
+        }
+
+        for (size_t i = 0; i < pass.reads.size(); i++)
+        {
+            if (pass.reads[i] != w)
+            {
+                readersSinceWrite[pass.reads[i]].push_back((int) p);
+            }
+        }
+
+        lastWriter[w] = (int) p;
+        readersSinceWrite[w].clear();
+    }
+
+    // Topological order. Of the passes that are ready, one drawing
+    // into the target just drawn to goes first (no FBO switch), then
+    // declaration order.
+    vector<int> ready;
+    size_t liveCount = 0;
+
+    for (size_t p = 0; p < passTotal; p++)
+    {
+        if (live[p])
+        {
+            liveCount++;
+
+            if (predecessorCount[p] == 0)
+            {
+                ready.push_back((int) p);
+            }
+        }
+    }
+
+    order.clear();
+
+    while (!ready.empty())
+    {
+        size_t pick = 0;
+
+        for (size_t i = 0; i < ready.size(); i++)
+        {
+            bool sameTarget = !order.empty() && passes[ready[i]].write == passes[order.back()].write;
+            bool pickSameTarget = !order.empty() && passes[ready[pick]].write == passes[order.back()].write;
+
+            if (sameTarget != pickSameTarget ? sameTarget : ready[i] < ready[pick])
+            {
+                pick = i;
+            }
+        }
+
+        int p = ready[pick];
+        ready.erase(ready.begin() + pick);
+        order.push_back(p);
+
+        for (size_t i = 0; i < successors[p].size(); i++)
+        {
+            if (--predecessorCount[successors[p][i]] == 0)
+            {
+                ready.push_back(successors[p][i]);
+            }
+        }
+    }
+
+    if (order.size() != liveCount)
+    {
+        cerr << "Frame graph has a dependency cycle" << endl;
+        order.clear();
+        return false;
+    }
+
+    // Storage: a transient takes a free slot with the same description
+    // at its first use and gives it back after its last use, so
+    // transients that are never alive together share a target
+    vector<int> firstUse(resources.size(), -1);
+    vector<int> lastUse(resources.size(), -1);
+
+    for (size_t step = 0; step < order.size(); step++)
+    {
+        const Pass &pass = passes[order[step]];
+        vector<FrameResource> used(pass.reads);
+        used.push_back(pass.write);
+
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            if (firstUse[used[i]] < 0)
+            {
+                firstUse[used[i]] = (int) step;
+            }
+
+            lastUse[used[i]] = (int) step;
+        }
+    }
+
+    vector<bool> slotFree;
+    physicals.clear();
+
+    for (size_t step = 0; step < order.size(); step++)
+    {
+        const Pass &pass = passes[order[step]];
+        Resource &written = resources[pass.write];
+
+        if (!written.imported && firstUse[pass.write] == (int) step)
+        {
+            written.physical = -1;
+
+            for (size_t s = 0; s < physicals.size(); s++)
+            {
+                if (slotFree[s] && physicals[s] == written.desc)
+                {
+                    written.physical = (int) s;
+                    break;
+                }
+            }
+
+            if (written.physical < 0)
+            {
+                written.physical = (int) physicals.size();
+                physicals.push_back(written.desc);
+                slotFree.push_back(false);
+            }
+
+            slotFree[written.physical] = false;
+        }
+
+        // Released only after the pass, which may read one transient
+        // while writing another
+        vector<FrameResource> used(pass.reads);
+        used.push_back(pass.write);
+
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            const Resource &resource = resources[used[i]];
+
+            if (!resource.imported && resource.physical >= 0 && lastUse[used[i]] == (int) step)
+            {
+                slotFree[resource.physical] = true;
+            }
+        }
+    }
+
+    passesDeclared += passTotal;
+    passesCulled += passTotal - order.size();
+
+    for (size_t r = 0; r < resources.size(); r++)
+    {
+        if (!resources[r].imported && firstUse[r] >= 0)
+        {
+            transientsDeclared++;
+        }
+    }
+
+    transientsAllocated += physicals.size();
+
+    return true;
+}
+
+void FrameGraph::execute()
+{
+    collect_timestamps();
+
+    vector<RenderTarget *> targets;
+
+    for (size_t s = 0; s < physicals.size(); s++)
+    {
+        RenderTarget *target = pool->acquire(physicals[s]);
+
+        if (!target)
+        {
+            break;
+        }
+
+        targets.push_back(target);
+    }
+
+    if (targets.size() == physicals.size())
+    {
+        for (size_t r = 0; r < resources.size(); r++)
+        {
+            Resource &resource = resources[r];
+
+            if (!resource.imported && resource.physical >= 0)
+            {
+                resource.framebuffer = targets[resource.physical]->framebuffer;
+                resource.texture = targets[resource.physical]->colorTexture;
+            }
+        }
+
+        // Skip GPU timing for this frame rather than wait on a query
+        TimestampSet &timestamps = timestampRing[frameIndex % timestampRing.size()];
+        bool timed = timestampsAvailable && !timestamps.pending && !order.empty();
+
+        if (timed)
+        {
+            size_t needed = order.size() + 1;
+
+            if (timestamps.queries.size() < needed)
+            {
+                size_t previous = timestamps.queries.size();
+                timestamps.queries.resize(needed);
+                glGenQueries((GLsizei) (needed - previous), &timestamps.queries[previous]);
+            }
+
+            timestamps.timings.clear();
+        }
+
+        GLint bound = -1;
+
+        for (size_t step = 0; step < order.size(); step++)
+        {
+            const Pass &pass = passes[order[step]];
+            const Resource &target = resources[pass.write];
+
+            map<string, PassTiming>::iterator timing = timings.find(pass.name);
+
+            if (timing == timings.end())
+            {
+                PassTiming empty = { 0, 0.0, 0.0, 0 };
+                timing = timings.insert(make_pair(pass.name, empty)).first;
+            }
+
+            ProfileScope zone(timing->first.c_str());
+            double start = glfwGetTime();
+
+            if (timed)
+            {
+                glQueryCounter(timestamps.queries[step], GL_TIMESTAMP);
+                timestamps.timings.push_back(&timing->second);
+            }
+
+            if (bound != (GLint) target.framebuffer)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+                bound = target.framebuffer;
+                framebufferBinds++;
+            }
+
+            glViewport(0, 0, target.desc.width, target.desc.height);
+            pass.execute();
+
+            timing->second.executions++;
+            timing->second.cpuSeconds += glfwGetTime() - start;
+        }
+
+        if (timed)
+        {
+            glQueryCounter(timestamps.queries[order.size()], GL_TIMESTAMP);
+            timestamps.pending = true;
+        }
+
+        framesExecuted++;
+        frameIndex++;
+    }
+    else
+    {
+        cerr << "Frame graph could not allocate its transient targets" << endl;
+    }
+
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        pool->release(targets[i]);
+    }
+}
+
+GLuint FrameGraph::texture(FrameResource resource) const
+{
+    return resources[resource].texture;
+}
+
+// Adds the per-pass GPU times of every finished frame, without waiting
+void FrameGraph::collect_timestamps()
+{
+    for (size_t i = 0; i < timestampRing.size(); i++)
+    {
+        TimestampSet &timestamps = timestampRing[i];
+
+        if (!timestamps.pending)
+        {
+            continue;
+        }
+
+        // Queries complete in order, the last one covers the frame
+        size_t count = timestamps.timings.size();
+        GLint available = 0;
+        glGetQueryObjectiv(timestamps.queries[count], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            continue;
+        }
+
+        GLuint64 previous = 0;
+
+        for (size_t q = 0; q <= count; q++)
+        {
+            GLuint64 time = 0;
+            glGetQueryObjectui64v(timestamps.queries[q], GL_QUERY_RESULT, &time);
+
+            if (q > 0)
+            {
+                timestamps.timings[q - 1]->gpuSeconds += (time - previous) * 1e-9;
+                timestamps.timings[q - 1]->gpuSamples++;
+            }
+
+            previous = time;
+        }
+
+        timestamps.pending = false;
+    }
+}
+
+void FrameGraph::report(ostream &out)
+{
+    collect_timestamps();
+
+    if (!framesExecuted)
+    {
+        return;
+    }
+
+    out << "Frame graph: " << framesExecuted << " frames, " << passesDeclared << " passes declared, "
+        << passesCulled << " culled, " << framebufferBinds << " framebuffer binds, "
+        << transientsDeclared << " transient textures in " << transientsAllocated << " targets" << endl;
+
+    for (map<string, PassTiming>::const_iterator i = timings.begin(); i != timings.end(); ++i)
+    {
+        const PassTiming &timing = i->second;
+
+        out << "  " << i->first << ": " << timing.executions << " runs, "
+            << timing.cpuSeconds * 1000.0 / max(timing.executions, 1ul) << " ms CPU";
+
+        if (timing.gpuSamples)
+        {
+            out << ", " << timing.gpuSeconds * 1000.0 / timing.gpuSamples << " ms GPU";
+        }
+
+        out << endl;
+    }
+}
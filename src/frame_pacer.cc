@@ -0,0 +1,282 @@
+#include "frame_pacer.h"
+#include "opengl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Pacer state
+//--------------------------------------------------------------
+
+// Render durations kept for predicting the next one
+const int RenderHistoryFrames = 64;
+const double RenderPredictionPercentile = 0.9;
+const double RenderPredictionSafety = 0.0005;
+
+// Spin margin bounds; the margin tracks sleep overshoot in between
+const double MinimumSpinMargin = 0.0003;
+const double MaximumSpinMargin = 0.004;
+
+// A frame starting this long after the last present follows an idle
+// period (redraw on demand) and restarts the pacing grid
+const double IdleGap = 0.05;
+
+// Present intervals kept for the jitter report
+const int IntervalHistoryFrames = 4096;
+
+static FramePacerConfig Config;
+static double FramePeriod = 0.0;
+static SwapMode ActiveSwapMode = SwapDriverDefault;
+
+static double NextDeadline = -1.0;
+static double FrameStart = 0.0;
+static double LastPresent = -1.0;
+static bool Consecutive = false;
+
+static double RenderDurations[RenderHistoryFrames];
+static int RenderDurationCount = 0;
+static double SpinMargin = 0.002;
+
+static vector<double> Intervals;
+static unsigned long IntervalCount = 0;
+static unsigned long PacedFrames = 0;
+static unsigned long MissedDeadlines = 0;
+static double SleepSeconds = 0.0;
+static double SpinSeconds = 0.0;
+
+static const char *SwapModeNames[] = { "default", "off", "vsync", "adaptive" };
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static double predicted_render_time()
+{
+    int count = min(RenderDurationCount, RenderHistoryFrames);
+
+    if (count == 0)
+    {
+        return 0.0;
+    }
+
+    double sorted[RenderHistoryFrames];
+    copy(RenderDurations, RenderDurations + count, sorted);
+
+    double *percentile = sorted + (int) (RenderPredictionPercentile * (count - 1));
+    nth_element(sorted, percentile, sorted + count);
+
+    return min(*percentile + RenderPredictionSafety, FramePeriod);
+}
+
+// Sleeps until SpinMargin before the deadline, then spins. Oversleep
+// raises the margin at once; it decays slowly when sleeps are accurate.
+static void wait_until(double deadline)
+{
+    double now = glfwGetTime();
+    double sleepTime = deadline - now - SpinMargin;
+
+    if (sleepTime > 0.0)
+    {
+        this_thread::sleep_for(chrono::duration<double>(sleepTime));
+
+        double slept = glfwGetTime() - now;
+        double margin = min(max((slept - sleepTime) * 1.25, MinimumSpinMargin), MaximumSpinMargin);
+
+        SpinMargin = margin > SpinMargin ? margin : SpinMargin * 0.95 + margin * 0.05;
+        SleepSeconds += slept;
+        now += slept;
+    }
+
+    double spinStart = now;
+
+    while (now < deadline)
+    {
+        now = glfwGetTime();
+    }
+
+    SpinSeconds += now - spinStart;
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+void frame_pacer_initialize(const FramePacerConfig &config)
+{
+    Config = config;
+    FramePeriod = config.targetFrameRate > 0.0 ? 1.0 / config.targetFrameRate : 0.0;
+    ActiveSwapMode = config.swapMode;
+
+    if (ActiveSwapMode == SwapAdaptive
+        && !glfwExtensionSupported("GLX_EXT_swap_control_tear")
+        && !glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+    {
+        cerr << "Adaptive vsync (EXT_swap_control_tear) not supported, using vsync" << endl;
+        ActiveSwapMode = SwapVsync;
+    }
+
+    switch (ActiveSwapMode)
+    {
+        case SwapImmediate: glfwSwapInterval(0); break;
+        case SwapVsync: glfwSwapInterval(1); break;
+        case SwapAdaptive: glfwSwapInterval(-1); break;
+        default: break;
+    }
+
+    Intervals.assign(IntervalHistoryFrames, 0.0);
+    IntervalCount = 0;
+    NextDeadline = -1.0;
+    LastPresent = -1.0;
+    RenderDurationCount = 0;
+}
+
+double frame_pacer_begin_frame()
+{
+    double now = glfwGetTime();
+
+    Consecutive = LastPresent >= 0.0 && now - LastPresent <= max(FramePeriod, IdleGap);
+
+    if (FramePeriod <= 0.0)
+    {
+        FrameStart = now;
+        return 0.0;
+    }
+
+    double predicted = predicted_render_time();
+
+    if (!Consecutive || NextDeadline < 0.0)
+    {
+        // Nothing to keep in step with; start now and build the grid from here
+        NextDeadline = now + predicted;
+        FrameStart = now;
+        return 0.0;
+    }
+
+    double start = NextDeadline - predicted;
+
+    if (start > now)
+    {
+        wait_until(start);
+    }
+
+    FrameStart = glfwGetTime();
+    PacedFrames++;
+
+    return FrameStart - now;
+}
+
+void frame_pacer_end_render()
+{
+    double now = glfwGetTime();
+
+    RenderDurations[RenderDurationCount % RenderHistoryFrames] = now - FrameStart;
+    RenderDurationCount++;
+
+    // A frame that beat its prediction still presents on the grid
+    if (FramePeriod > 0.0 && Consecutive && now < NextDeadline)
+    {
+        wait_until(NextDeadline);
+    }
+}
+
+void frame_pacer_end_frame()
+{
+    double now = glfwGetTime();
+
+    if (Consecutive && LastPresent >= 0.0)
+    {
+        Intervals[IntervalCount % Intervals.size()] = now - LastPresent;
+        IntervalCount++;
+    }
+
+    LastPresent = now;
+
+    if (FramePeriod <= 0.0)
+    {
+        return;
+    }
+
+    // Late frames are counted and the grid skips ahead, keeping its phase
+    if (Consecutive && now > NextDeadline + FramePeriod * 0.5)
+    {
+        MissedDeadlines++;
+    }
+
+    NextDeadline += FramePeriod;
+
+    while (NextDeadline <= now)
+    {
+        NextDeadline += FramePeriod;
+    }
+}
+
+void frame_pacer_report(ostream &out)
+{
+    out << "Frame pacing: target ";
+
+    if (FramePeriod > 0.0)
+    {
+        out << Config.targetFrameRate << " fps";
+    }
+    else
+    {
+        out << "unlimited";
+    }
+
+    out << ", swap " << SwapModeNames[ActiveSwapMode] << endl;
+
+    size_t count = min((size_t) IntervalCount, Intervals.size());
+
+    if (count == 0)
+    {
+        out << "  no consecutive frames" << endl;
+        return;
+    }
+
+    vector<double> sorted(Intervals.begin(), Intervals.begin() + count);
+    sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    double sumSquares = 0.0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += sorted[i];
+        sumSquares += sorted[i] * sorted[i];
+    }
+
+    double mean = sum / count;
+    double deviation = sqrt(max(sumSquares / count - mean * mean, 0.0));
+
+    out << "  frame interval (last " << count << "): mean " << mean * 1000.0 << " ms, stddev "
+        << deviation * 1000.0 << " ms, p50 " << sorted[count / 2] * 1000.0 << " ms, p99 "
+        << sorted[min(count - 1, (size_t) (count * 0.99))] * 1000.0 << " ms, max "
+        << sorted[count - 1] * 1000.0 << " ms" << endl;
+
+    if (FramePeriod > 0.0)
+    {
+        out << "  " << PacedFrames << " paced frames, " << MissedDeadlines << " missed deadlines, waited "
+            << SleepSeconds << " s asleep and " << SpinSeconds << " s spinning (spin margin "
+            << SpinMargin * 1000.0 << " ms)" << endl;
+    }
+}
+
+bool parse_swap_mode(const string &name, SwapMode &mode)
+{
+    for (int i = 0; i < (int) (sizeof(SwapModeNames) / sizeof(SwapModeNames[0])); i++)
+    {
+        if (name == SwapModeNames[i])
+        {
+            mode = (SwapMode) i;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,298 @@
+#include "frustum_cull.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// Objects per parallel task; a chunk's bounds (24 bytes each) stay
+// well inside L2
+const size_t CullChunkSize = 16384;
+
+//--------------------------------------------------------------
+// Frustum and bounds
+//--------------------------------------------------------------
+
+Frustum frustum_from_matrix(const Mat4 &m)
+{
+    // Each plane is the last row plus or minus another row
+    Vec4 rows[4];
+
+    for (int r = 0; r < 4; r++)
+    {
+        rows[r] = Vec4(m.at(r, 0), m.at(r, 1), m.at(r, 2), m.at(r, 3));
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];     // Left
+    frustum.planes[1] = rows[3] - rows[0];     // Right
+    frustum.planes[2] = rows[3] + rows[1];     // Bottom
+    frustum.planes[3] = rows[3] - rows[1];     // Top
+    frustum.planes[4] = rows[3] + rows[2];     // Near
+    frustum.planes[5] = rows[3] - rows[2];     // Far
+
+    // Normalized, so distances are in world units
+    for (int p = 0; p < 6; p++)
+    {
+        Vec4 &plane = frustum.planes[p];
+        float length = sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        plane = plane * (length > 0.0f ? 1.0f / length : 0.0f);
+    }
+
+    return frustum;
+}
+
+void CullBounds::resize(size_t count)
+{
+    centerX.resize(count);
+    centerY.resize(count);
+    centerZ.resize(count);
+    extentX.resize(count);
+    extentY.resize(count);
+    extentZ.resize(count);
+}
+
+void CullBounds::set(size_t index, const Vec3 &center, const Vec3 &extents)
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extents.x;
+    extentY[index] = extents.y;
+    extentZ[index] = extents.z;
+}
+
+// Arvo: the world extents are the local extents through the absolute
+// values of the rotation/scale part
+void transform_bounds(const Mat4 &matrix, const Vec3 &center, const Vec3 &extents,
+                      Vec3 &worldCenter, Vec3 &worldExtents)
+{
+    worldCenter = transform_point(matrix, center);
+
+    const float *m = matrix.m;
+    worldExtents = Vec3(fabs(m[0]) * extents.x + fabs(m[4]) * extents.y + fabs(m[8]) * extents.z,
+                        fabs(m[1]) * extents.x + fabs(m[5]) * extents.y + fabs(m[9]) * extents.z,
+                        fabs(m[2]) * extents.x + fabs(m[6]) * extents.y + fabs(m[10]) * extents.z);
+}
+
+//--------------------------------------------------------------
+// Culling kernels
+//--------------------------------------------------------------
+
+// One object against every plane: culled when the center lies further
+// behind a plane than the box reaches towards it.
+static inline bool visible_reference(const Frustum &frustum, const CullBounds &b, size_t i)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const Vec4 &plane = frustum.planes[p];
+        float distance = plane.x * b.centerX[i] + plane.y * b.centerY[i] + plane.z * b.centerZ[i] + plane.w;
+        float boxReach = fabs(plane.x) * b.extentX[i] + fabs(plane.y) * b.extentY[i] + fabs(plane.z) * b.extentZ[i];
+
+        if (distance < -boxReach)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void cull_bounds_reference(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end,
+                           vector<uint32_t> &visible)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        if (visible_reference(frustum, bounds, i))
+        {
+            visible.push_back((uint32_t) i);
+        }
+    }
+}
+
+void cull_bounds(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end,
+                 vector<uint32_t> &visible)
+{
+    // Room for every object; trimmed to the written count at the end
+    size_t written = visible.size();
+    visible.resize(written + (end - begin));
+    uint32_t *out = visible.empty() ? NULL : &visible[0];
+    size_t i = begin;
+
+#if defined(VECMATH_AVX)
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+        absX[p] = _mm256_andnot_ps(signMask, planeX[p]);
+        absY[p] = _mm256_andnot_ps(signMask, planeY[p]);
+        absZ[p] = _mm256_andnot_ps(signMask, planeZ[p]);
+    }
+
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+        __m256 culled = _mm256_setzero_ps();
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx),
+                                                                        _mm256_mul_ps(planeY[p], cy)),
+                                                          _mm256_mul_ps(planeZ[p], cz)), planeW[p]);
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)),
+                                         _mm256_mul_ps(absZ[p], ez));
+
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(distance, _mm256_xor_ps(reach, signMask), _CMP_LT_OQ));
+        }
+
+        int mask = ~_mm256_movemask_ps(culled) & 0xff;
+
+        // Every index is written, only visible ones advance the cursor
+        for (int k = 0; k < 8; k++)
+        {
+            out[written] = (uint32_t) (i + k);
+            written += (mask >> k) & 1;
+        }
+    }
+#elif defined(VECMATH_SSE)
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        absX[p] = _mm_andnot_ps(signMask, planeX[p]);
+        absY[p] = _mm_andnot_ps(signMask, planeY[p]);
+        absZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+    }
+
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 culled = _mm_setzero_ps();
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                                    _mm_mul_ps(planeZ[p], cz)), planeW[p]);
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                                      _mm_mul_ps(absZ[p], ez));
+
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(distance, _mm_xor_ps(reach, signMask)));
+        }
+
+        int mask = ~_mm_movemask_ps(culled) & 0xf;
+
+        // Every index is written, only visible ones advance the cursor
+        for (int k = 0; k < 4; k++)
+        {
+            out[written] = (uint32_t) (i + k);
+            written += (mask >> k) & 1;
+        }
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        out[written] = (uint32_t) i;
+        written += visible_reference(frustum, bounds, i) ? 1 : 0;
+    }
+
+    visible.resize(written);
+}
+
+//--------------------------------------------------------------
+// Frustum culler
+//--------------------------------------------------------------
+
+FrustumCuller::FrustumCuller(WorkerPool *pool)
+    : pool(pool)
+{
+    memset(&totals, 0, sizeof(totals));
+}
+
+void FrustumCuller::cull(const Frustum &frustum, const CullBounds &bounds, vector<uint32_t> &visible)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t count = bounds.size();
+
+    visible.clear();
+
+    if (!pool || count <= CullChunkSize)
+    {
+        cull_bounds(frustum, bounds, 0, count, visible);
+    }
+    else
+    {
+        size_t chunks = (count + CullChunkSize - 1) / CullChunkSize;
+
+        if (chunkVisible.size() < chunks)
+        {
+            chunkVisible.resize(chunks);
+        }
+
+        pool->run(chunks, [this, &frustum, &bounds, count](size_t chunk)
+        {
+            size_t begin = chunk * CullChunkSize;
+
+            chunkVisible[chunk].clear();
+            cull_bounds(frustum, bounds, begin, min(begin + CullChunkSize, count), chunkVisible[chunk]);
+        });
+
+        size_t total = 0;
+
+        for (size_t c = 0; c < chunks; c++)
+        {
+            total += chunkVisible[c].size();
+        }
+
+        visible.reserve(total);
+
+        for (size_t c = 0; c < chunks; c++)
+        {
+            visible.insert(visible.end(), chunkVisible[c].begin(), chunkVisible[c].end());
+        }
+    }
+
+    totals.lastSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    totals.seconds += totals.lastSeconds;
+    totals.frames++;
+    totals.tested += count;
+    totals.visible += visible.size();
+}
+
+void FrustumCuller::report(ostream &out) const
+{
+    if (!totals.frames)
+    {
+        return;
+    }
+
+    out << "Frustum culling: " << totals.tested / totals.frames << " objects tested, "
+        << totals.visible / totals.frames << " submitted, " << (totals.tested - totals.visible) / totals.frames
+        << " culled per frame, " << totals.seconds * 1000.0 / totals.frames << " ms per frame" << endl;
+}
@@ -0,0 +1,130 @@
+#define GL_TRACE_NO_INTERCEPT
+#include "opengl.h"
+
+#ifdef GL_TRACE_ENABLED
+
+#include <iomanip>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Trace tables
+//--------------------------------------------------------------
+
+struct GlTraceFunctionInfo
+{
+    const char *name;
+    GlTraceCategory category;
+};
+
+#define GL_TRACE_INFO_ENTRY(name, category) { #name, category },
+static const GlTraceFunctionInfo FunctionInfo[GlTraceFunctionCount] = {
+    GL_TRACE_FUNCTIONS(GL_TRACE_INFO_ENTRY)
+};
+#undef GL_TRACE_INFO_ENTRY
+
+static const char *CategoryNames[GlTraceCategoryCount] = {
+    "buffers",
+    "programs",
+    "attribs",
+    "draws",
+    "state",
+};
+
+// Counters for the frame in flight
+static unsigned long FrameCalls[GlTraceFunctionCount];
+static unsigned long FrameUploadBytes = 0;
+static double FrameCategoryTime[GlTraceCategoryCount];
+
+// Totals over all completed frames
+static unsigned long TotalFrames = 0;
+static unsigned long TotalCalls[GlTraceFunctionCount];
+static unsigned long PeakCalls[GlTraceFunctionCount];
+static unsigned long long TotalUploadBytes = 0;
+static unsigned long PeakUploadBytes = 0;
+static double TotalCategoryTime[GlTraceCategoryCount];
+
+//--------------------------------------------------------------
+// Recording
+//--------------------------------------------------------------
+
+double gl_trace_now()
+{
+    return glfwGetTime();
+}
+
+void gl_trace_record(GlTraceFunction function, double seconds, long uploadBytes)
+{
+    FrameCalls[function]++;
+    FrameCategoryTime[FunctionInfo[function].category] += seconds;
+    FrameUploadBytes += uploadBytes;
+}
+
+void gl_trace_end_frame()
+{
+    for (int f = 0; f < GlTraceFunctionCount; f++)
+    {
+        TotalCalls[f] += FrameCalls[f];
+        PeakCalls[f] = max(PeakCalls[f], FrameCalls[f]);
+        FrameCalls[f] = 0;
+    }
+
+    for (int c = 0; c < GlTraceCategoryCount; c++)
+    {
+        TotalCategoryTime[c] += FrameCategoryTime[c];
+        FrameCategoryTime[c] = 0.0;
+    }
+
+    TotalUploadBytes += FrameUploadBytes;
+    PeakUploadBytes = max(PeakUploadBytes, FrameUploadBytes);
+    FrameUploadBytes = 0;
+
+    TotalFrames++;
+}
+
+//--------------------------------------------------------------
+// Reporting
+//--------------------------------------------------------------
+
+void gl_trace_report(ostream &out)
+{
+    if (TotalFrames == 0)
+    {
+        return;
+    }
+
+    double frames = (double) TotalFrames;
+
+    // Formatting is restored afterwards, the stream is the caller's
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+
+    out << "GL trace over " << TotalFrames << " frames (per-frame averages)" << endl;
+    out << fixed << setprecision(2);
+
+    for (int f = 0; f < GlTraceFunctionCount; f++)
+    {
+        if (TotalCalls[f] == 0)
+        {
+            continue;
+        }
+
+        out << "  " << left << setw(28) << FunctionInfo[f].name << right
+            << setw(10) << TotalCalls[f] / frames << " calls"
+            << "  (peak " << PeakCalls[f] << ")" << endl;
+    }
+
+    out << "  uploads: " << TotalUploadBytes / frames << " bytes/frame"
+        << "  (peak " << PeakUploadBytes << ", total " << TotalUploadBytes << ")" << endl;
+
+    for (int c = 0; c < GlTraceCategoryCount; c++)
+    {
+        out << "  cpu " << left << setw(10) << CategoryNames[c] << right
+            << setw(10) << TotalCategoryTime[c] / frames * 1.0e6 << " us/frame" << endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+#endif // GL_TRACE_ENABLED
@@ -0,0 +1,307 @@
+#include "gpu_stats.h"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Query layout
+//--------------------------------------------------------------
+
+enum GpuStat
+{
+    StatPrimitivesGenerated,
+    StatSamplesPassed,
+    StatVerticesSubmitted,
+    StatVertexInvocations,
+    StatClippingInput,
+    StatClippingOutput,
+    StatFragmentInvocations,
+    StatCount
+};
+
+// The first two are core GL 3.0, the rest need the extension
+const int CoreStatCount = 2;
+
+// Query objects in flight are capped so a driver that never
+// returns results cannot grow the pool without bound
+const size_t MaxQuerySetsInFlight = 256;
+
+static const GLenum StatTargets[StatCount] = {
+    GL_PRIMITIVES_GENERATED,
+    GL_SAMPLES_PASSED,
+    GL_VERTICES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+    GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+};
+
+static const char *StatNames[StatCount] = {
+    "primitives",
+    "samples",
+    "vertices",
+    "vs_invocations",
+    "clip_in",
+    "clip_out",
+    "fs_invocations",
+};
+
+struct DrawGroup
+{
+    GLuint program;
+    string mesh;
+    unsigned long samples;
+    unsigned long long totals[StatCount];
+    GLuint64 last[StatCount];
+};
+
+struct QuerySet
+{
+    GLuint queries[StatCount];
+    int group;
+};
+
+static bool Initialized = false;
+static int ActiveStatCount = CoreStatCount;
+static vector<DrawGroup> Groups;
+static vector<pair<GLuint, string> > ProgramNames;
+static vector<QuerySet> FreeSets;
+static vector<QuerySet> InFlightSets;
+static int OpenSet = -1;
+static QuerySet OpenQuerySet;
+static unsigned long SkippedDraws = 0;
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static int find_group(GLuint program, const char *mesh)
+{
+    for (size_t i = 0; i < Groups.size(); i++)
+    {
+        if (Groups[i].program == program && Groups[i].mesh == mesh)
+        {
+            return (int) i;
+        }
+    }
+
+    DrawGroup group;
+    group.program = program;
+    group.mesh = mesh;
+    group.samples = 0;
+    memset(group.totals, 0, sizeof(group.totals));
+    memset(group.last, 0, sizeof(group.last));
+    Groups.push_back(group);
+
+    return (int) Groups.size() - 1;
+}
+
+static const char *program_name(GLuint program)
+{
+    for (size_t i = 0; i < ProgramNames.size(); i++)
+    {
+        if (ProgramNames[i].first == program)
+        {
+            return ProgramNames[i].second.c_str();
+        }
+    }
+
+    return "unnamed";
+}
+
+static bool acquire_query_set(QuerySet &set)
+{
+    if (!FreeSets.empty())
+    {
+        set = FreeSets.back();
+        FreeSets.pop_back();
+        return true;
+    }
+
+    if (InFlightSets.size() >= MaxQuerySetsInFlight)
+    {
+        return false;
+    }
+
+    glGenQueries(ActiveStatCount, set.queries);
+    return true;
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+void gpu_stats_initialize()
+{
+    ActiveStatCount = CoreStatCount;
+
+    if (glfwExtensionSupported("GL_ARB_pipeline_statistics_query"))
+    {
+        ActiveStatCount = StatCount;
+    }
+    else
+    {
+        cerr << "GL_ARB_pipeline_statistics_query not supported, "
+             << "only primitive and sample counts are collected" << endl;
+    }
+
+    Initialized = true;
+}
+
+void gpu_stats_shutdown()
+{
+    for (size_t i = 0; i < FreeSets.size(); i++)
+    {
+        glDeleteQueries(ActiveStatCount, FreeSets[i].queries);
+    }
+    for (size_t i = 0; i < InFlightSets.size(); i++)
+    {
+        glDeleteQueries(ActiveStatCount, InFlightSets[i].queries);
+    }
+
+    FreeSets.clear();
+    InFlightSets.clear();
+    Initialized = false;
+}
+
+void gpu_stats_name_program(GLuint program, const char *name)
+{
+    ProgramNames.push_back(make_pair(program, string(name)));
+}
+
+void gpu_stats_begin_draw(GLuint program, const char *mesh)
+{
+    if (!Initialized || OpenSet >= 0)
+    {
+        return;
+    }
+
+    if (!acquire_query_set(OpenQuerySet))
+    {
+        SkippedDraws++;
+        return;
+    }
+
+    OpenQuerySet.group = find_group(program, mesh);
+    OpenSet = OpenQuerySet.group;
+
+    for (int s = 0; s < ActiveStatCount; s++)
+    {
+        glBeginQuery(StatTargets[s], OpenQuerySet.queries[s]);
+    }
+}
+
+void gpu_stats_end_draw()
+{
+    if (OpenSet < 0)
+    {
+        return;
+    }
+
+    for (int s = 0; s < ActiveStatCount; s++)
+    {
+        glEndQuery(StatTargets[s]);
+    }
+
+    InFlightSets.push_back(OpenQuerySet);
+    OpenSet = -1;
+}
+
+void gpu_stats_end_frame()
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < InFlightSets.size(); i++)
+    {
+        QuerySet &set = InFlightSets[i];
+
+        // Completion is only ordered within one query target, and the
+        // set mixes several, so every query must be ready before any
+        // is read
+        GLint available = 1;
+
+        for (int s = 0; s < ActiveStatCount && available; s++)
+        {
+            glGetQueryObjectiv(set.queries[s], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+
+        if (!available)
+        {
+            InFlightSets[kept++] = set;
+            continue;
+        }
+
+        DrawGroup &group = Groups[set.group];
+
+        for (int s = 0; s < ActiveStatCount; s++)
+        {
+            GLuint64 value = 0;
+            glGetQueryObjectui64v(set.queries[s], GL_QUERY_RESULT, &value);
+
+            group.last[s] = value;
+            group.totals[s] += value;
+        }
+
+        group.samples++;
+        FreeSets.push_back(set);
+    }
+
+    InFlightSets.resize(kept);
+}
+
+void gpu_stats_report(ostream &out)
+{
+    if (Groups.empty())
+    {
+        return;
+    }
+
+    // Formatting is restored afterwards, the stream is the caller's
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+
+    out << "GPU pipeline statistics (per-draw-group averages)" << endl;
+    out << fixed << setprecision(1);
+
+    for (size_t i = 0; i < Groups.size(); i++)
+    {
+        const DrawGroup &group = Groups[i];
+
+        if (group.samples == 0)
+        {
+            continue;
+        }
+
+        double samples = (double) group.samples;
+
+        out << "  " << program_name(group.program) << " / " << group.mesh
+            << " (" << group.samples << " samples)" << endl;
+
+        for (int s = 0; s < ActiveStatCount; s++)
+        {
+            out << "    " << left << setw(16) << StatNames[s] << right
+                << setw(14) << group.totals[s] / samples << endl;
+        }
+
+        // Rough hint of which stage dominates the draw group
+        if (ActiveStatCount == StatCount && group.totals[StatVertexInvocations] > 0)
+        {
+            double ratio = (double) group.totals[StatFragmentInvocations] / group.totals[StatVertexInvocations];
+            out << "    fragments per vertex " << ratio
+                << (ratio > 1.0 ? " (fragment bound)" : " (vertex bound)") << endl;
+        }
+    }
+
+    if (SkippedDraws > 0)
+    {
+        out << "  " << SkippedDraws << " draw groups not sampled (query pool exhausted)" << endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,267 @@
+#include "image_diff.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// simd=none (VECMATH_SCALAR) builds the plain loop here too
+#if !defined(VECMATH_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#elif !defined(VECMATH_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Tolerance diff
+//--------------------------------------------------------------
+
+static inline bool pixel_differs(const unsigned char *a, const unsigned char *b, int tolerance, int &maxDifference)
+{
+    bool differs = false;
+
+    for (int c = 0; c < 4; c++)
+    {
+        int difference = abs((int) a[c] - (int) b[c]);
+        maxDifference = max(maxDifference, difference);
+        differs = differs || difference > tolerance;
+    }
+
+    return differs;
+}
+
+ImageDiffResult diff_rgba_scalar(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance)
+{
+    ImageDiffResult result = { 0, 0 };
+
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        if (pixel_differs(a + i * 4, b + i * 4, tolerance, result.maxChannelDifference))
+        {
+            result.differingPixels++;
+        }
+    }
+
+    return result;
+}
+
+#if !defined(VECMATH_SCALAR) && defined(__AVX2__)
+
+ImageDiffResult diff_rgba(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance)
+{
+    ImageDiffResult result = { 0, 0 };
+
+    const __m256i limit = _mm256_set1_epi8((char) min(max(tolerance, 0), 255));
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i maxima = zero;
+    size_t i = 0;
+
+    // 8 pixels per iteration
+    for (; i + 8 <= pixelCount; i += 8)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i * 4));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i * 4));
+
+        // |a - b| from two saturating subtractions
+        __m256i difference = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        maxima = _mm256_max_epu8(maxima, difference);
+
+        // A pixel passes when all four channels are within tolerance
+        __m256i excess = _mm256_subs_epu8(difference, limit);
+        __m256i within = _mm256_cmpeq_epi32(excess, zero);
+        int passing = _mm256_movemask_ps(_mm256_castsi256_ps(within));
+
+        result.differingPixels += 8 - __builtin_popcount(passing);
+    }
+
+    unsigned char lanes[32];
+    _mm256_storeu_si256((__m256i *) lanes, maxima);
+    result.maxChannelDifference = *max_element(lanes, lanes + 32);
+
+    for (; i < pixelCount; i++)
+    {
+        if (pixel_differs(a + i * 4, b + i * 4, tolerance, result.maxChannelDifference))
+        {
+            result.differingPixels++;
+        }
+    }
+
+    return result;
+}
+
+#elif !defined(VECMATH_SCALAR) && defined(__SSE2__)
+
+ImageDiffResult diff_rgba(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance)
+{
+    ImageDiffResult result = { 0, 0 };
+
+    const __m128i limit = _mm_set1_epi8((char) min(max(tolerance, 0), 255));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maxima = zero;
+    size_t i = 0;
+
+    // 4 pixels per iteration
+    for (; i + 4 <= pixelCount; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i * 4));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i * 4));
+
+        // |a - b| from two saturating subtractions
+        __m128i difference = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        maxima = _mm_max_epu8(maxima, difference);
+
+        // A pixel passes when all four channels are within tolerance
+        __m128i excess = _mm_subs_epu8(difference, limit);
+        __m128i within = _mm_cmpeq_epi32(excess, zero);
+        int passing = _mm_movemask_ps(_mm_castsi128_ps(within));
+
+        result.differingPixels += 4 - __builtin_popcount(passing);
+    }
+
+    unsigned char lanes[16];
+    _mm_storeu_si128((__m128i *) lanes, maxima);
+    result.maxChannelDifference = *max_element(lanes, lanes + 16);
+
+    for (; i < pixelCount; i++)
+    {
+        if (pixel_differs(a + i * 4, b + i * 4, tolerance, result.maxChannelDifference))
+        {
+            result.differingPixels++;
+        }
+    }
+
+    return result;
+}
+
+#else
+
+ImageDiffResult diff_rgba(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance)
+{
+    return diff_rgba_scalar(a, b, pixelCount, tolerance);
+}
+
+#endif
+
+void diff_rgba_mask(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance, unsigned char *mask)
+{
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        int ignored = 0;
+        bool differs = pixel_differs(a + i * 4, b + i * 4, tolerance, ignored);
+
+        for (int c = 0; c < 3; c++)
+        {
+            mask[i * 4 + c] = differs ? 255 : a[i * 4 + c] / 4;
+        }
+        mask[i * 4 + 3] = 255;
+    }
+}
+
+//--------------------------------------------------------------
+// XXH64
+//--------------------------------------------------------------
+
+static const uint64_t Prime1 = 11400714785074694791ull;
+static const uint64_t Prime2 = 14029467366897019727ull;
+static const uint64_t Prime3 = 1609587929392839161ull;
+static const uint64_t Prime4 = 9650029242287828579ull;
+static const uint64_t Prime5 = 2870177450012600261ull;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * Prime2;
+    accumulator = rotl(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static inline uint64_t merge_round(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= round64(0, value);
+    return accumulator * Prime1 + Prime4;
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        // Four independent lanes keep the multipliers busy
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+
+        const unsigned char *limit = end - 32;
+
+        do
+        {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    }
+    else
+    {
+        hash = seed + Prime5;
+    }
+
+    hash += (uint64_t) size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= round64(0, read64(p));
+        hash = rotl(hash, 27) * Prime1 + Prime4;
+    }
+
+    if (p + 4 <= end)
+    {
+        hash ^= (uint64_t) read32(p) * Prime1;
+        hash = rotl(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        hash ^= (*p) * Prime5;
+        hash = rotl(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
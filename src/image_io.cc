@@ -0,0 +1,223 @@
+#include "image_io.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <zlib.h>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// PPM
+//--------------------------------------------------------------
+
+bool write_ppm(const std::string &filename, const unsigned char *pixels, int width, int height)
+{
+    vector<unsigned char> data;
+    encode_ppm(pixels, width, height, data);
+
+    return write_file(filename, data);
+}
+
+void encode_ppm(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out)
+{
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    out.resize(headerSize + (size_t) width * height * 3);
+    memcpy(&out[0], header, headerSize);
+
+    unsigned char *target = &out[headerSize];
+
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const unsigned char *source = pixels + (size_t) y * width * 4;
+
+        for (int x = 0; x < width; x++)
+        {
+            *target++ = source[x * 4 + 0];
+            *target++ = source[x * 4 + 1];
+            *target++ = source[x * 4 + 2];
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// PNG
+//--------------------------------------------------------------
+
+static void put_u32(vector<unsigned char> &out, unsigned long value)
+{
+    out.push_back((value >> 24) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+static void put_chunk(vector<unsigned char> &out, const char *type, const unsigned char *data, size_t size)
+{
+    put_u32(out, size);
+
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+
+    // The CRC covers the chunk type and data
+    put_u32(out, crc32(0, &out[start], size + 4));
+}
+
+bool encode_png(const unsigned char *pixels, int width, int height, int level, std::vector<unsigned char> &out)
+{
+    size_t sourceStride = (size_t) width * 4;
+    size_t stride = (size_t) width * 3;
+
+    // Alpha is dropped like in the PPM: the scenes clear to alpha 0,
+    // which would come out transparent instead of black. Each row gets
+    // a filter byte; the Up filter stores the difference to the
+    // previous row, which compresses rendered images well at very
+    // little cost
+    vector<unsigned char> filtered((stride + 1) * height);
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = pixels + (size_t) (height - 1 - y) * sourceStride;
+        const unsigned char *previous = row + sourceStride;
+        unsigned char *target = &filtered[(stride + 1) * y];
+        target[0] = y == 0 ? 0 : 2;
+        target++;
+
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned char above = y == 0 ? 0 : previous[x * 4 + c];
+                *target++ = row[x * 4 + c] - above;
+            }
+        }
+    }
+
+    uLongf compressedSize = compressBound(filtered.size());
+    vector<unsigned char> compressed(compressedSize);
+
+    if (compress2(&compressed[0], &compressedSize, &filtered[0], filtered.size(), level) != Z_OK)
+    {
+        cerr << "PNG compression failed" << endl;
+        return false;
+    }
+
+    static const unsigned char Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    unsigned char header[13];
+    header[0] = (width >> 24) & 0xff;
+    header[1] = (width >> 16) & 0xff;
+    header[2] = (width >> 8) & 0xff;
+    header[3] = width & 0xff;
+    header[4] = (height >> 24) & 0xff;
+    header[5] = (height >> 16) & 0xff;
+    header[6] = (height >> 8) & 0xff;
+    header[7] = height & 0xff;
+    header[8] = 8;      // Bit depth
+    header[9] = 2;      // RGB
+    header[10] = 0;     // Deflate
+    header[11] = 0;     // Adaptive filtering
+    header[12] = 0;     // No interlace
+
+    out.clear();
+    out.reserve(compressedSize + 64);
+    out.insert(out.end(), Signature, Signature + 8);
+    put_chunk(out, "IHDR", header, sizeof(header));
+    put_chunk(out, "IDAT", &compressed[0], compressedSize);
+    put_chunk(out, "IEND", NULL, 0);
+
+    return true;
+}
+
+//--------------------------------------------------------------
+// Raw frames and files
+//--------------------------------------------------------------
+
+void encode_raw(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out)
+{
+    size_t stride = (size_t) width * 4;
+    out.resize(stride * height);
+
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(&out[stride * y], pixels + stride * (height - 1 - y), stride);
+    }
+}
+
+bool write_file(const std::string &filename, const std::vector<unsigned char> &data)
+{
+    FILE *out = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+
+    if (!out)
+    {
+        cerr << "Could not open " << filename << " for writing" << endl;
+        return false;
+    }
+
+    bool ok = data.empty() || fwrite(&data[0], 1, data.size(), out) == data.size();
+
+    if (out == stdout)
+    {
+        ok = fflush(out) == 0 && ok;
+    }
+    else
+    {
+        ok = fclose(out) == 0 && ok;
+    }
+
+    return ok;
+}
+
+bool read_ppm(const std::string &filename, std::vector<unsigned char> &pixels, int &width, int &height)
+{
+    FILE *in = fopen(filename.c_str(), "rb");
+
+    if (!in)
+    {
+        return false;
+    }
+
+    int maxValue = 0;
+    bool ok = fscanf(in, "P6 %d %d %d", &width, &height, &maxValue) == 3
+        && maxValue == 255 && width > 0 && height > 0 && fgetc(in) != EOF;
+
+    if (ok)
+    {
+        vector<unsigned char> rgb((size_t) width * height * 3);
+        ok = fread(&rgb[0], 1, rgb.size(), in) == rgb.size();
+
+        pixels.resize((size_t) width * height * 4);
+
+        for (size_t i = 0; ok && i < (size_t) width * height; i++)
+        {
+            pixels[i * 4 + 0] = rgb[i * 3 + 0];
+            pixels[i * 4 + 1] = rgb[i * 3 + 1];
+            pixels[i * 4 + 2] = rgb[i * 3 + 2];
+            pixels[i * 4 + 3] = 255;
+        }
+    }
+
+    fclose(in);
+
+    if (!ok)
+    {
+        cerr << "Could not read " << filename << " as an 8-bit binary PPM" << endl;
+    }
+
+    return ok;
+}
+
+void normalize_readback(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out)
+{
+    encode_raw(pixels, width, height, out);
+
+    for (size_t i = 3; i < out.size(); i += 4)
+    {
+        out[i] = 255;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef INC_BENCHMARK_H
+#define INC_BENCHMARK_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// CPU kernel benchmarks
+//
+// --bench NAME[,NAME...] runs the named benchmarks instead of the
+// renderer; no window or GL context is created. Each one first checks
+// the optimized kernels against their plain C++ reference on random
+// data, then times both. Returns false if any check failed or a name
+// is unknown.
+//--------------------------------------------------------------
+
+bool run_benchmarks(const std::vector<std::string> &names, std::ostream &out);
+
+#endif
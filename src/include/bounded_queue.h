@@ -0,0 +1,127 @@
+#ifndef INC_BOUNDED_QUEUE_H
+#define INC_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//--------------------------------------------------------------
+// Bounded lock-free multi-producer/multi-consumer queue
+//
+// Dmitry Vyukov's array queue: every cell carries a sequence
+// number that tells producers and consumers whether it is free
+// for them, so push and pop are a single CAS on the fast path and
+// never take a lock. Capacity is rounded up to a power of two.
+//--------------------------------------------------------------
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        cells = std::vector<Cell>(size);
+        mask = size - 1;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    // Returns false if the queue is full
+    bool push(const T &value)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell &cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t) sequence - (ptrdiff_t) pos;
+
+            if (difference == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T &value)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell &cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t) sequence - (ptrdiff_t) (pos + 1);
+
+            if (difference == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+
+        Cell() : sequence(0), value() {}
+        Cell(const Cell &other) : sequence(other.sequence.load()), value(other.value) {}
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+
+    // Kept on separate cache lines so producers and consumers do
+    // not fight over the same line
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+    BoundedQueue(const BoundedQueue &);
+    BoundedQueue &operator=(const BoundedQueue &);
+};
+
+#endif
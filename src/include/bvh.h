@@ -0,0 +1,155 @@
+#ifndef INC_BVH_H
+#define INC_BVH_H
+
+#include "frustum_cull.h"
+#include "vecmath.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <vector>
+
+//--------------------------------------------------------------
+// Bounding volume hierarchy
+//
+// A binary tree of boxes over primitive boxes, for culling and
+// queries that should not touch every object. Each node is split
+// where the surface area heuristic, evaluated over a few bins of
+// primitive centroids per axis, predicts the cheapest traversal.
+//
+// With a WorkerPool the large nodes near the root bin their
+// primitives in parallel, and once the tree has split into enough
+// subtrees those are built as independent tasks.
+//
+// refit() keeps the tree shape and recomputes the node boxes, for
+// objects that move without the scene changing much; rebuild when
+// queries slow down as the boxes grow to overlap.
+//
+// Nodes are stored with both children next to each other after
+// their parent, so a reverse walk visits children before parents.
+// Queries return the primitives' indices in the boxes given to
+// build(), in no particular order. The primitive boxes are tested the
+// same way as by the brute-force versions at the end, so the results
+// match them exactly.
+//--------------------------------------------------------------
+
+struct Aabb
+{
+    Vec3 lower;
+    Vec3 upper;
+
+    Aabb() {}
+    Aabb(const Vec3 &lower, const Vec3 &upper) : lower(lower), upper(upper) {}
+};
+
+struct BvhNode
+{
+    Vec3 lower;
+    uint32_t leftOrFirst;       // Left child for an inner node, first primitive for a leaf
+    Vec3 upper;
+    uint32_t count;             // Primitives in a leaf, 0 for an inner node
+};
+
+struct BvhRayHit
+{
+    uint32_t primitive;
+    float distance;
+};
+
+struct BvhCullStats
+{
+    size_t nodesVisited;
+    size_t nodesAccepted;       // Fully inside, primitives taken without tests
+    size_t primitivesTested;
+};
+
+class Bvh
+{
+public:
+    Bvh();
+
+    void build(const std::vector<Aabb> &boxes, WorkerPool *pool = NULL);
+
+    // boxes must be the same primitives, in the same order, as at build()
+    void refit(const std::vector<Aabb> &boxes, WorkerPool *pool = NULL);
+
+    BvhCullStats cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+    // Nearest primitive box hit along the ray within maxDistance;
+    // direction need not be normalized (distance is in its units)
+    bool raycast(const Vec3 &origin, const Vec3 &direction, float maxDistance, BvhRayHit &hit) const;
+
+    // Appends every primitive whose box overlaps query
+    void query_box(const Aabb &query, std::vector<uint32_t> &results) const;
+
+    size_t node_count() const { return nodes.size(); }
+    size_t primitive_count() const { return primitives.size(); }
+    int depth() const;
+
+private:
+    struct Bin
+    {
+        Aabb bounds;
+        Aabb centroids;
+        uint32_t count;
+    };
+
+    struct Split
+    {
+        int axis;
+        int bin;                    // Last bin on the left
+        int binCount;
+        float cost;
+        uint32_t leftCount;
+        Aabb leftBounds, rightBounds;
+        Aabb leftCentroids, rightCentroids;
+    };
+
+    // A node range left for a parallel task to build
+    struct PendingTask
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        int depth;
+        Aabb bounds;
+        Aabb centroidBounds;
+    };
+
+    // Nodes below a task's root, stored together as [begin, end)
+    struct Subtree
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    void build_node(uint32_t index, uint32_t first, uint32_t count, int depth, const Aabb &bounds,
+                    const Aabb &centroidBounds, std::vector<BvhNode> &out, WorkerPool *pool);
+    bool find_split(uint32_t first, uint32_t count, const Aabb &bounds, const Aabb &centroidBounds,
+                    WorkerPool *pool, Split &split);
+    void bin_primitives(uint32_t first, uint32_t count, const Aabb &centroidBounds, int binCount, Bin *bins) const;
+    void partition(uint32_t first, uint32_t count, const Aabb &centroidBounds, const Split &split);
+    void refit_range(uint32_t begin, uint32_t end);
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> primitives;       // Original indices, in leaf order
+    std::vector<Aabb> primitiveBoxes;       // In leaf order
+    std::vector<Vec3> centroids;            // Build scratch, in leaf order
+
+    // Parallel build: the top of the tree is [0, topNodes), split on
+    // the calling thread, and each task's subtree is stored after it
+    uint32_t topNodes;
+    uint32_t taskSize;
+    std::vector<PendingTask> pending;
+    std::vector<Subtree> subtrees;
+
+    Bvh(const Bvh &);
+    Bvh &operator=(const Bvh &);
+};
+
+// Brute force over every box, for checking and comparing
+void cull_boxes_reference(const Frustum &frustum, const std::vector<Aabb> &boxes, std::vector<uint32_t> &visible);
+bool raycast_reference(const std::vector<Aabb> &boxes, const Vec3 &origin, const Vec3 &direction,
+                       float maxDistance, BvhRayHit &hit);
+void query_box_reference(const std::vector<Aabb> &boxes, const Aabb &query, std::vector<uint32_t> &results);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef INC_DAMAGE_H
+#define INC_DAMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+//--------------------------------------------------------------
+// Scene damage tracking
+//
+// Anything that changes what is on screen invalidates the scene
+// with a reason. The main loop only renders when the scene is
+// invalid and otherwise sleeps in glfwWaitEvents, leaving the last
+// presented frame on screen.
+//
+// Damage can also be limited to rectangles. When nothing but
+// rectangles were damaged, the renderer redraws just their merged
+// union with scissoring into a persistent backbuffer.
+//--------------------------------------------------------------
+
+enum DamageReason
+{
+    DamageInput = 1 << 0,
+    DamageResize = 1 << 1,
+    DamageAnimation = 1 << 2,   // Animated content stepped
+    DamageAsset = 1 << 3,       // Shaders or cached layers (re)built
+    DamageExpose = 1 << 4,      // Window contents lost (refresh callback)
+    DamageDebug = 1 << 5,       // Debug overlays or screenshots
+    DamageRegion = 1 << 6       // Rectangles given to damage_invalidate_rect
+};
+
+// Framebuffer pixels, bottom-left origin like glScissor
+struct DamageRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Damages the whole frame
+void damage_invalidate(unsigned reasons);
+
+// Damages a rectangle; the extra reasons are reported by
+// damage_consume but do not force a full redraw
+void damage_invalidate_rect(int x, int y, int width, int height, unsigned reasons = 0);
+
+// Returns the pending reasons and marks the scene clean. If only
+// rectangles were damaged (no damage_invalidate call), regions
+// receives their merged union (at most maxRegions rectangles, clipped
+// to the framebuffer); it is left empty when the whole frame has to
+// be redrawn, including when the rectangles cover more than
+// fullFrameFraction of it.
+unsigned damage_consume(int framebufferWidth, int framebufferHeight, std::vector<DamageRect> &regions,
+                        size_t maxRegions = 8, float fullFrameFraction = 0.6f);
+unsigned damage_consume();
+bool damage_pending();
+
+// Animations ask to be woken at a point in time (glfwGetTime());
+// the earliest pending request wins. Waking does not damage anything
+// by itself: the animation invalidates what it changed when it runs.
+void damage_schedule(double time);
+
+// Seconds until the next scheduled wake (0 if already due), negative
+// if none. A due wake-up is cleared.
+double damage_time_until_wake(double now);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef INC_FRAME_EXPORT_H
+#define INC_FRAME_EXPORT_H
+
+#include "bounded_queue.h"
+#include "render_target.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------
+// Frame sequence export
+//
+// Finished readbacks are copied into recycled frame buffers and
+// pushed through a bounded lock-free queue to a pool of encoder
+// threads, which compress (PNG/PPM) and write each frame. The
+// render thread only pays for the copy; it waits solely when the
+// queue is full, i.e. when encoding cannot keep up at all, and
+// those waits are counted.
+//
+// Raw output to stdout must stay in frame order, so it uses a
+// single writer thread.
+//--------------------------------------------------------------
+
+struct FrameExportStats
+{
+    uint64_t framesWritten;
+    uint64_t bytesWritten;
+    uint64_t submitStalls;      // Times the render thread found the queue full
+    double encodeSeconds;       // Summed over all encoder threads
+};
+
+class FrameExporter
+{
+public:
+    // threads <= 0 uses one encoder per core
+    FrameExporter(const std::string &format, const std::string &pathPattern, int threads, int pngLevel);
+    ~FrameExporter();
+
+    void submit(const ReadbackImage &image);
+
+    // Drains the queue and joins the encoders
+    void finish();
+
+    FrameExportStats stats() const;
+    int thread_count() const { return (int) workers.size(); }
+
+private:
+    struct FrameJob
+    {
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> encoded;
+        int width;
+        int height;
+        uint64_t frame;
+    };
+
+    void encode_loop();
+    bool encode_and_write(FrameJob &job);
+
+    std::string format;
+    std::string pathPattern;
+    int pngLevel;
+
+    BoundedQueue<FrameJob *> pending;
+    BoundedQueue<FrameJob *> recycled;
+    std::vector<std::thread> workers;
+    std::atomic<bool> closing;
+
+    std::atomic<uint64_t> framesWritten;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> encodeNanoseconds;
+    uint64_t submitStalls;
+
+    FrameExporter(const FrameExporter &);
+    FrameExporter &operator=(const FrameExporter &);
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef INC_FRAME_GRAPH_H
+#define INC_FRAME_GRAPH_H
+
+#include "opengl.h"
+#include "render_target.h"
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// Frame graph
+//
+// Each frame the renderer declares its passes and the render
+// targets they read and write instead of binding targets itself:
+//
+//  - transient textures (create_texture) live only within the frame
+//    and get their storage from a RenderTargetPool at execution
+//  - imported targets (the window, persistent buffers) are owned
+//    elsewhere and are the graph's outputs
+//
+// compile() then
+//
+//  - culls passes whose results never reach an output
+//  - orders passes by their dependencies, preferring to keep
+//    passes that draw into the same target next to each other
+//  - lets transients with non-overlapping lifetimes share storage
+//
+// and execute() binds each pass's target (skipping redundant FBO
+// switches), times it on the CPU and with GPU timestamps, and runs it.
+//
+// A pass overwrites its target. One that draws on top of what is
+// already there has to read the target as well.
+//--------------------------------------------------------------
+
+typedef int FrameResource;
+
+class FrameGraph
+{
+public:
+    typedef std::function<void()> ExecuteFunction;
+
+    FrameGraph(RenderTargetPool *pool);
+    ~FrameGraph();
+
+    // Forgets the previous frame's declarations
+    void reset();
+
+    FrameResource create_texture(const std::string &name, const RenderTargetDesc &desc);
+
+    // scaleX/Y: the used part of texture (see ResizableTarget)
+    FrameResource import_target(const std::string &name, GLuint framebuffer, GLuint texture,
+                                int width, int height, float scaleX = 1.0f, float scaleY = 1.0f);
+
+    // write may be -1 for a pass that draws nothing (it is culled)
+    int add_pass(const std::string &name, const std::vector<FrameResource> &reads,
+                 FrameResource write, const ExecuteFunction &execute);
+
+    // Returns false on a dependency cycle
+    bool compile();
+    void execute();
+
+    // For execute functions
+    GLuint texture(FrameResource resource) const;
+    float scale_x(FrameResource resource) const { return resources[resource].scaleX; }
+    float scale_y(FrameResource resource) const { return resources[resource].scaleY; }
+    int width(FrameResource resource) const { return resources[resource].desc.width; }
+    int height(FrameResource resource) const { return resources[resource].desc.height; }
+
+    void report(std::ostream &out);
+
+private:
+    struct Resource
+    {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        GLuint framebuffer;     // Imported only
+        GLuint texture;
+        float scaleX;
+        float scaleY;
+        int physical;           // Transient storage slot after compile()
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<FrameResource> reads;
+        FrameResource write;
+        ExecuteFunction execute;
+    };
+
+    struct PassTiming
+    {
+        unsigned long executions;
+        double cpuSeconds;
+        double gpuSeconds;
+        unsigned long gpuSamples;
+    };
+
+    // Timestamps of one executed frame, read back a few frames later
+    struct TimestampSet
+    {
+        std::vector<GLuint> queries;
+        std::vector<PassTiming *> timings;
+        bool pending;
+    };
+
+    void collect_timestamps();
+
+    RenderTargetPool *pool;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<int> order;                     // Live passes in execution order
+    std::vector<RenderTargetDesc> physicals;    // Storage shared by transients
+
+    // Keyed by pass name; map nodes keep the names stable for profiler zones
+    std::map<std::string, PassTiming> timings;
+
+    bool timestampsAvailable;
+    std::vector<TimestampSet> timestampRing;
+    unsigned long frameIndex;
+
+    unsigned long framesExecuted;
+    unsigned long passesDeclared;
+    unsigned long passesCulled;
+    unsigned long transientsDeclared;
+    unsigned long transientsAllocated;
+    unsigned long framebufferBinds;
+
+    FrameGraph(const FrameGraph &);
+    FrameGraph &operator=(const FrameGraph &);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef INC_FRAME_PACER_H
+#define INC_FRAME_PACER_H
+
+#include <ostream>
+#include <string>
+
+//--------------------------------------------------------------
+// Frame pacing
+//
+// Frames are started so that they finish on an even grid of
+// 1 / targetFrameRate: the pacer predicts how long the next frame
+// will take to render (from the recent render durations) and holds
+// the start back until deadline - prediction. Input is then sampled
+// as late as possible and frames are presented at a steady rate.
+//
+// Waiting sleeps for the bulk of the time and spins for the last
+// part, since sleeps routinely overshoot by a scheduler tick. The
+// spin margin follows the measured oversleep.
+//
+// The swap interval is set once at startup; adaptive sync (late
+// swaps tear instead of waiting a whole refresh) falls back to
+// plain vsync where GLX/WGL_EXT_swap_control_tear is missing.
+//--------------------------------------------------------------
+
+enum SwapMode
+{
+    SwapDriverDefault,      // Leave the swap interval alone
+    SwapImmediate,          // 0: no vsync
+    SwapVsync,              // 1
+    SwapAdaptive            // -1: vsync unless the frame is late
+};
+
+struct FramePacerConfig
+{
+    double targetFrameRate;     // 0 for no limit
+    SwapMode swapMode;
+};
+
+// Needs the window's context to be current
+void frame_pacer_initialize(const FramePacerConfig &config);
+
+// Blocks until the next frame should start. Returns the seconds waited.
+double frame_pacer_begin_frame();
+
+// Call right before and right after the buffer swap. Only the part
+// before it counts as render time, a vsynced swap blocks. A frame
+// finished ahead of its deadline is held until then.
+void frame_pacer_end_render();
+void frame_pacer_end_frame();
+
+void frame_pacer_report(std::ostream &out);
+
+// Parses "default", "off", "vsync" or "adaptive"
+bool parse_swap_mode(const std::string &name, SwapMode &mode);
+
+#endif
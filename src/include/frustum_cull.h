@@ -0,0 +1,90 @@
+#ifndef INC_FRUSTUM_CULL_H
+#define INC_FRUSTUM_CULL_H
+
+#include "vecmath.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+//--------------------------------------------------------------
+// Frustum culling
+//
+// Object bounds are kept as arrays per component (center, box
+// half-extents) so one SIMD register holds the same value for 4 (SSE)
+// or 8 (AVX) objects. Each plane is tested against the boxes of all
+// of them at once: an object is culled as soon as its box lies fully
+// behind any plane. Surviving indices are written out in order
+// without branching on the result. (A bounding sphere test adds
+// nothing: the sphere around a box reaches at least as far past
+// every plane as the box does.)
+//
+// The culler splits the objects into chunks for a WorkerPool and
+// joins the chunks' visible lists in object order, so the draw queue
+// sees the same list whatever the thread count.
+//--------------------------------------------------------------
+
+// Planes as (normal, distance), inside where dot(normal, p) + distance >= 0
+struct Frustum
+{
+    Vec4 planes[6];
+};
+
+// Gribb/Hartmann extraction from a projection * view matrix
+Frustum frustum_from_matrix(const Mat4 &viewProjection);
+
+struct CullBounds
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t size() const { return centerX.size(); }
+
+    void resize(size_t count);
+    void set(size_t index, const Vec3 &center, const Vec3 &extents);
+};
+
+// World bounds of a local box (center, extents) under matrix
+void transform_bounds(const Mat4 &matrix, const Vec3 &center, const Vec3 &extents,
+                      Vec3 &worldCenter, Vec3 &worldExtents);
+
+// Appends the indices in [begin, end) that are at least partly inside
+void cull_bounds(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end,
+                 std::vector<uint32_t> &visible);
+
+// Plain C++ version, for checking and comparing
+void cull_bounds_reference(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end,
+                           std::vector<uint32_t> &visible);
+
+struct CullStats
+{
+    unsigned long frames;
+    unsigned long long tested;
+    unsigned long long visible;
+    double seconds;
+    double lastSeconds;
+};
+
+class FrustumCuller
+{
+public:
+    // pool may be NULL to cull on the calling thread
+    FrustumCuller(WorkerPool *pool = NULL);
+
+    // Replaces visible with the indices of the visible objects, ascending
+    void cull(const Frustum &frustum, const CullBounds &bounds, std::vector<uint32_t> &visible);
+
+    const CullStats &stats() const { return totals; }
+    void report(std::ostream &out) const;
+
+private:
+    WorkerPool *pool;
+    std::vector<std::vector<uint32_t> > chunkVisible;
+    CullStats totals;
+
+    FrustumCuller(const FrustumCuller &);
+    FrustumCuller &operator=(const FrustumCuller &);
+};
+
+#endif
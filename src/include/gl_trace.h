@@ -0,0 +1,137 @@
+#ifndef INC_GL_TRACE_H
+#define INC_GL_TRACE_H
+
+//--------------------------------------------------------------
+// GL call tracing
+//
+// In debug builds the GL entry points used by the renderer are
+// redirected through macros that count calls per frame, total
+// the bytes handed to glBufferData/glBufferSubData and time the
+// CPU cost of each call category. Release builds (NDEBUG) and
+// builds with GL_TRACE_DISABLED compile all of it out.
+//
+// Included from opengl.h, after the GL prototypes.
+//--------------------------------------------------------------
+
+#if !defined(NDEBUG) && !defined(GL_TRACE_DISABLED)
+#define GL_TRACE_ENABLED 1
+#endif
+
+#ifdef GL_TRACE_ENABLED
+
+#include <ostream>
+
+enum GlTraceCategory
+{
+    GlTraceBuffers,
+    GlTracePrograms,
+    GlTraceAttribs,
+    GlTraceDraws,
+    GlTraceState,
+    GlTraceCategoryCount
+};
+
+// Every traced entry point and the category it is billed to
+#define GL_TRACE_FUNCTIONS(X) \
+    X(glGenBuffers, GlTraceBuffers) \
+    X(glDeleteBuffers, GlTraceBuffers) \
+    X(glBindBuffer, GlTraceBuffers) \
+    X(glBufferData, GlTraceBuffers) \
+    X(glBufferSubData, GlTraceBuffers) \
+    X(glCreateShader, GlTracePrograms) \
+    X(glShaderSource, GlTracePrograms) \
+    X(glCompileShader, GlTracePrograms) \
+    X(glGetShaderiv, GlTracePrograms) \
+    X(glGetShaderInfoLog, GlTracePrograms) \
+    X(glCreateProgram, GlTracePrograms) \
+    X(glDeleteProgram, GlTracePrograms) \
+    X(glAttachShader, GlTracePrograms) \
+    X(glDetachShader, GlTracePrograms) \
+    X(glLinkProgram, GlTracePrograms) \
+    X(glGetProgramiv, GlTracePrograms) \
+    X(glGetProgramInfoLog, GlTracePrograms) \
+    X(glUseProgram, GlTracePrograms) \
+    X(glEnableVertexAttribArray, GlTraceAttribs) \
+    X(glDisableVertexAttribArray, GlTraceAttribs) \
+    X(glVertexAttribPointer, GlTraceAttribs) \
+    X(glDrawArrays, GlTraceDraws) \
+    X(glDrawElements, GlTraceDraws) \
+    X(glClear, GlTraceState) \
+    X(glClearColor, GlTraceState) \
+    X(glViewport, GlTraceState)
+
+#define GL_TRACE_ENUM_ENTRY(name, category) GlTrace_##name,
+enum GlTraceFunction
+{
+    GL_TRACE_FUNCTIONS(GL_TRACE_ENUM_ENTRY)
+    GlTraceFunctionCount
+};
+#undef GL_TRACE_ENUM_ENTRY
+
+void gl_trace_record(GlTraceFunction function, double seconds, long uploadBytes);
+double gl_trace_now();
+
+// Closes the per-frame counters and folds them into the totals
+void gl_trace_end_frame();
+
+// Average calls, bytes and CPU time per frame since startup
+void gl_trace_report(std::ostream &out);
+
+// Times one GL call; lives until the end of the traced expression
+struct GlTraceCall
+{
+    GlTraceFunction function;
+    long uploadBytes;
+    double start;
+
+    GlTraceCall(GlTraceFunction fn, long bytes = 0) : function(fn), uploadBytes(bytes), start(gl_trace_now()) {}
+    ~GlTraceCall() { gl_trace_record(function, gl_trace_now() - start, uploadBytes); }
+};
+
+#define GL_TRACE_CALL(fn, call) (GlTraceCall(fn), call)
+#define GL_TRACE_UPLOAD(fn, bytes, call) (GlTraceCall(fn, (long) (bytes)), call)
+
+#ifndef GL_TRACE_NO_INTERCEPT
+
+// Buffer uploads also record their size (the size argument is
+// evaluated twice, so keep it free of side effects)
+#define glBufferData(target, size, data, usage) \
+    GL_TRACE_UPLOAD(GlTrace_glBufferData, size, glBufferData(target, size, data, usage))
+#define glBufferSubData(target, offset, size, data) \
+    GL_TRACE_UPLOAD(GlTrace_glBufferSubData, size, glBufferSubData(target, offset, size, data))
+
+#define glGenBuffers(...) GL_TRACE_CALL(GlTrace_glGenBuffers, glGenBuffers(__VA_ARGS__))
+#define glDeleteBuffers(...) GL_TRACE_CALL(GlTrace_glDeleteBuffers, glDeleteBuffers(__VA_ARGS__))
+#define glBindBuffer(...) GL_TRACE_CALL(GlTrace_glBindBuffer, glBindBuffer(__VA_ARGS__))
+#define glCreateShader(...) GL_TRACE_CALL(GlTrace_glCreateShader, glCreateShader(__VA_ARGS__))
+#define glShaderSource(...) GL_TRACE_CALL(GlTrace_glShaderSource, glShaderSource(__VA_ARGS__))
+#define glCompileShader(...) GL_TRACE_CALL(GlTrace_glCompileShader, glCompileShader(__VA_ARGS__))
+#define glGetShaderiv(...) GL_TRACE_CALL(GlTrace_glGetShaderiv, glGetShaderiv(__VA_ARGS__))
+#define glGetShaderInfoLog(...) GL_TRACE_CALL(GlTrace_glGetShaderInfoLog, glGetShaderInfoLog(__VA_ARGS__))
+#define glCreateProgram(...) GL_TRACE_CALL(GlTrace_glCreateProgram, glCreateProgram(__VA_ARGS__))
+#define glDeleteProgram(...) GL_TRACE_CALL(GlTrace_glDeleteProgram, glDeleteProgram(__VA_ARGS__))
+#define glAttachShader(...) GL_TRACE_CALL(GlTrace_glAttachShader, glAttachShader(__VA_ARGS__))
+#define glDetachShader(...) GL_TRACE_CALL(GlTrace_glDetachShader, glDetachShader(__VA_ARGS__))
+#define glLinkProgram(...) GL_TRACE_CALL(GlTrace_glLinkProgram, glLinkProgram(__VA_ARGS__))
+#define glGetProgramiv(...) GL_TRACE_CALL(GlTrace_glGetProgramiv, glGetProgramiv(__VA_ARGS__))
+#define glGetProgramInfoLog(...) GL_TRACE_CALL(GlTrace_glGetProgramInfoLog, glGetProgramInfoLog(__VA_ARGS__))
+#define glUseProgram(...) GL_TRACE_CALL(GlTrace_glUseProgram, glUseProgram(__VA_ARGS__))
+#define glEnableVertexAttribArray(...) GL_TRACE_CALL(GlTrace_glEnableVertexAttribArray, glEnableVertexAttribArray(__VA_ARGS__))
+#define glDisableVertexAttribArray(...) GL_TRACE_CALL(GlTrace_glDisableVertexAttribArray, glDisableVertexAttribArray(__VA_ARGS__))
+#define glVertexAttribPointer(...) GL_TRACE_CALL(GlTrace_glVertexAttribPointer, glVertexAttribPointer(__VA_ARGS__))
+#define glDrawArrays(...) GL_TRACE_CALL(GlTrace_glDrawArrays, glDrawArrays(__VA_ARGS__))
+#define glDrawElements(...) GL_TRACE_CALL(GlTrace_glDrawElements, glDrawElements(__VA_ARGS__))
+#define glClear(...) GL_TRACE_CALL(GlTrace_glClear, glClear(__VA_ARGS__))
+#define glClearColor(...) GL_TRACE_CALL(GlTrace_glClearColor, glClearColor(__VA_ARGS__))
+#define glViewport(...) GL_TRACE_CALL(GlTrace_glViewport, glViewport(__VA_ARGS__))
+
+#endif // GL_TRACE_NO_INTERCEPT
+
+#else
+
+#define gl_trace_end_frame()
+#define gl_trace_report(out)
+
+#endif // GL_TRACE_ENABLED
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef INC_GPU_STATS_H
+#define INC_GPU_STATS_H
+
+#include "opengl.h"
+
+#include <ostream>
+
+//--------------------------------------------------------------
+// Per-draw-group GPU statistics
+//
+// Wraps groups of draw calls in primitives-generated and
+// samples-passed queries, plus the GL_ARB_pipeline_statistics_query
+// counters when the driver exposes them (vertices submitted, vertex
+// and fragment shader invocations, clipping input/output). Results
+// are read back without waiting and accumulated per (program, mesh)
+// pair, so the report shows which stage each draw group spends its
+// time in.
+//
+// Draw groups cannot be nested: GL allows one active query per target.
+//--------------------------------------------------------------
+
+void gpu_stats_initialize();
+void gpu_stats_shutdown();
+
+// Human readable name used for a program in the report
+void gpu_stats_name_program(GLuint program, const char *name);
+
+void gpu_stats_begin_draw(GLuint program, const char *mesh);
+void gpu_stats_end_draw();
+
+// Collects whatever results the driver has finished with
+void gpu_stats_end_frame();
+
+void gpu_stats_report(std::ostream &out);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef INC_IMAGE_DIFF_H
+#define INC_IMAGE_DIFF_H
+
+#include <stdint.h>
+#include <cstddef>
+
+//--------------------------------------------------------------
+// Image comparison for golden-image checks
+//
+// diff_rgba compares two RGBA8 images channel by channel with a
+// tolerance, 16 or 32 bytes at a time with SSE2/AVX2 when the
+// compiler targets them. hash_bytes is XXH64, used to recognise
+// exact matches without a per-pixel pass.
+//--------------------------------------------------------------
+
+struct ImageDiffResult
+{
+    size_t differingPixels;     // Pixels with any channel off by more than the tolerance
+    int maxChannelDifference;
+};
+
+ImageDiffResult diff_rgba(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance);
+
+// Reference implementation the SIMD paths must agree with
+ImageDiffResult diff_rgba_scalar(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance);
+
+// Writes a per-pixel mask (white where beyond tolerance, dimmed
+// original elsewhere) for looking at failures
+void diff_rgba_mask(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance, unsigned char *mask);
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef INC_IMAGE_IO_H
+#define INC_IMAGE_IO_H
+
+#include <string>
+#include <vector>
+
+// All functions take RGBA8 pixels bottom row first, as glReadPixels
+// returns them, and produce images top row first.
+
+// Writes a binary PPM (alpha dropped)
+bool write_ppm(const std::string &filename, const unsigned char *pixels, int width, int height);
+
+// In-memory encoders, out is replaced with the encoded file; PNGs
+// are RGB, alpha dropped as in the PPM
+void encode_ppm(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out);
+bool encode_png(const unsigned char *pixels, int width, int height, int level, std::vector<unsigned char> &out);
+
+// Top-down RGBA rows with no header, for piping into video encoders
+void encode_raw(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out);
+
+bool write_file(const std::string &filename, const std::vector<unsigned char> &data);
+
+// Reads a binary PPM into RGBA8 (alpha 255), top row first
+bool read_ppm(const std::string &filename, std::vector<unsigned char> &pixels, int &width, int &height);
+
+// Flips GL readback rows to top row first and forces alpha to 255,
+// so images compare the same way they are stored
+void normalize_readback(const unsigned char *pixels, int width, int height, std::vector<unsigned char> &out);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef INC_LAYERS_H
+#define INC_LAYERS_H
+
+#include "opengl.h"
+#include "render_target.h"
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// Layer compositing
+//
+// A scene is split into layers drawn bottom to top. A cached layer
+// renders into its own texture, which is only redrawn when the
+// layer is invalidated or the output size changes; every other
+// frame it costs one textured quad (or a blit, for an opaque bottom
+// layer). The textures are sized with hysteresis (ResizableTarget).
+// A direct layer is drawn straight into the output every time,
+// which is cheaper for content that changes every frame.
+//
+// Layers are cleared to transparent black before rendering and
+// composited as premultiplied alpha.
+//--------------------------------------------------------------
+
+enum LayerKind
+{
+    LayerCached,
+    LayerDirect
+};
+
+// Draws the layer's content into the bound framebuffer, without clearing
+typedef std::function<void()> LayerRenderFunction;
+
+struct LayerStats
+{
+    std::string name;
+    uint64_t renders;       // Times the content was drawn
+    uint64_t composites;    // Times a cached texture was reused
+};
+
+class LayerStack
+{
+public:
+    LayerStack();
+    ~LayerStack();
+
+    // Builds the composite program; needs a current GL context
+    bool initialize();
+
+    // Returns the layer index; layers are composited in the order added
+    int add_layer(const std::string &name, LayerKind kind, bool opaque, const LayerRenderFunction &render);
+
+    void invalidate(int layer);
+    void invalidate_all();
+
+    // Composites every layer into the bound framebuffer, which must be
+    // width x height. With bypassCache set all layers are drawn
+    // directly, e.g. while a debug view replaces their shaders.
+    void composite(int width, int height, bool bypassCache = false);
+
+    std::vector<LayerStats> stats() const;
+
+    // Cache texture reallocations over all layers
+    unsigned long reallocations() const;
+
+private:
+    struct Layer
+    {
+        std::string name;
+        LayerKind kind;
+        bool opaque;
+        LayerRenderFunction render;
+        ResizableTarget *cache;
+        bool dirty;
+        uint64_t renders;
+        uint64_t composites;
+    };
+
+    bool refresh_cache(Layer &layer, int width, int height);
+
+    std::vector<Layer> layers;
+    GLuint compositeProgram;
+    GLint layerTextureLocation;
+    GLint scaleLocation;
+    GLuint fullscreenVertexArray;
+
+    LayerStack(const LayerStack &);
+    LayerStack &operator=(const LayerStack &);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef INC_MESH_LOD_H
+#define INC_MESH_LOD_H
+
+#include "vecmath.h"
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// Mesh levels of detail
+//
+// A distant mesh covering a few dozen pixels gains nothing from its
+// full triangle count. The chain is built ahead of time by edge
+// collapses ordered by quadric error (Garland & Heckbert): each vertex
+// sums the planes of the triangles around it, and collapsing an edge
+// into one of its ends costs the distance (area-weighted RMS) from
+// that end to the planes of both. Collapses run cheapest first, and
+// a level is taken each time the triangle count has halved. Collapses
+// that turn a triangle by more than about 45 degrees or make the
+// surface non-manifold are refused, and open borders carry extra
+// planes so they keep their outline.
+//
+// Every vertex stays where it is, so all levels share one vertex
+// buffer and a level is just a range of the index buffer:
+//
+//     glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT,
+//                    (void *) (level.firstIndex * sizeof(uint32_t)));
+//
+// Each level records the largest distance (object units, from the
+// original surface) a collapse moved it by. At run time that error is
+// projected to pixels at the mesh's distance and the coarsest level
+// under the limit is drawn; a coarser level must fit well inside the
+// limit before it is switched to, so meshes near a boundary do not
+// flip between levels every frame.
+//
+// --lod FILE.obj builds the chain of an OBJ mesh into a .lod file:
+// the header below, the level table, positions, then indices, all
+// in native byte order.
+//--------------------------------------------------------------
+
+const int MaxLodLevels = 8;
+
+struct LodLevel
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;            // Object units; 0 for the full mesh
+};
+
+struct LodTable
+{
+    LodLevel levels[MaxLodLevels];  // Finest first, errors increasing
+    uint32_t levelCount;
+    float radius;                   // Bounding sphere around the box center
+};
+
+struct LodMesh
+{
+    std::vector<Vec3> positions;
+    std::vector<uint32_t> indices;  // Every level, finest first
+    LodTable table;
+};
+
+// Builds levels down to about minTriangles, halving the count each
+// time; stops early when collapses would move the surface by more
+// than maxError times the radius or none are left
+bool build_lod_chain(const std::vector<Vec3> &positions, const std::vector<uint32_t> &indices, LodMesh &out,
+                     size_t minTriangles = 64, float maxError = 0.25f);
+
+// Collapses edges until at most targetIndexCount indices are left or
+// the next collapse would cost more than maxError (object units).
+// Returns the error reached.
+float simplify_mesh(const std::vector<Vec3> &positions, const std::vector<uint32_t> &indices,
+                    size_t targetIndexCount, float maxError, std::vector<uint32_t> &out);
+
+// Pixels covered by one object unit at distance 1, for a perspective
+// projection drawn into a viewport of the given height
+float lod_pixel_scale(const Mat4 &projection, int viewportHeight);
+
+// Level to draw when the mesh is at the given distance from the eye,
+// allowing pixelError pixels of error; currentLevel is the level drawn
+// last frame, or -1 if none
+int select_lod(const LodTable &table, float pixelScale, float distance, int currentLevel, float pixelError = 1.0f);
+
+// Triangulated positions of the v and f lines in an OBJ file
+bool load_obj(const std::string &filename, std::vector<Vec3> &positions, std::vector<uint32_t> &indices);
+
+bool write_lod_mesh(const std::string &filename, const LodMesh &mesh);
+bool read_lod_mesh(const std::string &filename, LodMesh &mesh);
+
+// The --lod tool: OBJ in, .lod out, level table printed to report
+bool convert_obj_to_lod(const std::string &source, const std::string &target, std::ostream &report);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef INC_METRICS_H
+#define INC_METRICS_H
+
+#include <stdint.h>
+#include <string>
+
+//--------------------------------------------------------------
+// Live metrics export
+//
+// Every frame the main loop publishes a FrameMetrics record into
+// a POSIX shared-memory ring. The writer never blocks: each slot
+// is guarded by its own sequence counter (odd while being written)
+// so readers in other processes retry instead of locking.
+//
+// Optionally a background thread serves a Prometheus text
+// exposition of the latest frames on a Unix domain socket, e.g.
+//
+//   curl --unix-socket /tmp/glfw-spike-metrics-<pid>.sock http://x/metrics
+//
+// Shared memory layout (all little-endian, 8-byte aligned):
+//
+//   MetricsRingHeader
+//   MetricsSlot[capacity]
+//
+// A reader loads writeIndex, then for slot (writeIndex - 1) % capacity
+// reads sequence, copies data, and re-reads sequence; the copy is
+// valid if both reads match and are even.
+//--------------------------------------------------------------
+
+const uint32_t MetricsRingMagic = 0x4d545247; // "GRTM"
+const uint32_t MetricsRingVersion = 1;
+
+struct FrameMetrics
+{
+    uint64_t frameIndex;
+    double timestamp;          // glfwGetTime() at publish
+    double frameTime;          // seconds, CPU side
+    double gpuTime;            // seconds, -1 if unknown
+    uint64_t drawCalls;
+    uint64_t uploadBytes;
+    int64_t gpuMemoryFreeKb;   // -1 if the driver cannot report it
+    uint64_t uploadBytesTotal; // cumulative since startup
+};
+
+struct MetricsConfig
+{
+    std::string sharedMemoryName; // "%d" is replaced by the pid, empty disables
+    std::string socketPath;       // "%d" is replaced by the pid, empty disables
+    uint32_t capacity;            // frames kept in the ring
+};
+
+bool metrics_initialize(const MetricsConfig &config);
+void metrics_shutdown();
+
+// Wait-free; safe to call every frame from the render thread
+void metrics_publish(const FrameMetrics &metrics);
+
+// Free video memory in KB via GL_NVX_gpu_memory_info or
+// GL_ATI_meminfo, -1 if neither is available. Needs a GL context.
+int64_t metrics_query_gpu_memory_kb();
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef INC_OCCLUSION_CULL_H
+#define INC_OCCLUSION_CULL_H
+
+#include "frustum_cull.h"
+#include "vecmath.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+//--------------------------------------------------------------
+// Software occlusion culling
+//
+// A few large occluders (walls, buildings, terrain chunks) are drawn
+// into a small depth buffer on the CPU, and objects whose bounds lie
+// entirely behind that depth are dropped before any GL draw is issued.
+// Nothing is read back from the GPU, so it works on any driver.
+//
+// Occluder triangles are binned into screen tiles, and each tile is
+// rasterized as one WorkerPool task, 4 pixels at a time with SSE, so
+// tiles never share pixels. The buffer keeps the nearest depth per
+// pixel; a pyramid above it keeps the farthest of each 2x2 block. An
+// object is tested at the level where its screen rectangle covers at
+// most 2x2 texels: it is hidden when its nearest point lies behind all
+// of them.
+//
+// The test is conservative: objects crossing the near plane are always
+// visible, and so are occluder triangles crossing it skipped. Depth is
+// GL window depth (0 near, 1 far).
+//--------------------------------------------------------------
+
+struct OcclusionStats
+{
+    unsigned long frames;
+    unsigned long long triangles;       // Occluder triangles rasterized
+    unsigned long long tested;
+    unsigned long long occluded;
+    double rasterSeconds;
+    double testSeconds;
+};
+
+class OcclusionCuller
+{
+public:
+    // The size is rounded up to whole tiles; pool may be NULL to do
+    // everything on the calling thread
+    OcclusionCuller(int width = 256, int height = 128, WorkerPool *pool = NULL);
+
+    // Clears the buffer and occluders for a new view
+    void begin_frame(const Mat4 &viewProjection);
+
+    // An indexed triangle mesh, counter-clockwise front faces; back
+    // faces are skipped
+    void add_occluder(const Vec3 *vertices, const uint32_t *indices, size_t indexCount, const Mat4 &world);
+
+    // Rasterizes the occluders and builds the depth pyramid
+    void rasterize();
+
+    bool is_visible(const Vec3 &center, const Vec3 &extents) const;
+
+    // Narrows candidates (e.g. the frustum culling result) to the
+    // objects not hidden, keeping their order
+    void cull(const CullBounds &bounds, const std::vector<uint32_t> &candidates, std::vector<uint32_t> &visible);
+
+    // Plain C++ versions, for checking: every triangle over the whole
+    // buffer, and objects against every pixel they cover
+    void rasterize_reference(std::vector<float> &depth) const;
+    bool is_visible_reference(const std::vector<float> &depth, const Vec3 &center, const Vec3 &extents) const;
+
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+    const float *depth_buffer() const { return &levels[0][0]; }
+
+    const OcclusionStats &stats() const { return totals; }
+    void report(std::ostream &out) const;
+
+private:
+    // Edge functions a * x + b * y + c, positive inside, and the depth
+    // plane, in pixels; the rectangle is in pixels whose centers it
+    // may cover
+    struct ScreenTriangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, minY, maxX, maxY;
+    };
+
+    // Screen rectangle and nearest depth of a box; false when it
+    // cannot be hidden (crosses the near plane) or is off screen
+    bool project_box(const Vec3 &center, const Vec3 &extents, int rect[4], float &nearestDepth) const;
+    void rasterize_tile(int tile);
+    void build_pyramid();
+
+    int bufferWidth;
+    int bufferHeight;
+    int tilesX;
+    int tilesY;
+    WorkerPool *pool;
+    Mat4 viewProjection;
+
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<uint32_t> > tileTriangles;
+    std::vector<std::vector<float> > levels;    // Level 0 is the depth buffer
+    std::vector<int> levelWidths;
+    std::vector<int> levelHeights;
+    std::vector<std::vector<uint32_t> > chunkVisible;
+
+    OcclusionStats totals;
+
+    OcclusionCuller(const OcclusionCuller &);
+    OcclusionCuller &operator=(const OcclusionCuller &);
+};
+
+#endif
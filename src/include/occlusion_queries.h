@@ -0,0 +1,136 @@
+#ifndef INC_OCCLUSION_QUERIES_H
+#define INC_OCCLUSION_QUERIES_H
+
+#include "opengl.h"
+#include "frustum_cull.h"
+#include "vecmath.h"
+
+#include <stdint.h>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+//--------------------------------------------------------------
+// GPU occlusion queries
+//
+// Complements the CPU culling stages for objects they cannot prove
+// hidden. Each object keeps the result of its last GL_ANY_SAMPLES_PASSED
+// query, read back frames later without waiting:
+//
+//  - Visible (or new) objects are drawn, and when their query is due
+//    the draw itself is wrapped in the query.
+//  - Hidden objects whose query is due get their bounding box drawn
+//    into a query with colour and depth writes off, after all the
+//    visible objects, and are then drawn under glBeginConditionalRender
+//    with GL_QUERY_NO_WAIT: the GPU drops the draw if the box showed
+//    no samples, and draws it if that result is not in yet.
+//  - Hidden objects whose query is not due are skipped.
+//
+// Objects whose result stays the same are queried less often, hidden
+// ones less so since they can only reappear when queried. Objects
+// around the eye are always drawn.
+//
+// Queries of the same kind cannot nest, so draw() must not be called
+// inside a gpu_stats draw group (which holds GL_SAMPLES_PASSED open).
+//--------------------------------------------------------------
+
+// Unit cube (corners at -1 and 1), counter-clockwise from outside;
+// shaders/vertex/bounds.glsl scales it to a box
+const int UnitCubeVertexCount = 8;
+const int UnitCubeIndexCount = 36;
+extern const GLfloat UnitCubeVertices[UnitCubeVertexCount * 3];
+extern const GLubyte UnitCubeIndices[UnitCubeIndexCount];
+
+struct OcclusionQueryStats
+{
+    unsigned long frames;
+    unsigned long long objects;
+    unsigned long long drawn;               // Drawn without a condition
+    unsigned long long skipped;             // Hidden by an earlier result
+    unsigned long long conditional;         // Drawn under a box query
+    unsigned long long discarded;           // ...whose box turned out hidden
+    unsigned long long drawQueries;         // Queries wrapping real draws
+    unsigned long long boxQueries;          // Extra bounding box draws
+    double boxGpuSeconds;
+    unsigned long boxGpuSamples;
+};
+
+class OcclusionQueries
+{
+public:
+    OcclusionQueries();
+    ~OcclusionQueries();
+
+    // Builds the bounding box program and mesh; needs a current GL context
+    bool initialize();
+
+    // Collects finished query results without waiting
+    void begin_frame(const Mat4 &viewProjection, const Vec3 &eye, float nearDistance);
+
+    // Draws the objects (indices into bounds, e.g. a culling result)
+    // that may be visible into the bound framebuffer, which must have
+    // depth testing set up. drawObject must bind its own program and
+    // vertex array.
+    void draw(const CullBounds &bounds, const std::vector<uint32_t> &objects,
+              const std::function<void(uint32_t)> &drawObject);
+
+    const OcclusionQueryStats &stats() const { return totals; }
+    void report(std::ostream &out) const;
+
+private:
+    struct ObjectState
+    {
+        unsigned long resultFrame;      // Frame the held result was issued in
+        unsigned long nextQueryFrame;
+        bool known;
+        bool visible;
+        int stableResults;              // Equal results in a row
+    };
+
+    struct PendingQuery
+    {
+        GLuint query;
+        uint32_t object;
+        unsigned long frame;
+        bool box;
+    };
+
+    struct TimestampPair
+    {
+        GLuint queries[2];
+        bool pending;
+    };
+
+    bool acquire_query(GLuint &query);
+    void collect_results();
+    void collect_timestamps();
+    bool contains_eye(const CullBounds &bounds, uint32_t object) const;
+
+    GLuint program;
+    GLint viewProjectionLocation;
+    GLint centerLocation;
+    GLint extentsLocation;
+    GLuint vertexArray;
+    GLuint buffers[2];
+
+    Mat4 viewProjection;
+    Vec3 eye;
+    float nearDistance;
+    unsigned long frame;
+
+    std::vector<ObjectState> states;
+    std::vector<GLuint> freeQueries;
+    std::vector<PendingQuery> pending;      // In issue order
+    std::vector<uint32_t> hiddenDue;
+    std::vector<GLuint> hiddenQueries;
+
+    bool timestampsAvailable;
+    std::vector<TimestampPair> timestampRing;
+
+    OcclusionQueryStats totals;
+
+    OcclusionQueries(const OcclusionQueries &);
+    OcclusionQueries &operator=(const OcclusionQueries &);
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef INC_OPENGL_H
+#define INC_OPENGL_H
+
+// Single place that decides how OpenGL and GLFW get pulled in, so every
+// translation unit sees the same function prototypes.
+#define GLFW_INCLUDE_GL_3
+#define GL_GLEXT_PROTOTYPES 1
+#include <GLFW/glfw3.h>
+
+// Debug builds count and time the GL calls made by the renderer
+#include "gl_trace.h"
+
+#endif
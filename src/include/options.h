@@ -0,0 +1,69 @@
+#ifndef INC_OPTIONS_H
+#define INC_OPTIONS_H
+
+#include <string>
+
+//--------------------------------------------------------------
+// Command line options
+//
+// With no arguments the program opens its interactive window.
+// The options below select the offline modes instead.
+//--------------------------------------------------------------
+
+struct ProgramOptions
+{
+    int width;                  // Window / output size, 0 for the default
+    int height;
+
+    // --continuous: redraw every frame instead of only on damage
+    bool continuous;
+
+    // --background-fps N: frame cap while the window is unfocused, 0 for none
+    double backgroundFrameRate;
+
+    // --fps N, --swap MODE: frame pacing target (0 for none) and
+    // swap interval (default, off, vsync or adaptive)
+    double targetFrameRate;
+    std::string swapMode;
+
+    // --dynamic-resolution MS: GPU frame time to hold by rendering
+    // below the window resolution, 0 to always render at full size
+    double dynamicResolutionTarget;
+
+    // --post LIST: comma-separated post-processing passes for the window
+    std::string postPasses;
+
+    // --export N: render N frames offscreen and stream them out
+    int exportFrames;
+    std::string exportFormat;   // png, ppm or raw
+    std::string exportPath;     // printf pattern taking the frame number, "-" for stdout
+    int exportThreads;          // 0 picks the number of cores
+    int pngCompression;         // zlib level 0-9
+
+    // --tiled WxH: render one image of this size tile by tile to --output
+    int tiledWidth;
+    int tiledHeight;
+    int tileSize;               // 0 picks the largest the GPU allows
+
+    // --golden-check/--golden-update DIR: render the canonical scenes
+    // and compare them with (or store them as) the images in DIR
+    std::string goldenDirectory;
+    bool goldenUpdate;
+    int goldenTolerance;        // Per-channel difference still accepted
+
+    // --occlusion-queries N: draw N frames of a city block grid
+    // offscreen with and without GPU occlusion queries and compare
+    int occlusionFrames;
+
+    // --bench LIST: run the named CPU kernel benchmarks and exit
+    std::string benchmarks;
+
+    // --lod FILE: build the level-of-detail chain of an OBJ mesh into
+    // --output (default FILE with a .lod extension) and exit
+    std::string lodSource;
+};
+
+// Returns false (after printing usage) on unknown or malformed options
+bool parse_options(int argc, char **argv, ProgramOptions &options);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef INC_OVERDRAW_H
+#define INC_OVERDRAW_H
+
+#include "opengl.h"
+#include "render_target.h"
+
+#include <string>
+
+//--------------------------------------------------------------
+// Overdraw and shader cost visualization
+//
+// While a debug mode is active the scene is drawn into an
+// offscreen float target with additive blending, using a
+// counting shader in place of each registered program, and the
+// result is tone-mapped to a heatmap on the window.
+//
+//  - OverdrawCount: every shaded fragment adds 1
+//  - OverdrawCost:  every fragment adds the estimated instruction
+//                   cost of the program it replaced
+//--------------------------------------------------------------
+
+enum OverdrawMode
+{
+    OverdrawOff,
+    OverdrawCount,
+    OverdrawCost,
+    OverdrawModeCount
+};
+
+// The count target follows the window size (see ResizableTarget).
+// Returns false if the heatmap program does not build; the mode then
+// stays off and the other calls do nothing.
+bool overdraw_initialize();
+void overdraw_shutdown();
+
+// Builds the counting replacement for program from its vertex shader
+// and estimates the cost of its fragment shader
+void overdraw_register_program(GLuint program, const std::string &vertexFilename, const std::string &fragmentFilename);
+
+void overdraw_cycle_mode();
+OverdrawMode overdraw_mode();
+
+// The counting replacement while a mode is active, otherwise program
+GLuint overdraw_substitute(GLuint program);
+
+// Redirect rendering into the overdraw target / resolve it to the window
+void overdraw_begin_frame(int width, int height);
+void overdraw_end_frame();
+
+// Rough per-fragment ALU estimate from GLSL source (1 = passthrough)
+float estimate_shader_cost(const std::string &source);
+
+#endif
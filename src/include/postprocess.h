@@ -0,0 +1,73 @@
+#ifndef INC_POSTPROCESS_H
+#define INC_POSTPROCESS_H
+
+#include "opengl.h"
+#include "frame_graph.h"
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// Post-processing chain
+//
+// An ordered list of fullscreen passes run over the rendered scene.
+// Each pass is a GLSL snippet in shaders/post/ defining a function
+// named PASS, either
+//
+//   vec4 PASS(vec2 uv)              samples its input via fetch()
+//   vec4 PASS(vec4 color, vec2 uv)  pointwise, sees only its pixel
+//
+// A pointwise pass needs nothing but the previous pass's result for
+// the same pixel, so it is merged into the previous pass's shader
+// instead of getting a target and a draw of its own. Each merged
+// stage therefore starts with at most one sampling pass.
+//
+// Each stage is a frame graph pass and intermediate results are
+// transient textures, so the graph's aliasing reuses a target as soon
+// as the stage reading it has run: a chain needs at most two
+// (ping-pong) whatever its length.
+//--------------------------------------------------------------
+
+class PostChain
+{
+public:
+    PostChain();
+    ~PostChain();
+
+    // Builds the stages for the named passes (tonemap, vignette, fxaa,
+    // blur). Returns false on an unknown name or a shader error.
+    bool build(const std::vector<std::string> &passNames);
+
+    bool empty() const { return stages.empty(); }
+
+    // Declares the stages from input to output, both width x height
+    void add_passes(FrameGraph &graph, FrameResource input, FrameResource output);
+
+    size_t pass_count() const { return passCount; }
+    size_t stage_count() const { return stages.size(); }
+
+private:
+    struct Stage
+    {
+        std::string name;       // Merged pass names, e.g. "fxaa+tonemap"
+        GLuint program;
+        GLint sourceLocation;
+        GLint scaleLocation;
+        GLint texelSizeLocation;
+    };
+
+    void clear();
+    void draw_stage(const Stage &stage, FrameGraph &graph, FrameResource input, FrameResource output);
+
+    std::vector<Stage> stages;
+    size_t passCount;
+    GLuint vertexArray;
+
+    PostChain(const PostChain &);
+    PostChain &operator=(const PostChain &);
+};
+
+// Splits "a,b,c" into names
+std::vector<std::string> split_pass_list(const std::string &list);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef INC_PROFILER_H
+#define INC_PROFILER_H
+
+#include <string>
+
+//--------------------------------------------------------------
+// Frame profiler and hitch detector
+//
+// Keeps a rolling window of per-frame CPU/GPU timings, named
+// CPU zones and resource counters in memory. When a frame takes
+// longer than HitchFactor times the window median, the frame and
+// its neighbours are written to a text file so the outlier can
+// be diagnosed after the fact without always-on tracing.
+//--------------------------------------------------------------
+
+enum ProfileCounter
+{
+    CounterShaderCompiles,
+    CounterBufferAllocations,
+    CounterUploads,
+    CounterUploadBytes,
+    CounterDrawCalls,
+    CounterCount
+};
+
+struct ProfilerConfig
+{
+    int windowFrames;         // Frames kept in the rolling window
+    double hitchFactor;       // Hitch when frame time > factor * median
+    double hitchMinimumTime;  // Ignore hitches shorter than this (seconds)
+    int neighborFrames;       // Frames dumped on each side of a hitch
+    std::string dumpPrefix;   // Trace files are named <prefix><frame>.txt
+};
+
+// Must be called with a current GL context (GPU timers are created here)
+void profiler_initialize(const ProfilerConfig &config);
+void profiler_shutdown();
+
+void profiler_begin_frame();
+void profiler_end_frame();
+
+// Named CPU zones, may be nested. Names must outlive the frame.
+void profiler_begin_zone(const char *name);
+void profiler_end_zone();
+
+void profiler_count(ProfileCounter counter, unsigned long amount = 1);
+
+// Timing of the most recently completed frames (seconds, -1 if unknown)
+double profiler_last_cpu_time();
+double profiler_last_gpu_time();
+unsigned long profiler_last_counter(ProfileCounter counter);
+
+// RAII helper for profiler_begin_zone/profiler_end_zone
+struct ProfileScope
+{
+    ProfileScope(const char *name) { profiler_begin_zone(name); }
+    ~ProfileScope() { profiler_end_zone(); }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef INC_RENDER_SCALE_H
+#define INC_RENDER_SCALE_H
+
+#include "opengl.h"
+
+#include <ostream>
+
+//--------------------------------------------------------------
+// Dynamic resolution
+//
+// The scene is rendered at a fraction of the framebuffer size and
+// upscaled to the window. RenderScaleController picks the fraction
+// from the measured GPU frame time: fragment cost goes with the
+// pixel count, i.e. the square of the scale, so an over-budget frame
+// shrinks the scale by sqrt(target / measured) at once, while spare
+// time grows it back in small steps. GPU timings arrive a few frames
+// late, so after every change the controller waits for measurements
+// taken at the new scale before deciding again.
+//--------------------------------------------------------------
+
+struct RenderScaleConfig
+{
+    double targetGpuTime;       // Seconds per frame to hold
+    float minScale;
+    float maxScale;
+    int settleFrames;           // Frames to wait after a change
+};
+
+class RenderScaleController
+{
+public:
+    RenderScaleController(const RenderScaleConfig &config);
+
+    // Feeds the latest GPU frame time (negative when none is known)
+    // and returns the scale for the next frame
+    float update(double gpuTime);
+
+    float scale() const { return currentScale; }
+
+    // Framebuffer size times the scale, at least one pixel
+    void scaled_size(int width, int height, int &scaledWidth, int &scaledHeight) const;
+
+    void report(std::ostream &out) const;
+
+private:
+    RenderScaleConfig config;
+    float currentScale;
+    double smoothedGpuTime;
+    int framesSinceChange;
+
+    unsigned long frames;
+    unsigned long changes;
+    double scaleSum;
+    float lowestScale;
+};
+
+// Catmull-Rom upscale of the used part (scaleX/Y) of a texture to the
+// bound framebuffer
+class Upscaler
+{
+public:
+    Upscaler();
+    ~Upscaler();
+
+    bool initialize();
+    void draw(GLuint texture, float scaleX, float scaleY);
+
+private:
+    GLuint program;
+    GLint sourceLocation;
+    GLint scaleLocation;
+    GLuint vertexArray;
+
+    Upscaler(const Upscaler &);
+    Upscaler &operator=(const Upscaler &);
+};
+
+#endif
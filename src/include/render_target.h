@@ -0,0 +1,186 @@
+#ifndef INC_RENDER_TARGET_H
+#define INC_RENDER_TARGET_H
+
+#include "opengl.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+//--------------------------------------------------------------
+// Offscreen render targets
+//
+// A RenderTarget is a framebuffer object with one color texture
+// and an optional depth renderbuffer. Targets are handed out by a
+// RenderTargetPool keyed on size and format: releasing a target
+// makes it available to the next acquire with the same description,
+// and targets left unused for a while (e.g. the old size after a
+// window resize) are destroyed by end_frame().
+//--------------------------------------------------------------
+
+struct RenderTargetDesc
+{
+    int width;
+    int height;
+    GLenum colorFormat;    // Internal format, e.g. GL_RGBA8, GL_R16F
+    bool depth;            // Attach a 24-bit depth renderbuffer
+    GLenum filter;         // GL_NEAREST or GL_LINEAR for sampling
+
+    RenderTargetDesc(int w = 0, int h = 0, GLenum format = GL_RGBA8, bool withDepth = false, GLenum textureFilter = GL_LINEAR)
+        : width(w), height(h), colorFormat(format), depth(withDepth), filter(textureFilter) {}
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return width == other.width && height == other.height && colorFormat == other.colorFormat
+            && depth == other.depth && filter == other.filter;
+    }
+};
+
+struct RenderTarget
+{
+    GLuint framebuffer;
+    GLuint colorTexture;
+    GLuint depthRenderbuffer;
+    RenderTargetDesc desc;
+};
+
+bool render_target_create(RenderTarget &target, const RenderTargetDesc &desc);
+void render_target_destroy(RenderTarget &target);
+
+// Binds target (NULL for the window) and sets a matching viewport
+void render_target_bind(const RenderTarget *target, int windowWidth = 0, int windowHeight = 0);
+
+class RenderTargetPool
+{
+public:
+    RenderTargetPool(int evictAfterFrames = 60);
+    ~RenderTargetPool();
+
+    RenderTarget *acquire(const RenderTargetDesc &desc);
+    void release(RenderTarget *target);
+
+    // Ages free targets and destroys the ones idle for too long
+    void end_frame();
+    void clear();
+
+    size_t allocated_count() const { return entries.size(); }
+    size_t allocated_bytes() const;
+
+private:
+    struct Entry
+    {
+        RenderTarget *target;
+        bool inUse;
+        int idleFrames;
+    };
+
+    std::vector<Entry> entries;
+    int evictAfterFrames;
+
+    RenderTargetPool(const RenderTargetPool &);
+    RenderTargetPool &operator=(const RenderTargetPool &);
+};
+
+//--------------------------------------------------------------
+// Window-sized targets
+//
+// A target that follows the window is only used up to the current
+// size. Its storage grows in steps with some headroom and shrinks
+// only after the used area has stayed under half of it for a while,
+// so a drag-resize does not reallocate every frame. Viewports, blits
+// and texture coordinates have to use the used size (see scale_x/y).
+//--------------------------------------------------------------
+
+class ResizableTarget
+{
+public:
+    ResizableTarget(const RenderTargetDesc &desc = RenderTargetDesc(), int shrinkAfterFrames = 60);
+    ~ResizableTarget();
+
+    // Makes room for width x height, called once per frame. Returns
+    // true when the storage was reallocated and its contents are lost.
+    bool resize(int width, int height);
+    void destroy();
+
+    // Binds the target with a viewport covering the used size
+    void bind() const;
+
+    RenderTarget *target() const { return storage; }
+    int width() const { return usedWidth; }
+    int height() const { return usedHeight; }
+
+    // Used size over storage size, for 0..1 texture coordinates
+    float scale_x() const { return storage ? (float) usedWidth / storage->desc.width : 1.0f; }
+    float scale_y() const { return storage ? (float) usedHeight / storage->desc.height : 1.0f; }
+
+    unsigned long reallocations() const { return reallocationCount; }
+
+private:
+    RenderTargetDesc desc;
+    RenderTarget *storage;
+    int usedWidth;
+    int usedHeight;
+    int shrinkAfterFrames;
+    int undersizedFrames;
+    unsigned long reallocationCount;
+
+    ResizableTarget(const ResizableTarget &);
+    ResizableTarget &operator=(const ResizableTarget &);
+};
+
+//--------------------------------------------------------------
+// Asynchronous readback
+//
+// glReadPixels into a pixel buffer object returns immediately; a
+// fence placed after it tells us when the copy has finished, at
+// which point mapping the buffer no longer stalls. A ring of PBOs
+// keeps several readbacks in flight.
+//--------------------------------------------------------------
+
+struct ReadbackImage
+{
+    const unsigned char *pixels;   // RGBA8, bottom row first
+    int width;
+    int height;
+    uint64_t tag;
+};
+
+class ReadbackRing
+{
+public:
+    ReadbackRing(int depth = 3);
+    ~ReadbackRing();
+
+    // Starts copying a region of framebuffer (0 = window back buffer).
+    // Returns false when every PBO is still in flight.
+    bool request(GLuint framebuffer, int x, int y, int width, int height, uint64_t tag);
+
+    // Hands every finished readback to callback in request order and
+    // recycles its PBO. With wait set, first blocks until the oldest
+    // readback in flight is done.
+    void poll(const std::function<void(const ReadbackImage &)> &callback, bool wait = false);
+
+    int in_flight() const { return inFlight; }
+    int depth() const { return (int) slots.size(); }
+
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        GLsync fence;
+        size_t capacity;
+        int width;
+        int height;
+        uint64_t tag;
+    };
+
+    std::vector<Slot> slots;
+    int head;       // Oldest readback in flight
+    int inFlight;
+
+    ReadbackRing(const ReadbackRing &);
+    ReadbackRing &operator=(const ReadbackRing &);
+};
+
+#endif
@@ -1,8 +1,15 @@
 #ifndef INC_SHADER_UTILS_H
 #define INC_SHADER_UTILS_H
 
+#include "opengl.h"
+
 #include <string>
+#include <vector>
 
 std::string load_shader_from_file(std::string filename);
 
+GLuint create_shader(GLenum eShaderType, const std::string &strShaderFile);
+GLuint create_shader_program(const std::vector<GLuint> &shaderList);
+GLuint create_program_from_files(const std::string &vertexFilename, const std::string &fragmentFilename);
+
 #endif
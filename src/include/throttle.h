@@ -0,0 +1,54 @@
+#ifndef INC_THROTTLE_H
+#define INC_THROTTLE_H
+
+#include <ostream>
+
+//--------------------------------------------------------------
+// Background throttling
+//
+// The window loop asks how long to hold off before the next frame
+// based on what the user can see of the window:
+//
+//  - focused:    no limit
+//  - unfocused:  frames capped at unfocusedFrameRate
+//  - iconified or hidden: nothing is drawn until the window is
+//                restored, which is reported as an event and so
+//                wakes the loop immediately
+//
+// Time spent and frames drawn in each state are kept for a report.
+//--------------------------------------------------------------
+
+enum WindowActivity
+{
+    ActivityFocused,
+    ActivityUnfocused,
+    ActivityIconified,
+    ActivityHidden,
+    ActivityCount
+};
+
+struct ThrottleConfig
+{
+    double unfocusedFrameRate;      // 0 for no cap
+    bool suspendWhenIconified;
+};
+
+void throttle_initialize(const ThrottleConfig &config, double now);
+
+// Fed from the GLFW focus and iconify callbacks and the window's
+// GLFW_VISIBLE attribute
+void throttle_set_focused(bool focused, double now);
+void throttle_set_iconified(bool iconified, double now);
+void throttle_set_visible(bool visible, double now);
+
+WindowActivity throttle_activity();
+
+// Seconds to wait before drawing the next frame: 0 to draw now,
+// negative while suspended (wait for events only)
+double throttle_wait_time(double now);
+
+void throttle_frame_rendered(double now);
+
+void throttle_report(std::ostream &out, double now);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef INC_TILED_RENDER_H
+#define INC_TILED_RENDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------
+// Tiled rendering of images larger than any framebuffer
+//
+// The output is split into tiles no larger than the GPU allows.
+// Each tile renders the normal scene with a view transform that
+// maps its part of the image onto the whole viewport, and is then
+// written straight into its place in the output file. Peak memory
+// is a handful of tiles no matter how large the image gets.
+//--------------------------------------------------------------
+
+struct Tile
+{
+    int x;
+    int y;          // Bottom-left origin, like GL
+    int width;
+    int height;
+};
+
+// Splits width x height into tiles of at most tileSize, row by row
+std::vector<Tile> make_tiles(int width, int height, int tileSize);
+
+// Binary PPM written tile by tile at random offsets (pwrite), so
+// tiles can arrive in any order and never need to be assembled in
+// memory. The file is sized up front; its header is written first.
+class TiledImageWriter
+{
+public:
+    TiledImageWriter();
+    ~TiledImageWriter();
+
+    bool open(const std::string &filename, int width, int height);
+
+    // RGBA8 pixels of one tile, bottom row first as read back from GL
+    bool write_tile(const Tile &tile, const unsigned char *pixels);
+
+    bool close();
+
+    uint64_t bytes_written() const { return bytesWritten; }
+
+private:
+    int fd;
+    int width;
+    int height;
+    uint64_t headerSize;
+    uint64_t bytesWritten;
+    std::vector<unsigned char> rowBuffer;
+
+    TiledImageWriter(const TiledImageWriter &);
+    TiledImageWriter &operator=(const TiledImageWriter &);
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef INC_VECMATH_H
+#define INC_VECMATH_H
+
+#include <stddef.h>
+#include <cmath>
+
+//--------------------------------------------------------------
+// Vector math
+//
+// Vec3, Vec4, Quat and a column-major Mat4 (m[column * 4 + row], the
+// layout glUniformMatrix4fv takes without transposing). Matrices
+// transform column vectors: (a * b) * v applies b first.
+//
+// The per-value operations are inline; the batch kernels below are
+// what bulk CPU work (transforms, culling, animation) should call.
+// They use SSE on x86-64, AVX where the compiler targets it
+// ('scons simd=avx'), and plain C++ with VECMATH_SCALAR ('simd=none').
+// Every SIMD path has a *_reference counterpart in plain C++ that
+// 'glfw-spike --bench math' checks it against.
+//--------------------------------------------------------------
+
+#if !defined(VECMATH_SCALAR) && defined(__SSE2__)
+#define VECMATH_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(VECMATH_SSE) && defined(__AVX__)
+#define VECMATH_AVX 1
+#include <immintrin.h>
+#endif
+
+//--------------------------------------------------------------
+// Vectors
+//--------------------------------------------------------------
+
+struct Vec3
+{
+    float x;
+    float y;
+    float z;
+
+    Vec3(float x = 0.0f, float y = 0.0f, float z = 0.0f) : x(x), y(y), z(z) {}
+};
+
+inline Vec3 operator+(const Vec3 &a, const Vec3 &b) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator-(const Vec3 &a, const Vec3 &b) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator-(const Vec3 &a) { return Vec3(-a.x, -a.y, -a.z); }
+inline Vec3 operator*(const Vec3 &a, float s) { return Vec3(a.x * s, a.y * s, a.z * s); }
+inline Vec3 operator*(const Vec3 &a, const Vec3 &b) { return Vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+
+inline float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const Vec3 &a) { return std::sqrt(dot(a, a)); }
+
+inline Vec3 cross(const Vec3 &a, const Vec3 &b)
+{
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline Vec3 normalize(const Vec3 &a)
+{
+    float len = length(a);
+    return len > 0.0f ? a * (1.0f / len) : a;
+}
+
+struct Vec4
+{
+    float x;
+    float y;
+    float z;
+    float w;
+
+    Vec4(float x = 0.0f, float y = 0.0f, float z = 0.0f, float w = 0.0f) : x(x), y(y), z(z), w(w) {}
+    Vec4(const Vec3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+};
+
+inline Vec4 operator+(const Vec4 &a, const Vec4 &b) { return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+inline Vec4 operator-(const Vec4 &a, const Vec4 &b) { return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+inline Vec4 operator*(const Vec4 &a, float s) { return Vec4(a.x * s, a.y * s, a.z * s, a.w * s); }
+
+inline float dot(const Vec4 &a, const Vec4 &b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+//--------------------------------------------------------------
+// Quaternions (unit quaternions as rotations)
+//--------------------------------------------------------------
+
+struct Quat
+{
+    float x;
+    float y;
+    float z;
+    float w;
+
+    Quat(float x = 0.0f, float y = 0.0f, float z = 0.0f, float w = 1.0f) : x(x), y(y), z(z), w(w) {}
+};
+
+inline Quat quat_from_axis_angle(const Vec3 &axis, float radians)
+{
+    Vec3 a = normalize(axis) * std::sin(radians * 0.5f);
+    return Quat(a.x, a.y, a.z, std::cos(radians * 0.5f));
+}
+
+// Rotation b followed by rotation a
+inline Quat operator*(const Quat &a, const Quat &b)
+{
+    return Quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+inline Quat conjugate(const Quat &q) { return Quat(-q.x, -q.y, -q.z, q.w); }
+
+inline Quat normalize(const Quat &q)
+{
+    float len = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    return len > 0.0f ? Quat(q.x / len, q.y / len, q.z / len, q.w / len) : Quat();
+}
+
+inline Vec3 rotate(const Quat &q, const Vec3 &v)
+{
+    // v + 2w(u x v) + 2u x (u x v), u the vector part
+    Vec3 u(q.x, q.y, q.z);
+    Vec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+// Normalized lerp along the shorter arc; close to slerp for the small
+// steps between animation keys and much cheaper
+inline Quat nlerp(const Quat &a, const Quat &b, float t)
+{
+    float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0f : 1.0f;
+    float u = 1.0f - t;
+    float v = t * sign;
+
+    return normalize(Quat(a.x * u + b.x * v, a.y * u + b.y * v, a.z * u + b.z * v, a.w * u + b.w * v));
+}
+
+//--------------------------------------------------------------
+// Matrices
+//--------------------------------------------------------------
+
+struct alignas(16) Mat4
+{
+    float m[16];
+
+    // Identity
+    Mat4()
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+        }
+    }
+
+    float &at(int row, int column) { return m[column * 4 + row]; }
+    float at(int row, int column) const { return m[column * 4 + row]; }
+};
+
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b)
+{
+    Mat4 result;
+
+#ifdef VECMATH_SSE
+    // Each result column is a's columns weighted by b's column
+    __m128 a0 = _mm_load_ps(a.m);
+    __m128 a1 = _mm_load_ps(a.m + 4);
+    __m128 a2 = _mm_load_ps(a.m + 8);
+    __m128 a3 = _mm_load_ps(a.m + 12);
+
+    for (int c = 0; c < 4; c++)
+    {
+        const float *column = b.m + c * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+        _mm_store_ps(result.m + c * 4, r);
+    }
+#else
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            result.m[c * 4 + r] = a.m[r] * b.m[c * 4] + a.m[4 + r] * b.m[c * 4 + 1]
+                                + a.m[8 + r] * b.m[c * 4 + 2] + a.m[12 + r] * b.m[c * 4 + 3];
+        }
+    }
+#endif
+
+    return result;
+}
+
+inline Vec4 operator*(const Mat4 &a, const Vec4 &v)
+{
+    return Vec4(a.m[0] * v.x + a.m[4] * v.y + a.m[8] * v.z + a.m[12] * v.w,
+                a.m[1] * v.x + a.m[5] * v.y + a.m[9] * v.z + a.m[13] * v.w,
+                a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14] * v.w,
+                a.m[3] * v.x + a.m[7] * v.y + a.m[11] * v.z + a.m[15] * v.w);
+}
+
+// Affine transform of a point (w = 1, no divide)
+inline Vec3 transform_point(const Mat4 &a, const Vec3 &p)
+{
+    return Vec3(a.m[0] * p.x + a.m[4] * p.y + a.m[8] * p.z + a.m[12],
+                a.m[1] * p.x + a.m[5] * p.y + a.m[9] * p.z + a.m[13],
+                a.m[2] * p.x + a.m[6] * p.y + a.m[10] * p.z + a.m[14]);
+}
+
+inline Vec3 transform_vector(const Mat4 &a, const Vec3 &v)
+{
+    return Vec3(a.m[0] * v.x + a.m[4] * v.y + a.m[8] * v.z,
+                a.m[1] * v.x + a.m[5] * v.y + a.m[9] * v.z,
+                a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z);
+}
+
+Mat4 transpose(const Mat4 &a);
+
+// General inverse; a singular matrix gives non-finite values
+Mat4 inverse(const Mat4 &a);
+
+Mat4 mat4_translation(const Vec3 &t);
+Mat4 mat4_scale(const Vec3 &s);
+Mat4 mat4_rotation(const Quat &q);
+
+// translation * rotation * scale in one go
+Mat4 mat4_trs(const Vec3 &t, const Quat &r, const Vec3 &s);
+
+// OpenGL clip space (z in -w..w), right-handed view looking down -z
+Mat4 mat4_perspective(float fovY, float aspect, float nearZ, float farZ);
+Mat4 mat4_look_at(const Vec3 &eye, const Vec3 &target, const Vec3 &up);
+
+//--------------------------------------------------------------
+// Batch kernels
+//
+// AoSoA blocks keep Vec3BlockWidth values of each component together,
+// one AVX register (two SSE registers) per component, while blocks
+// of a stream stay contiguous like an array of structures.
+//--------------------------------------------------------------
+
+const int Vec3BlockWidth = 8;
+
+struct Vec3Block
+{
+    float x[Vec3BlockWidth];
+    float y[Vec3BlockWidth];
+    float z[Vec3BlockWidth];
+};
+
+// out[i] = a[i] * b[i]
+void multiply_matrices(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count);
+
+// Affine point transforms; out may alias the input
+void transform_points(const Mat4 &matrix, const Vec3 *points, Vec3 *out, size_t count);
+void transform_points_soa(const Mat4 &matrix, const float *x, const float *y, const float *z,
+                          float *outX, float *outY, float *outZ, size_t count);
+void transform_blocks(const Mat4 &matrix, const Vec3Block *blocks, Vec3Block *out, size_t count);
+
+// Plain C++ versions, for checking and comparing the kernels above
+Mat4 multiply_reference(const Mat4 &a, const Mat4 &b);
+Mat4 inverse_reference(const Mat4 &a);
+void transform_points_reference(const Mat4 &matrix, const Vec3 *points, Vec3 *out, size_t count);
+
+// Which kernels this build uses: "avx", "sse" or "scalar"
+const char *vecmath_instruction_set();
+
+#endif
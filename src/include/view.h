@@ -0,0 +1,30 @@
+#ifndef INC_VIEW_H
+#define INC_VIEW_H
+
+// 2D clip-space transform applied by the scene vertex shaders
+// (uniform vec4 viewTransform): clip.xy = position.xy * scale + offset * position.w.
+// Lets one render cover a sub-rectangle of the full view, e.g. a tile.
+struct ViewTransform
+{
+    float scaleX;
+    float scaleY;
+    float offsetX;
+    float offsetY;
+
+    ViewTransform(float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f)
+        : scaleX(sx), scaleY(sy), offsetX(ox), offsetY(oy) {}
+};
+
+// Transform that makes the pixel rectangle (x, y, width, height) of
+// a fullWidth x fullHeight image fill the viewport
+inline ViewTransform view_for_region(int x, int y, int width, int height, int fullWidth, int fullHeight)
+{
+    float left = -1.0f + 2.0f * x / fullWidth;
+    float bottom = -1.0f + 2.0f * y / fullHeight;
+    float scaleX = (float) fullWidth / width;
+    float scaleY = (float) fullHeight / height;
+
+    return ViewTransform(scaleX, scaleY, -1.0f - left * scaleX, -1.0f - bottom * scaleY);
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef INC_WORKER_POOL_H
+#define INC_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------
+// Worker pool for data-parallel frame work
+//
+// run() hands task indices 0..count-1 to the workers and the calling
+// thread, which take the next index from a shared counter until none
+// are left, and returns once every task has finished. The threads
+// are created once and sleep between runs, so a run costs a wakeup
+// rather than thread creation. Tasks should be coarse (a subtree, a
+// few thousand objects): each index is one atomic increment.
+//--------------------------------------------------------------
+
+class WorkerPool
+{
+public:
+    typedef std::function<void(size_t)> Task;
+
+    // threads <= 0 uses one per core; the calling thread counts as one
+    WorkerPool(int threads = 0);
+    ~WorkerPool();
+
+    void run(size_t count, const Task &task);
+
+    int thread_count() const { return (int) workers.size() + 1; }
+
+private:
+    void worker_loop();
+    void work();
+
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const Task *task;
+    size_t taskCount;
+    std::atomic<size_t> nextTask;
+    int activeWorkers;
+    unsigned long generation;
+    bool closing;
+
+    WorkerPool(const WorkerPool &);
+    WorkerPool &operator=(const WorkerPool &);
+};
+
+#endif
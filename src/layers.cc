@@ -0,0 +1,222 @@
+#include "layers.h"
+#include "shader_utils.h"
+#include "profiler.h"
+
+#include <iostream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+const char* CompositeVertexShaderFilename = "shaders/vertex/fullscreen.glsl";
+const char* CompositeFragmentShaderFilename = "shaders/fragment/composite.glsl";
+
+//--------------------------------------------------------------
+// Layer stack
+//--------------------------------------------------------------
+
+LayerStack::LayerStack()
+    : compositeProgram(0), layerTextureLocation(-1), scaleLocation(-1), fullscreenVertexArray(0)
+{
+}
+
+LayerStack::~LayerStack()
+{
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        delete layers[i].cache;
+    }
+
+    if (compositeProgram)
+    {
+        glDeleteProgram(compositeProgram);
+        glDeleteVertexArrays(1, &fullscreenVertexArray);
+    }
+}
+
+bool LayerStack::initialize()
+{
+    compositeProgram = create_program_from_files(CompositeVertexShaderFilename, CompositeFragmentShaderFilename);
+
+    if (!compositeProgram)
+    {
+        cerr << "Could not build the layer composite program" << endl;
+        return false;
+    }
+
+    layerTextureLocation = glGetUniformLocation(compositeProgram, "layer");
+    scaleLocation = glGetUniformLocation(compositeProgram, "scale");
+    glGenVertexArrays(1, &fullscreenVertexArray);
+
+    return true;
+}
+
+int LayerStack::add_layer(const string &name, LayerKind kind, bool opaque, const LayerRenderFunction &render)
+{
+    Layer layer;
+    layer.name = name;
+    layer.kind = kind;
+    layer.opaque = opaque;
+    layer.render = render;
+    layer.cache = kind == LayerCached ? new ResizableTarget(RenderTargetDesc(0, 0, GL_RGBA8, false, GL_NEAREST)) : NULL;
+    layer.dirty = true;
+    layer.renders = 0;
+    layer.composites = 0;
+
+    layers.push_back(layer);
+
+    return (int) layers.size() - 1;
+}
+
+void LayerStack::invalidate(int layer)
+{
+    if (layer >= 0 && layer < (int) layers.size())
+    {
+        layers[layer].dirty = true;
+    }
+}
+
+void LayerStack::invalidate_all()
+{
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        layers[i].dirty = true;
+    }
+}
+
+// Re-renders a cached layer into its texture if it is stale. The
+// texture always holds the whole layer, so any scissor set up for
+// the output is suspended meanwhile.
+bool LayerStack::refresh_cache(Layer &layer, int width, int height)
+{
+    bool resized = layer.cache->width() != width || layer.cache->height() != height;
+
+    if (layer.cache->resize(width, height) || resized)
+    {
+        layer.dirty = true;
+    }
+
+    if (!layer.cache->target())
+    {
+        return false;
+    }
+
+    if (!layer.dirty)
+    {
+        layer.composites++;
+        return true;
+    }
+
+    ProfileScope zone("layer_refresh");
+
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+
+    layer.cache->bind();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    layer.render();
+
+    if (scissor)
+    {
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    layer.dirty = false;
+    layer.renders++;
+
+    return true;
+}
+
+void LayerStack::composite(int width, int height, bool bypassCache)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    GLint output = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output);
+
+    // Respects the scissor, so partial redraws clear only their region
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        Layer &layer = layers[i];
+
+        if (bypassCache || layer.kind == LayerDirect || !compositeProgram)
+        {
+            layer.render();
+            layer.renders++;
+            continue;
+        }
+
+        if (!refresh_cache(layer, width, height))
+        {
+            continue;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glViewport(0, 0, width, height);
+
+        // An opaque bottom layer replaces everything below it, which a
+        // blit does without running a shader
+        if (i == 0 && layer.opaque)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, layer.cache->target()->framebuffer);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, output);
+            continue;
+        }
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        glUseProgram(compositeProgram);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, layer.cache->target()->colorTexture);
+        glUniform1i(layerTextureLocation, 0);
+        glUniform2f(scaleLocation, layer.cache->scale_x(), layer.cache->scale_y());
+
+        glBindVertexArray(fullscreenVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        profiler_count(CounterDrawCalls);
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+    }
+}
+
+vector<LayerStats> LayerStack::stats() const
+{
+    vector<LayerStats> result;
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        LayerStats stats;
+        stats.name = layers[i].name;
+        stats.renders = layers[i].renders;
+        stats.composites = layers[i].composites;
+        result.push_back(stats);
+    }
+
+    return result;
+}
+
+unsigned long LayerStack::reallocations() const
+{
+    unsigned long total = 0;
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        total += layers[i].cache ? layers[i].cache->reallocations() : 0;
+    }
+
+    return total;
+}
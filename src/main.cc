@@ -12,16 +12,38 @@
 //
 ////////////////////////////////////////////////////////////////
 
-#define GLFW_INCLUDE_GL_3
-#define GL_GLEXT_PROTOTYPES 1
-#include <GLFW/glfw3.h>
+#include "opengl.h"
 
 #include <cstdlib>
+#include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <functional>
 
 #include "shader_utils.h"
+#include "profiler.h"
+#include "gpu_stats.h"
+#include "overdraw.h"
+#include "metrics.h"
+#include "render_target.h"
+#include "image_io.h"
+#include "options.h"
+#include "frame_export.h"
+#include "tiled_render.h"
+#include "view.h"
+#include "image_diff.h"
+#include "damage.h"
+#include "layers.h"
+#include "throttle.h"
+#include "frame_pacer.h"
+#include "render_scale.h"
+#include "postprocess.h"
+#include "frame_graph.h"
+#include "benchmark.h"
+#include "mesh_lod.h"
+#include "occlusion_queries.h"
 
 using namespace std;
 
@@ -33,84 +55,1351 @@ const char* WindowTitle = "Hello OpenGL!";
 const int WindowWidth = 640;
 const int WindowHeight = 640;
 
+// Hitch detection: frames slower than HitchFactor times the median of
+// the last HitchWindowFrames frames are dumped with their neighbours
+const int HitchWindowFrames = 240;
+const double HitchFactor = 2.0;
+const double HitchMinimumTime = 0.004;
+const int HitchNeighborFrames = 8;
+const char* HitchDumpPrefix = "hitch_frame_";
+
+// Live metrics: shared-memory ring and Prometheus text on a Unix
+// socket, "%d" becomes the process id (empty strings disable)
+const char* MetricsSharedMemoryName = "/glfw-spike-metrics-%d";
+const char* MetricsSocketPath = "/tmp/glfw-spike-metrics-%d.sock";
+const int MetricsRingFrames = 1024;
+const int MetricsGpuMemoryInterval = 60;
+
+// Offscreen targets unused for this many frames are freed
+const int RenderTargetEvictFrames = 120;
+const int ReadbackRingDepth = 3;
+const char* ScreenshotPrefix = "screenshot_";
+
+// Largest tile used for tiled renders unless --tile-size says otherwise
+const int TiledMaxTileSize = 4096;
+
+// While idle, how often to wake up to collect readbacks in flight
+const double ReadbackPollInterval = 0.005;
+
+// Partial redraw: dirty rectangles are merged down to at most this
+// many scissored passes, and above this fraction of the frame a full
+// redraw is cheaper
+const bool PartialRedraw = true;
+const size_t PartialRedrawMaxRegions = 8;
+const float PartialRedrawFullFraction = 0.6f;
+
+// Dynamic resolution (--dynamic-resolution): scale bounds, and frames
+// to wait after a change for GPU timings at the new scale
+const float DynamicResolutionMinScale = 0.5f;
+const float DynamicResolutionMaxScale = 1.0f;
+const int DynamicResolutionSettleFrames = 8;
+
+// Iconified or hidden windows draw nothing until restored
+const bool ThrottleSuspendWhenIconified = true;
+
+// F2 pulses the triangle, a small animated region for partial redraw
+const double PulseFrequency = 0.5;
+const double PulseInterval = 1.0 / 60.0;
+
+// Canonical scenes for golden-image checks, rendered at a fixed size
+// so results do not depend on the window
+struct GoldenScene
+{
+    const char* name;
+    const char* vertexShader;
+    const char* fragmentShader;
+};
+
+const GoldenScene GoldenScenes[] = {
+    { "multiinput", "shaders/vertex/multiinput.glsl", "shaders/fragment/multiinput.glsl" },
+    { "fragposition", "shaders/vertex/multiinput.glsl", "shaders/fragment/fragposition.glsl" },
+};
+const int GoldenImageWidth = 640;
+const int GoldenImageHeight = 640;
+
+// Occlusion query comparison (--occlusion-queries): a grid of city
+// blocks with small objects scattered between them, seen from a
+// camera driving down one street
+const int OcclusionBlocksX = 17;
+const int OcclusionBlocksZ = 16;
+const float OcclusionBlockSpacing = 24.0f;
+const float OcclusionBuildingHalfWidth = 8.0f;
+const size_t OcclusionObjectCount = 20000;
+const float OcclusionNearDistance = 0.1f;
+const float OcclusionFarDistance = 500.0f;
+
+//--------------------------------------------------------------
+// Shader definitions
+//--------------------------------------------------------------
+
+const char* VertexShaderFilename = "shaders/vertex/multiinput.glsl";
+const char* FragmentShaderFilename = "shaders/fragment/multiinput.glsl";
+
+// Window background, a static layer rendered once per size
+const char* BackgroundVertexShaderFilename = "shaders/vertex/fullscreen.glsl";
+const char* BackgroundFragmentShaderFilename = "shaders/fragment/fragposition.glsl";
+
+// Solid boxes for the occlusion query comparison
+const char* BoxVertexShaderFilename = "shaders/vertex/bounds.glsl";
+const char* BoxFragmentShaderFilename = "shaders/fragment/basic.glsl";
+
+//--------------------------------------------------------------
+// Scene data
+//--------------------------------------------------------------
+
+// Triangle positions followed by colors (see initialize_vertex_buffer)
+const float TriangleVertexData[] = {
+    // Triangle data:
+     0.0f,    0.5f, 0.0f, 1.0f, // (Vec4)
+     0.5f, -0.366f, 0.0f, 1.0f, // (Vec4)
+    -0.5f, -0.366f, 0.0f, 1.0f, // (Vec4)
+
+    // Color data:
+     1.0f,    0.0f, 0.0f, 1.0f, // (Vec4)
+     0.0f,    1.0f, 0.0f, 1.0f, // (Vec4)
+     0.0f,    0.0f, 1.0f, 1.0f, // (Vec4)
+};
+const int TriangleVertexCount = 3;
+
+//--------------------------------------------------------------
+// Program function declarations
+//--------------------------------------------------------------
+
+static GLuint initialize_main_shaders();
+static GLuint initialize_vertex_buffer();
+static void render_scene(GLuint shaderProgram, const ViewTransform &view = ViewTransform());
+static void draw_triangle(GLuint shaderProgram, const ViewTransform &view);
+static void draw_fullscreen(GLuint shaderProgram);
+static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+static void window_refresh_callback(GLFWwindow* window);
+static void window_focus_callback(GLFWwindow* window, int focused);
+static void window_iconify_callback(GLFWwindow* window, int iconified);
+static void error_callback(int error, const char* description);
+static void save_screenshot(const ReadbackImage &image);
+
+// Renderer resources shared by the interactive and offline modes
+struct RenderContext
+{
+    GLFWwindow* window;
+    GLuint mainShader;
+    RenderTargetPool* renderTargets;
+    ReadbackRing* readback;
+
+    // Persistent copy of the last frame for partial redraws, owned
+    // here rather than by the pool so its contents survive
+    ResizableTarget* backbuffer;
+
+    // The interactive scene as cached layers (background, geometry)
+    GLuint backgroundShader;
+    LayerStack* layers;
+    int geometryLayer;
+
+    // Dynamic resolution, all NULL unless enabled
+    RenderScaleController* renderScale;
+    ResizableTarget* scaledTarget;
+    Upscaler* upscaler;
+
+    // Post-processing applied to the window scene (may be empty)
+    PostChain* post;
+
+    // Window frames are declared as passes and run by the graph
+    FrameGraph* frameGraph;
+};
+
+static void run_window_loop(RenderContext &context, const ProgramOptions &options);
+static bool wait_for_damage(RenderContext &context);
+static void build_window_layers(RenderContext &context);
+static void render_window_scene(RenderContext &context, int width, int height);
+static void render_window_graph(RenderContext &context, GLuint output, int width, int height);
+static void animate_scene(RenderContext &context, double now, int framebufferWidth, int framebufferHeight);
+static DamageRect scene_bounds(int framebufferWidth, int framebufferHeight);
+static void render_window_frame(RenderContext &context, int width, int height, const vector<DamageRect> &regions);
+static void run_export(RenderContext &context, const ProgramOptions &options, int width, int height);
+static void run_tiled_render(RenderContext &context, const ProgramOptions &options);
+static bool run_golden_images(RenderContext &context, const ProgramOptions &options);
+static bool run_occlusion_queries(RenderContext &context, const ProgramOptions &options, int width, int height);
+
+// Set from key_callback, consumed by the main loop
+static bool ScreenshotRequested = false;
+static bool PulseAnimation = false;
+
+// Scene animation state
+static float PulseValue = 0.0f;
+static double NextPulseTime = 0.0;
+
+// Partial redraw statistics (pixels shaded vs. full frames)
+static double ShadedPixels = 0.0;
+static double FullFramePixels = 0.0;
+
+// Latest framebuffer size from framebuffer_size_callback; the loop
+// applies it once per frame however many events came in
+static bool ResizePending = false;
+static int PendingFramebufferWidth = 0;
+static int PendingFramebufferHeight = 0;
+static unsigned long ResizeEvents = 0;
+static unsigned long ResizesApplied = 0;
+
+//==============================================================
+// Entry point
+//==============================================================
+
+int main(int argc, char** argv)
+{
+    ProgramOptions options;
+
+    if (!parse_options(argc, argv, options))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    // CPU-only, no window needed
+    if (!options.benchmarks.empty())
+    {
+        return run_benchmarks(split_pass_list(options.benchmarks), cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!options.lodSource.empty())
+    {
+        return convert_obj_to_lod(options.lodSource, options.exportPath, cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    bool exporting = options.exportFrames > 0;
+    bool tiled = options.tiledWidth > 0 && options.tiledHeight > 0;
+    bool golden = !options.goldenDirectory.empty();
+    bool occlusion = options.occlusionFrames > 0;
+    int status = EXIT_SUCCESS;
+
+    // Raw frames may be going to stdout, keep reports off it
+    ostream &report = exporting ? cerr : cout;
+
+    // Initialize error handler
+    glfwSetErrorCallback(error_callback);
+
+    // Initialize GLFW library
+    if (!glfwInit())
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    // Offline modes only need the context, not a visible window
+    if (exporting || tiled || golden || occlusion)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    }
+
+    // Set up a windowed OpenGL window
+    int width = options.width > 0 ? options.width : WindowWidth;
+    int height = options.height > 0 ? options.height : WindowHeight;
+    GLFWwindow* window = glfwCreateWindow(width, height, WindowTitle, NULL, NULL);
+
+    if (!window)
+    {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Configure window hookpoints
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowIconifyCallback(window, window_iconify_callback);
+
+    // Initialize OpenGL by creating a context
+    glfwMakeContextCurrent(window);
+
+    // Initialize OpenGL resources such as shaders
+    RenderContext context;
+    context.window = window;
+    context.mainShader = initialize_main_shaders();
+
+    // Keep a rolling window of frame timings to catch hitches
+    ProfilerConfig profilerConfig;
+    profilerConfig.windowFrames = HitchWindowFrames;
+    profilerConfig.hitchFactor = HitchFactor;
+    profilerConfig.hitchMinimumTime = HitchMinimumTime;
+    profilerConfig.neighborFrames = HitchNeighborFrames;
+    profilerConfig.dumpPrefix = HitchDumpPrefix;
+    profiler_initialize(profilerConfig);
+
+    // Per-draw-group pipeline statistics
+    gpu_stats_initialize();
+    gpu_stats_name_program(context.mainShader, "multiinput");
+
+    // Offscreen targets and asynchronous readback
+    // (heap allocated so they can be freed while the context exists)
+    context.renderTargets = new RenderTargetPool(RenderTargetEvictFrames);
+    context.readback = new ReadbackRing(ReadbackRingDepth);
+    context.backbuffer = new ResizableTarget(RenderTargetDesc(0, 0, GL_RGBA8, true, GL_NEAREST));
+    context.frameGraph = new FrameGraph(context.renderTargets);
+
+    // Debug heatmaps (F1 cycles overdraw / shader cost / off); the
+    // mode stays off if their shaders do not build
+    if (overdraw_initialize())
+    {
+        overdraw_register_program(context.mainShader, VertexShaderFilename, FragmentShaderFilename);
+    }
+
+    context.backgroundShader = 0;
+    context.layers = NULL;
+    context.geometryLayer = -1;
+
+    context.renderScale = NULL;
+    context.scaledTarget = NULL;
+    context.upscaler = NULL;
+
+    if (options.dynamicResolutionTarget > 0.0)
+    {
+        context.upscaler = new Upscaler;
+
+        // Without the upscale pass, frames stay at native resolution
+        if (!context.upscaler->initialize())
+        {
+            report << "Dynamic resolution disabled, rendering at native resolution" << endl;
+            delete context.upscaler;
+            context.upscaler = NULL;
+        }
+    }
+
+    if (context.upscaler)
+    {
+        RenderScaleConfig scaleConfig;
+        scaleConfig.targetGpuTime = options.dynamicResolutionTarget;
+        scaleConfig.minScale = DynamicResolutionMinScale;
+        scaleConfig.maxScale = DynamicResolutionMaxScale;
+        scaleConfig.settleFrames = DynamicResolutionSettleFrames;
+
+        context.renderScale = new RenderScaleController(scaleConfig);
+        context.scaledTarget = new ResizableTarget(RenderTargetDesc(0, 0, GL_RGBA8, true, GL_LINEAR));
+    }
+
+    context.post = new PostChain;
+    bool postReady = context.post->build(split_pass_list(options.postPasses));
+
+    if (postReady && !context.post->empty())
+    {
+        report << "Post-processing: " << context.post->pass_count() << " passes in "
+               << context.post->stage_count() << " draws" << endl;
+    }
+
+    if (!postReady)
+    {
+        status = EXIT_FAILURE;
+    }
+    else if (golden)
+    {
+        status = run_golden_images(context, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (occlusion)
+    {
+        status = run_occlusion_queries(context, options, width, height) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (tiled)
+    {
+        run_tiled_render(context, options);
+    }
+    else if (exporting)
+    {
+        run_export(context, options, width, height);
+    }
+    else
+    {
+        build_window_layers(context);
+        run_window_loop(context, options);
+    }
+
+    // Cleanup
+    gl_trace_report(report);
+    gpu_stats_report(report);
+    gpu_stats_shutdown();
+    overdraw_shutdown();
+    delete context.backbuffer;
+    delete context.upscaler;
+    delete context.scaledTarget;
+    delete context.renderScale;
+    delete context.post;
+    delete context.frameGraph;
+    delete context.layers;
+    glDeleteProgram(context.backgroundShader);
+    delete context.readback;
+    delete context.renderTargets;
+    profiler_shutdown();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    return status;
+}
+
+//--------------------------------------------------------------
+// Interactive window loop
+//--------------------------------------------------------------
+
+static void run_window_loop(RenderContext &context, const ProgramOptions &options)
+{
+    // Publish per-frame metrics for external scrapers
+    MetricsConfig metricsConfig;
+    metricsConfig.sharedMemoryName = MetricsSharedMemoryName;
+    metricsConfig.socketPath = MetricsSocketPath;
+    metricsConfig.capacity = MetricsRingFrames;
+    metrics_initialize(metricsConfig);
+
+    FrameMetrics frameMetrics;
+    frameMetrics.uploadBytesTotal = 0;
+    frameMetrics.gpuMemoryFreeKb = -1;
+
+    // Throttle while in the background (unfocused, iconified)
+    ThrottleConfig throttleConfig;
+    throttleConfig.unfocusedFrameRate = options.backgroundFrameRate;
+    throttleConfig.suspendWhenIconified = ThrottleSuspendWhenIconified;
+    throttle_initialize(throttleConfig, glfwGetTime());
+    throttle_set_focused(glfwGetWindowAttrib(context.window, GLFW_FOCUSED) == GL_TRUE, glfwGetTime());
+
+    // Steady frame pacing and the swap interval
+    FramePacerConfig pacerConfig;
+    pacerConfig.targetFrameRate = options.targetFrameRate;
+    parse_swap_mode(options.swapMode, pacerConfig.swapMode);
+    frame_pacer_initialize(pacerConfig);
+
+    // Redraw on demand: the first frame is always needed
+    damage_invalidate(DamageExpose);
+    double idleSeconds = 0.0;
+    double loopStart = glfwGetTime();
+
+    // Enter main window loop
+    uint64_t frameIndex = 0;
+
+    vector<DamageRect> regions;
+
+    // Framebuffer pixels, not window coordinates, which differ on HiDPI displays
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(context.window, &framebufferWidth, &framebufferHeight);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+    while (!glfwWindowShouldClose(context.window))
+    {
+        animate_scene(context, glfwGetTime(), framebufferWidth, framebufferHeight);
+
+        // Hold off while the window is in the background. Restoring or
+        // focusing it is an event, so these waits end right away.
+        throttle_set_visible(glfwGetWindowAttrib(context.window, GLFW_VISIBLE) == GL_TRUE, glfwGetTime());
+        double throttleWait = throttle_wait_time(glfwGetTime());
+
+        if (throttleWait != 0.0)
+        {
+            double idleStart = glfwGetTime();
+
+            if (throttleWait < 0.0)
+            {
+                glfwWaitEvents();
+            }
+            else
+            {
+                glfwWaitEventsTimeout(throttleWait);
+            }
+
+            idleSeconds += glfwGetTime() - idleStart;
+            continue;
+        }
+
+        // Sleep until something changes what is on screen; the last
+        // presented frame stays up in the meantime
+        if (!options.continuous && !damage_pending())
+        {
+            double idleStart = glfwGetTime();
+            bool damaged = wait_for_damage(context);
+            idleSeconds += glfwGetTime() - idleStart;
+
+            if (!damaged)
+            {
+                continue;
+            }
+        }
+
+        // Start the frame on the pacing grid, then pick up any input
+        // that arrived while waiting so it makes this frame
+        double pacingWait = frame_pacer_begin_frame();
+
+        if (pacingWait > 0.0)
+        {
+            idleSeconds += pacingWait;
+            glfwPollEvents();
+        }
+
+        // A drag-resize reports every intermediate size; only the last
+        // one before this frame matters
+        if (ResizePending)
+        {
+            framebufferWidth = PendingFramebufferWidth;
+            framebufferHeight = PendingFramebufferHeight;
+
+            // [This function defines the current viewport transform. It defines as a
+            // region of the window, specified by the bottom-left position and a width/height.]
+            glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+            ResizePending = false;
+            ResizesApplied++;
+        }
+
+        damage_consume(framebufferWidth, framebufferHeight, regions,
+                       PartialRedrawMaxRegions, PartialRedrawFullFraction);
+        profiler_begin_frame();
+
+        {
+            ProfileScope zone("render_scene");
+
+            if (options.continuous || !PartialRedraw || overdraw_mode() != OverdrawOff
+                || !context.post->empty() || context.renderScale)
+            {
+                // Post passes read neighbouring pixels and scaled frames
+                // are not in window pixels, so both always get whole frames
+                overdraw_begin_frame(framebufferWidth, framebufferHeight);
+
+                GLint output = 0;
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output);
+                render_window_graph(context, output, framebufferWidth, framebufferHeight);
+
+                overdraw_end_frame();
+            }
+            else
+            {
+                render_window_frame(context, framebufferWidth, framebufferHeight, regions);
+            }
+
+            // Queue the copy now, collect it a few frames later
+            if (ScreenshotRequested && context.readback->request(0, 0, 0, framebufferWidth, framebufferHeight, frameIndex))
+            {
+                ScreenshotRequested = false;
+            }
+
+            context.readback->poll(save_screenshot);
+        }
+
+        {
+            ProfileScope zone("swap_buffers");
+            frame_pacer_end_render();
+            glfwSwapBuffers(context.window);
+            frame_pacer_end_frame();
+        }
+
+        {
+            ProfileScope zone("poll_events");
+            glfwPollEvents();
+        }
+
+        gpu_stats_end_frame();
+        context.renderTargets->end_frame();
+        profiler_end_frame();
+        gl_trace_end_frame();
+        throttle_frame_rendered(glfwGetTime());
+
+        if (context.renderScale)
+        {
+            context.renderScale->update(profiler_last_gpu_time());
+        }
+
+        if (frameIndex % MetricsGpuMemoryInterval == 0)
+        {
+            frameMetrics.gpuMemoryFreeKb = metrics_query_gpu_memory_kb();
+        }
+
+        frameMetrics.frameIndex = frameIndex;
+        frameMetrics.timestamp = glfwGetTime();
+        frameMetrics.frameTime = profiler_last_cpu_time();
+        frameMetrics.gpuTime = profiler_last_gpu_time();
+        frameMetrics.drawCalls = profiler_last_counter(CounterDrawCalls);
+        frameMetrics.uploadBytes = profiler_last_counter(CounterUploadBytes);
+        frameMetrics.uploadBytesTotal += frameMetrics.uploadBytes;
+        metrics_publish(frameMetrics);
+
+        frameIndex++;
+    }
+
+    if (!options.continuous)
+    {
+        double elapsed = glfwGetTime() - loopStart;
+        cout << "Rendered " << frameIndex << " frames in " << elapsed << " s, idle "
+             << (elapsed > 0.0 ? 100.0 * idleSeconds / elapsed : 0.0) << "% of the time" << endl;
+
+        if (FullFramePixels > 0.0)
+        {
+            cout << "Partial redraw shaded " << 100.0 * ShadedPixels / FullFramePixels
+                 << "% of the pixels of full redraws" << endl;
+        }
+    }
+
+    throttle_report(cout, glfwGetTime());
+
+    cout << "Resize: " << ResizeEvents << " framebuffer size events applied as " << ResizesApplied
+         << " resizes, " << context.backbuffer->reallocations() + context.layers->reallocations()
+         << " target reallocations" << endl;
+    frame_pacer_report(cout);
+    context.frameGraph->report(cout);
+
+    if (context.renderScale)
+    {
+        context.renderScale->report(cout);
+    }
+
+    vector<LayerStats> layerStats = context.layers->stats();
+
+    for (size_t i = 0; i < layerStats.size(); i++)
+    {
+        cout << "Layer " << layerStats[i].name << ": rendered " << layerStats[i].renders
+             << " times, reused from cache " << layerStats[i].composites << " times" << endl;
+    }
+
+    while (context.readback->in_flight() > 0)
+    {
+        context.readback->poll(save_screenshot, true);
+    }
+
+    metrics_shutdown();
+}
+
+// Blocks in glfwWaitEvents until an event or a scheduled animation
+// damages the scene. Returns false when it woke up without damage,
+// e.g. to collect a finished screenshot readback.
+static bool wait_for_damage(RenderContext &context)
+{
+    double wait = damage_time_until_wake(glfwGetTime());
+
+    if (damage_pending())
+    {
+        return true;
+    }
+
+    if (context.readback->in_flight() > 0)
+    {
+        context.readback->poll(save_screenshot);
+        wait = wait < 0.0 ? ReadbackPollInterval : min(wait, ReadbackPollInterval);
+    }
+
+    if (wait < 0.0)
+    {
+        glfwWaitEvents();
+    }
+    else if (wait > 0.0)
+    {
+        glfwWaitEventsTimeout(wait);
+    }
+
+    damage_time_until_wake(glfwGetTime());
+
+    return damage_pending();
+}
+
+// Redraws the damaged part of the scene into the persistent
+// backbuffer and copies it to the window. Each region is its own
+// scissored pass; glClear and rasterization both respect the scissor,
+// so fragment work scales with the damaged area.
+static void render_window_frame(RenderContext &context, int width, int height, const vector<DamageRect> &regions)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    // The storage is reused across small size changes, but its
+    // contents only match the frame at the size they were drawn at
+    bool fresh = context.backbuffer->width() != width || context.backbuffer->height() != height;
+    fresh = context.backbuffer->resize(width, height) || fresh;
+
+    if (!context.backbuffer->target())
+    {
+        return;
+    }
+
+    const RenderTarget *storage = context.backbuffer->target();
+    FrameGraph &graph = *context.frameGraph;
+    graph.reset();
+
+    FrameResource window = graph.import_target("window", 0, 0, width, height);
+    FrameResource backbuffer = graph.import_target("backbuffer", storage->framebuffer, storage->colorTexture,
+                                                   width, height, context.backbuffer->scale_x(),
+                                                   context.backbuffer->scale_y());
+
+    // Regions are drawn over the previous frame, a whole frame replaces it
+    bool whole = fresh || regions.empty();
+    vector<FrameResource> previous;
+
+    if (!whole)
+    {
+        previous.push_back(backbuffer);
+    }
+
+    graph.add_pass("scene", previous, backbuffer, [&context, &regions, whole, width, height]()
+    {
+        if (whole)
+        {
+            render_window_scene(context, width, height);
+            return;
+        }
+
+        glEnable(GL_SCISSOR_TEST);
+
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            const DamageRect &region = regions[i];
+
+            glScissor(region.x, region.y, region.width, region.height);
+            render_window_scene(context, width, height);
+        }
+
+        glDisable(GL_SCISSOR_TEST);
+    });
+
+    // The window's back buffer is undefined after a swap, so the whole
+    // frame is copied; that costs bandwidth but no shading
+    GLuint source = storage->framebuffer;
+
+    graph.add_pass("present", vector<FrameResource>(1, backbuffer), window, [source, width, height]()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    });
+
+    if (graph.compile())
+    {
+        graph.execute();
+    }
+
+    if (whole)
+    {
+        ShadedPixels += (double) width * height;
+    }
+    else
+    {
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            ShadedPixels += (double) regions[i].width * regions[i].height;
+        }
+    }
+
+    FullFramePixels += (double) width * height;
+}
+
+// Declares the whole window frame into output (the window, or the
+// heatmap target): the scene, at the dynamic resolution scale if
+// enabled, the post-processing stages and the upscale. The debug
+// heatmaps show the scene alone, at full size.
+static void render_window_graph(RenderContext &context, GLuint output, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    bool debug = overdraw_mode() != OverdrawOff;
+    bool post = !context.post->empty() && !debug;
+    bool scaled = context.renderScale && context.renderScale->scale() < 1.0f && !debug;
+
+    FrameGraph &graph = *context.frameGraph;
+    graph.reset();
+
+    FrameResource window = graph.import_target("window", output, 0, width, height);
+    FrameResource image = window;
+    int sceneWidth = width;
+    int sceneHeight = height;
+
+    // The scaled image keeps its own storage so that scale changes
+    // get the resize hysteresis instead of a new pool entry each
+    if (scaled)
+    {
+        context.renderScale->scaled_size(width, height, sceneWidth, sceneHeight);
+        context.scaledTarget->resize(sceneWidth, sceneHeight);
+
+        const RenderTarget *storage = context.scaledTarget->target();
+
+        if (!storage)
+        {
+            return;
+        }
+
+        image = graph.import_target("scaled", storage->framebuffer, storage->colorTexture, sceneWidth, sceneHeight,
+                                    context.scaledTarget->scale_x(), context.scaledTarget->scale_y());
+    }
+
+    FrameResource scene = image;
+
+    if (post)
+    {
+        scene = graph.create_texture("scene", RenderTargetDesc(sceneWidth, sceneHeight, GL_RGBA8, false, GL_LINEAR));
+    }
+
+    graph.add_pass("scene", vector<FrameResource>(), scene, [&context, sceneWidth, sceneHeight]()
+    {
+        render_window_scene(context, sceneWidth, sceneHeight);
+    });
+
+    if (post)
+    {
+        context.post->add_passes(graph, scene, image);
+    }
+
+    if (scaled)
+    {
+        Upscaler *upscaler = context.upscaler;
+
+        graph.add_pass("upscale", vector<FrameResource>(1, image), window, [upscaler, &graph, image]()
+        {
+            upscaler->draw(graph.texture(image), graph.scale_x(image), graph.scale_y(image));
+        });
+    }
+
+    if (graph.compile())
+    {
+        graph.execute();
+    }
+}
+
+// The window scene: the gradient background never changes, so both
+// layers are cached and a frame without changes to either costs two
+// texture copies regardless of how expensive the layers are to draw
+static void build_window_layers(RenderContext &context)
+{
+    context.backgroundShader = create_program_from_files(BackgroundVertexShaderFilename, BackgroundFragmentShaderFilename);
+    gpu_stats_name_program(context.backgroundShader, "background");
+    overdraw_register_program(context.backgroundShader, BackgroundVertexShaderFilename, BackgroundFragmentShaderFilename);
+
+    context.layers = new LayerStack;
+    context.layers->initialize();
+
+    GLuint backgroundShader = context.backgroundShader;
+    GLuint mainShader = context.mainShader;
+
+    context.layers->add_layer("background", LayerCached, true, [backgroundShader]()
+    {
+        draw_fullscreen(backgroundShader);
+    });
+
+    context.geometryLayer = context.layers->add_layer("geometry", LayerCached, false, [mainShader]()
+    {
+        draw_triangle(mainShader, ViewTransform());
+    });
+
+    // Nothing has been drawn with the new shaders and layers yet
+    damage_invalidate(DamageAsset);
+}
+
+// Composites the window scene into the bound framebuffer. The debug
+// heatmaps substitute shaders while drawing, so they bypass the caches.
+static void render_window_scene(RenderContext &context, int width, int height)
+{
+    context.layers->composite(width, height, overdraw_mode() != OverdrawOff);
+}
+
+// Advances the F2 pulse. Only the triangle's screen rectangle changes,
+// so that is all it damages, then it asks to be woken for its next step.
+static void animate_scene(RenderContext &context, double now, int framebufferWidth, int framebufferHeight)
+{
+    if (!PulseAnimation)
+    {
+        return;
+    }
+
+    if (now < NextPulseTime)
+    {
+        damage_schedule(NextPulseTime);
+        return;
+    }
+
+    PulseValue = (float) (0.5 + 0.5 * sin(now * 2.0 * M_PI * PulseFrequency));
+    context.layers->invalidate(context.geometryLayer);
+
+    DamageRect bounds = scene_bounds(framebufferWidth, framebufferHeight);
+    damage_invalidate_rect(bounds.x, bounds.y, bounds.width, bounds.height, DamageAnimation);
+
+    NextPulseTime = now + PulseInterval;
+    damage_schedule(NextPulseTime);
+}
+
+// Window rectangle covered by the triangle, padded a pixel for rasterization rules
+static DamageRect scene_bounds(int framebufferWidth, int framebufferHeight)
+{
+    float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+
+    for (int i = 0; i < TriangleVertexCount; i++)
+    {
+        minX = min(minX, TriangleVertexData[i * 4 + 0]);
+        maxX = max(maxX, TriangleVertexData[i * 4 + 0]);
+        minY = min(minY, TriangleVertexData[i * 4 + 1]);
+        maxY = max(maxY, TriangleVertexData[i * 4 + 1]);
+    }
+
+    int left = (int) floor((minX * 0.5f + 0.5f) * framebufferWidth) - 1;
+    int bottom = (int) floor((minY * 0.5f + 0.5f) * framebufferHeight) - 1;
+    int right = (int) ceil((maxX * 0.5f + 0.5f) * framebufferWidth) + 1;
+    int top = (int) ceil((maxY * 0.5f + 0.5f) * framebufferHeight) + 1;
+
+    DamageRect bounds = { left, bottom, right - left, top - bottom };
+    return bounds;
+}
+
 //--------------------------------------------------------------
-// Shader definitions
+// Headless frame export
 //--------------------------------------------------------------
 
-const char* VertexShaderFilename = "shaders/vertex/multiinput.glsl";
-const char* FragmentShaderFilename = "shaders/fragment/multiinput.glsl";
+// Renders the requested number of frames into an offscreen target
+// and streams them to the encoder pool. The render loop only waits
+// when every readback PBO is still being filled by the GPU, or when
+// the encoders have fallen a full queue behind.
+static void run_export(RenderContext &context, const ProgramOptions &options, int width, int height)
+{
+    FrameExporter exporter(options.exportFormat, options.exportPath, options.exportThreads, options.pngCompression);
+    std::function<void(const ReadbackImage &)> submit = [&exporter](const ReadbackImage &image)
+    {
+        exporter.submit(image);
+    };
+
+    RenderTargetDesc desc(width, height, GL_RGBA8, true);
+    double start = glfwGetTime();
+
+    for (int frame = 0; frame < options.exportFrames && !glfwWindowShouldClose(context.window); frame++)
+    {
+        profiler_begin_frame();
+
+        RenderTarget *target = context.renderTargets->acquire(desc);
+
+        if (!target)
+        {
+            break;
+        }
+
+        render_target_bind(target);
+        render_scene(context.mainShader);
+
+        // The readback owns its PBO, so the target is free for the
+        // next frame as soon as the copy is queued
+        while (!context.readback->request(target->framebuffer, 0, 0, width, height, frame))
+        {
+            context.readback->poll(submit, true);
+        }
+
+        context.renderTargets->release(target);
+        context.readback->poll(submit);
+
+        glfwPollEvents();
+
+        gpu_stats_end_frame();
+        context.renderTargets->end_frame();
+        profiler_end_frame();
+        gl_trace_end_frame();
+    }
+
+    while (context.readback->in_flight() > 0)
+    {
+        context.readback->poll(submit, true);
+    }
+
+    double renderSeconds = glfwGetTime() - start;
+    exporter.finish();
+    double totalSeconds = glfwGetTime() - start;
+
+    FrameExportStats stats = exporter.stats();
+
+    cerr << "Exported " << stats.framesWritten << " frames (" << stats.bytesWritten << " bytes) with "
+         << exporter.thread_count() << " encoder threads" << endl
+         << "  render loop " << renderSeconds << " s, total " << totalSeconds << " s, "
+         << stats.framesWritten / totalSeconds << " frames/s" << endl
+         << "  encoding " << stats.encodeSeconds << " thread-s, render thread waited on a full queue "
+         << stats.submitStalls << " times" << endl;
+}
 
 //--------------------------------------------------------------
-// Program function declarations
+// Tiled poster rendering
 //--------------------------------------------------------------
 
-static GLuint initialize_main_shaders();
-static GLuint create_shader_program(const std::vector<GLuint> &shaderList);
-static GLuint create_shader(GLenum eShaderType, const std::string &strShaderFile);
-static GLuint initialize_vertex_buffer();
-static void render_scene(GLuint shaderProgram);
-static void window_size_callback(GLFWwindow* window, int width, int height);
-static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
-static void error_callback(int error, const char* description);
+// Renders an image of any size by drawing the scene once per tile
+// with a view transform covering just that tile. Finished tiles come
+// back through the readback ring and go straight to their place in
+// the output file, so only the tile target and the PBOs in flight
+// are ever held in memory.
+static void run_tiled_render(RenderContext &context, const ProgramOptions &options)
+{
+    int fullWidth = options.tiledWidth;
+    int fullHeight = options.tiledHeight;
 
-//==============================================================
-// Entry point
-//==============================================================
+    GLint maxViewport[2];
+    GLint maxRenderbuffer;
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+
+    int tileLimit = min(min(maxViewport[0], maxViewport[1]), maxRenderbuffer);
+    int tileSize = options.tileSize > 0 ? min(options.tileSize, tileLimit) : min(tileLimit, TiledMaxTileSize);
+
+    TiledImageWriter writer;
+
+    if (!writer.open(options.exportPath, fullWidth, fullHeight))
+    {
+        return;
+    }
+
+    vector<Tile> tiles = make_tiles(fullWidth, fullHeight, tileSize);
+    RenderTarget *target = context.renderTargets->acquire(RenderTargetDesc(tileSize, tileSize, GL_RGBA8, true));
+
+    if (!target)
+    {
+        return;
+    }
+
+    bool failed = false;
+    std::function<void(const ReadbackImage &)> store = [&](const ReadbackImage &image)
+    {
+        failed = !writer.write_tile(tiles[image.tag], image.pixels) || failed;
+    };
+
+    double start = glfwGetTime();
+
+    for (size_t i = 0; i < tiles.size() && !failed; i++)
+    {
+        const Tile &tile = tiles[i];
+
+        render_target_bind(target);
+        glViewport(0, 0, tile.width, tile.height);
+        render_scene(context.mainShader, view_for_region(tile.x, tile.y, tile.width, tile.height, fullWidth, fullHeight));
+
+        while (!context.readback->request(target->framebuffer, 0, 0, tile.width, tile.height, i))
+        {
+            context.readback->poll(store, true);
+        }
+
+        context.readback->poll(store);
+        glfwPollEvents();
+    }
+
+    while (context.readback->in_flight() > 0)
+    {
+        context.readback->poll(store, true);
+    }
+
+    context.renderTargets->release(target);
+    writer.close();
 
-int main()
+    cout << (failed ? "Failed writing " : "Wrote ") << options.exportPath << " (" << fullWidth << "x" << fullHeight
+         << ", " << tiles.size() << " tiles of " << tileSize << ") in " << glfwGetTime() - start << " s" << endl;
+}
+
+//--------------------------------------------------------------
+// Golden-image regression checks
+//--------------------------------------------------------------
+
+// Renders every canonical scene offscreen and compares it with the
+// stored golden image: a matching 64-bit hash means an exact match,
+// otherwise a per-pixel tolerance diff decides and a mask of the
+// differing pixels is written next to the golden. With goldenUpdate
+// set the renders replace the stored images instead.
+static bool run_golden_images(RenderContext &context, const ProgramOptions &options)
 {
-    // Initialize error handler
-    glfwSetErrorCallback(error_callback);
+    bool passed = true;
+    int width = GoldenImageWidth;
+    int height = GoldenImageHeight;
+    RenderTargetDesc desc(width, height, GL_RGBA8, true);
 
-    // Initialize GLFW library
-    if (!glfwInit())
+    for (size_t i = 0; i < sizeof(GoldenScenes) / sizeof(GoldenScenes[0]); i++)
     {
-        exit(EXIT_FAILURE);
+        const GoldenScene &scene = GoldenScenes[i];
+        string goldenPath = options.goldenDirectory + "/" + scene.name + ".ppm";
+
+        GLuint program = create_program_from_files(scene.vertexShader, scene.fragmentShader);
+
+        if (!program)
+        {
+            cout << "FAIL " << scene.name << ": could not build its shader program" << endl;
+            passed = false;
+            continue;
+        }
+
+        RenderTarget *target = context.renderTargets->acquire(desc);
+
+        if (!target)
+        {
+            cout << "FAIL " << scene.name << ": no render target" << endl;
+            glDeleteProgram(program);
+            passed = false;
+            continue;
+        }
+
+        render_target_bind(target);
+        render_scene(program);
+
+        vector<unsigned char> rendered;
+        bool written = false;
+        std::function<void(const ReadbackImage &)> keep = [&](const ReadbackImage &image)
+        {
+            if (options.goldenUpdate)
+            {
+                written = write_ppm(goldenPath, image.pixels, image.width, image.height);
+            }
+
+            normalize_readback(image.pixels, image.width, image.height, rendered);
+        };
+
+        context.readback->request(target->framebuffer, 0, 0, width, height, i);
+        while (context.readback->in_flight() > 0)
+        {
+            context.readback->poll(keep, true);
+        }
+
+        context.renderTargets->release(target);
+        glDeleteProgram(program);
+
+        if (rendered.empty())
+        {
+            cout << "FAIL " << scene.name << ": the readback returned no image" << endl;
+            passed = false;
+            continue;
+        }
+
+        uint64_t renderedHash = hash_bytes(&rendered[0], rendered.size());
+
+        if (options.goldenUpdate && !written)
+        {
+            cout << "FAIL " << scene.name << ": could not write " << goldenPath << endl;
+            passed = false;
+            continue;
+        }
+
+        if (options.goldenUpdate)
+        {
+            cout << "updated " << goldenPath << " (hash " << hex << renderedHash << dec << ")" << endl;
+            continue;
+        }
+
+        vector<unsigned char> expected;
+        int goldenWidth, goldenHeight;
+
+        if (!read_ppm(goldenPath, expected, goldenWidth, goldenHeight) || goldenWidth != width || goldenHeight != height)
+        {
+            cout << "FAIL " << scene.name << ": no usable golden image at " << goldenPath << endl;
+            passed = false;
+            continue;
+        }
+
+        if (hash_bytes(&expected[0], expected.size()) == renderedHash)
+        {
+            cout << "PASS " << scene.name << " (exact, hash " << hex << renderedHash << dec << ")" << endl;
+            continue;
+        }
+
+        size_t pixelCount = (size_t) width * height;
+        ImageDiffResult diff = diff_rgba(&rendered[0], &expected[0], pixelCount, options.goldenTolerance);
+
+        if (diff.differingPixels == 0)
+        {
+            cout << "PASS " << scene.name << " (max channel difference " << diff.maxChannelDifference << ")" << endl;
+            continue;
+        }
+
+        vector<unsigned char> mask(rendered.size());
+        diff_rgba_mask(&rendered[0], &expected[0], pixelCount, options.goldenTolerance, &mask[0]);
+
+        string maskPath = options.goldenDirectory + "/" + scene.name + ".diff.ppm";
+
+        // write_ppm expects GL row order, the mask is top row first
+        vector<unsigned char> flipped;
+        encode_raw(&mask[0], width, height, flipped);
+        write_ppm(maskPath, &flipped[0], width, height);
+
+        cout << "FAIL " << scene.name << ": " << diff.differingPixels << " of " << pixelCount
+             << " pixels beyond tolerance " << options.goldenTolerance << " (max channel difference "
+             << diff.maxChannelDifference << "), mask in " << maskPath << endl;
+        passed = false;
     }
 
-    // Set up a windowed OpenGL window
-    GLFWwindow* window = glfwCreateWindow(WindowWidth, WindowHeight, WindowTitle, NULL, NULL);
+    return passed;
+}
 
-    if (!window)
+//--------------------------------------------------------------
+// GPU occlusion query comparison
+//--------------------------------------------------------------
+
+// Drives a camera down a street of the block grid for the requested
+// number of frames, twice: first drawing every object the frustum
+// culler passes, then the same frames through OcclusionQueries. The
+// buildings are drawn first both times as plain occluders; only the
+// small objects between them go through the queries. Each frame is
+// finished before the next so the times include the GPU.
+static bool run_occlusion_queries(RenderContext &context, const ProgramOptions &options, int width, int height)
+{
+    GLuint program = create_program_from_files(BoxVertexShaderFilename, BoxFragmentShaderFilename);
+
+    if (!program)
     {
-        glfwTerminate();
-        exit(EXIT_FAILURE);
+        cerr << "Could not build the box program" << endl;
+        return false;
     }
 
-    // Configure window hookpoints
-    glfwSetWindowSizeCallback(window, window_size_callback);
-    glfwSetKeyCallback(window, key_callback);
+    OcclusionQueries queries;
+    RenderTarget *target = context.renderTargets->acquire(RenderTargetDesc(width, height, GL_RGBA8, true));
 
-    // Initialize OpenGL by creating a context
-    glfwMakeContextCurrent(window);
+    if (!target)
+    {
+        cerr << "No render target for the occlusion query comparison" << endl;
+        glDeleteProgram(program);
+        return false;
+    }
 
-    // Initialize OpenGL resources such as shaders
-    GLuint mainShader = initialize_main_shaders();
+    if (!queries.initialize())
+    {
+        context.renderTargets->release(target);
+        glDeleteProgram(program);
+        return false;
+    }
 
-    // Enter main window loop
-    while (!glfwWindowShouldClose(window))
+    GLint viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+    GLint centerLocation = glGetUniformLocation(program, "center");
+    GLint extentsLocation = glGetUniformLocation(program, "extents");
+
+    GLuint vertexArray;
+    GLuint buffers[2];
+    glGenVertexArrays(1, &vertexArray);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(UnitCubeVertices), UnitCubeVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(UnitCubeIndices), UnitCubeIndices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Same layout every run
+    srand(1);
+    std::function<float(float, float)> uniform = [](float low, float high)
     {
-        render_scene(mainShader);
+        return low + (high - low) * (float) rand() / (float) RAND_MAX;
+    };
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    CullBounds buildings;
+    buildings.resize(OcclusionBlocksX * OcclusionBlocksZ);
+
+    for (int bz = 0; bz < OcclusionBlocksZ; bz++)
+    {
+        for (int bx = 0; bx < OcclusionBlocksX; bx++)
+        {
+            float halfHeight = uniform(5.0f, 20.0f);
+            Vec3 center((bx - OcclusionBlocksX / 2) * OcclusionBlockSpacing, halfHeight,
+                        OcclusionBlockSpacing * 0.5f + bz * OcclusionBlockSpacing);
+            buildings.set(bz * OcclusionBlocksX + bx, center,
+                          Vec3(OcclusionBuildingHalfWidth, halfHeight, OcclusionBuildingHalfWidth));
+        }
     }
 
-    // Cleanup
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    float sideX = OcclusionBlocksX / 2 * OcclusionBlockSpacing + OcclusionBlockSpacing * 0.5f;
+    float depthZ = OcclusionBlocksZ * OcclusionBlockSpacing;
+
+    CullBounds objects;
+    objects.resize(OcclusionObjectCount);
+
+    for (size_t i = 0; i < OcclusionObjectCount; i++)
+    {
+        Vec3 center(uniform(-sideX, sideX), uniform(0.5f, 3.0f), uniform(0.0f, depthZ));
+        objects.set(i, center, Vec3(uniform(0.25f, 1.0f), uniform(0.25f, 1.0f), uniform(0.25f, 1.0f)));
+    }
+
+    std::function<void(const CullBounds &, uint32_t)> drawBox = [&](const CullBounds &bounds, uint32_t index)
+    {
+        glUseProgram(program);
+        glBindVertexArray(vertexArray);
+        glUniform3f(centerLocation, bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]);
+        glUniform3f(extentsLocation, bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]);
+        glDrawElements(GL_TRIANGLES, UnitCubeIndexCount, GL_UNSIGNED_BYTE, 0);
+    };
+
+    std::function<void(uint32_t)> drawObject = [&](uint32_t index)
+    {
+        drawBox(objects, index);
+    };
+
+    Mat4 projection = mat4_perspective(1.0f, (float) width / (float) height, OcclusionNearDistance,
+                                       OcclusionFarDistance);
+    int frames = options.occlusionFrames;
+    FrustumCuller culler;
+    vector<uint32_t> candidates;
+    unsigned long long candidateDraws = 0;
+    double seconds[2];
+
+    render_target_bind(target);
+    glEnable(GL_DEPTH_TEST);
 
-    return 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool useQueries = pass == 1;
+        double start = glfwGetTime();
+
+        for (int frame = 0; frame < frames; frame++)
+        {
+            // Down the street between the two middle columns, glancing
+            // from side to side
+            float t = frames > 1 ? (float) frame / (float) (frames - 1) : 0.0f;
+            Vec3 eye(OcclusionBlockSpacing * 0.5f, 1.7f, t * (depthZ - 40.0f));
+            Vec3 look(eye.x + 10.0f * (float) sin(t * 4.0 * M_PI), eye.y, eye.z + 40.0f);
+            Mat4 viewProjection = projection * mat4_look_at(eye, look, Vec3(0.0f, 1.0f, 0.0f));
+
+            culler.cull(frustum_from_matrix(viewProjection), objects, candidates);
+
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glUseProgram(program);
+            glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, viewProjection.m);
+
+            for (uint32_t i = 0; i < buildings.size(); i++)
+            {
+                drawBox(buildings, i);
+            }
+
+            if (useQueries)
+            {
+                queries.begin_frame(viewProjection, eye, OcclusionNearDistance);
+                queries.draw(objects, candidates, drawObject);
+            }
+            else
+            {
+                for (size_t i = 0; i < candidates.size(); i++)
+                {
+                    drawObject(candidates[i]);
+                }
+
+                candidateDraws += candidates.size();
+            }
+
+            glFinish();
+        }
+
+        seconds[pass] = glfwGetTime() - start;
+    }
+
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    render_target_bind(NULL, width, height);
+
+    cout << "occlusion queries (" << OcclusionObjectCount << " objects, " << buildings.size() << " buildings, "
+         << frames << " frames at " << width << "x" << height << ")" << endl;
+    cout << "  frustum culled: " << candidateDraws / frames << " draws, "
+         << seconds[0] * 1000.0 / frames << " ms per frame" << endl;
+    cout << "  with queries:   " << seconds[1] * 1000.0 / frames << " ms per frame" << endl;
+    queries.report(cout);
+    culler.report(cout);
+
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteBuffers(2, buffers);
+    glDeleteProgram(program);
+    context.renderTargets->release(target);
+
+    return true;
 }
 
 //--------------------------------------------------------------
 // Scene composition and pipeline
 //--------------------------------------------------------------
 
-static void render_scene(GLuint shaderProgram)
+static void render_scene(GLuint shaderProgram, const ViewTransform &view)
 {
-    GLuint positionBufferObject;
-
     // Start from black
     // [These functions clear the current viewable area of the screen.
     // glClearColor sets the color to clear, while glClear with the
@@ -118,15 +1407,35 @@ static void render_scene(GLuint shaderProgram)
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
+    draw_triangle(shaderProgram, view);
+}
+
+// Draws the triangle without clearing, so it can sit on other layers
+static void draw_triangle(GLuint shaderProgram, const ViewTransform &view)
+{
+    // Built on first use; re-creating it every frame leaked a buffer
+    // object per frame, which long headless exports cannot afford
+    static GLuint positionBufferObject = 0;
+
     // We need to draw with shaders, NOT compatibility layer
     // [This function causes the given program to become the current program.
     // All rendering taking place after this call will use this program for
     // the various shader stages. If the program 0 is given, then no program
     // is current.]
-    glUseProgram(shaderProgram);
+    // (The overdraw debug modes swap in their counting shader here)
+    GLuint program = overdraw_substitute(shaderProgram);
+    glUseProgram(program);
+
+    // Which part of the full view this render covers (all of it
+    // unless we are drawing a tile)
+    glUniform4f(glGetUniformLocation(program, "viewTransform"), view.scaleX, view.scaleY, view.offsetX, view.offsetY);
+    glUniform1f(glGetUniformLocation(program, "pulse"), PulseValue);
 
     // Create a buffer of triangle data that will be rendered
-    positionBufferObject = initialize_vertex_buffer();
+    if (!positionBufferObject)
+    {
+        positionBufferObject = initialize_vertex_buffer();
+    }
 
     // Shove our vertex buffer into the OpenGL pipeline, by
     // telling OpenGL what format our data is in
@@ -151,7 +1460,7 @@ static void render_scene(GLuint shaderProgram)
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)(sizeof(GLfloat) * 4 * 3));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)(sizeof(GLfloat) * 4 * TriangleVertexCount));
 
     // Actually interpret the vertex buffer as triangles
     // [The glDrawArrays function can be used to draw triangles,
@@ -160,7 +1469,10 @@ static void render_scene(GLuint shaderProgram)
     // [This function initiates rendering, using the currently active vertex
     // attributes and the current program object (among other state). It causes
     // a number of vertices to be pulled from the attribute arrays in order.]
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    gpu_stats_begin_draw(shaderProgram, "triangle");
+    glDrawArrays(GL_TRIANGLES, 0, TriangleVertexCount);
+    gpu_stats_end_draw();
+    profiler_count(CounterDrawCalls);
 
     // Cleanup
     glDisableVertexAttribArray(1);
@@ -168,6 +1480,28 @@ static void render_scene(GLuint shaderProgram)
     glUseProgram(0);
 }
 
+// Covers the bound target with one triangle generated from gl_VertexID
+static void draw_fullscreen(GLuint shaderProgram)
+{
+    static GLuint vertexArray = 0;
+
+    if (!vertexArray)
+    {
+        glGenVertexArrays(1, &vertexArray);
+    }
+
+    glUseProgram(overdraw_substitute(shaderProgram));
+    glBindVertexArray(vertexArray);
+
+    gpu_stats_begin_draw(shaderProgram, "fullscreen");
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    gpu_stats_end_draw();
+    profiler_count(CounterDrawCalls);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
 //--------------------------------------------------------------
 // Shader creation
 //--------------------------------------------------------------
@@ -194,92 +1528,6 @@ static GLuint initialize_main_shaders()
     return program;
 }
 
-// Shader link stage
-// [These functions create a working program object. glCreateProgram
-// creates an empty program object. glAttachShader attaches a shader
-// object to that program. Multiple calls attach multiple shader objects.
-// glLinkProgram links all of the previously attached shaders into a
-// complete program. glDetachShader is used to remove a shader object
-// from the program object; this does not affect the behavior of the program.]
-static GLuint create_shader_program(const std::vector<GLuint> &shaderList)
-{
-    // Create OpenGL object
-    GLuint program = glCreateProgram();
-
-    // Tell OpenGL about our shader objects
-    for(size_t iLoop = 0; iLoop < shaderList.size(); iLoop++)
-        glAttachShader(program, shaderList[iLoop]);
-
-    // Link them all into one program
-    glLinkProgram(program);
-
-    // Handle errors
-    GLint status;
-    glGetProgramiv (program, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        GLint infoLogLength;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
-
-        GLchar *strInfoLog = new GLchar[infoLogLength + 1];
-        glGetProgramInfoLog(program, infoLogLength, NULL, strInfoLog);
-
-        cerr <<  "Linker failure: " << strInfoLog << endl;
-        delete[] strInfoLog;
-    }
-
-    // The shaders are linked already, we can tell OpenGL to
-    // forget about them
-    for(size_t iLoop = 0; iLoop < shaderList.size(); iLoop++)
-        glDetachShader(program, shaderList[iLoop]);
-
-    return program;
-}
-
-// Shader compile stage
-// [These functions create a working shader object. glCreateShader simply
-// creates an empty shader object of a particular shader stage.
-// glShaderSource sets strings into that object; multiple calls to this
-// function simply overwrite the previously set strings. glCompileShader
-// causes the shader object to be compiled with the previously set strings.
-// glDeleteShader causes the shader object to be deleted.]
-static GLuint create_shader(GLenum eShaderType, const std::string &strShaderFile)
-{
-    // Create OpenGL object
-    GLuint shader = glCreateShader(eShaderType);
-
-    const char *strFileData = strShaderFile.c_str();
-    glShaderSource(shader, 1, &strFileData, NULL);
-
-    // Turn the text shader into a compiled binary object
-    glCompileShader(shader);
-
-    // Handle errors
-    GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE)
-    {
-        GLint infoLogLength;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-
-        GLchar *strInfoLog = new GLchar[infoLogLength + 1];
-        glGetShaderInfoLog(shader, infoLogLength, NULL, strInfoLog);
-
-        const char *strShaderType = NULL;
-        switch(eShaderType)
-        {
-            case GL_VERTEX_SHADER: strShaderType = "vertex"; break;
-            case GL_GEOMETRY_SHADER: strShaderType = "geometry"; break;
-            case GL_FRAGMENT_SHADER: strShaderType = "fragment"; break;
-        }
-
-        cerr <<  "Compile failure in " << strShaderType << " shader:" << endl << strInfoLog << "%s" << endl;
-        delete[] strInfoLog;
-    }
-
-    return shader;
-}
-
 //--------------------------------------------------------------
 // Triangle data (initialize vertex buffer for rendering)
 //--------------------------------------------------------------
@@ -295,17 +1543,7 @@ static GLuint create_shader(GLenum eShaderType, const std::string &strShaderFile
 static GLuint initialize_vertex_buffer()
 {
     GLuint bufferObject;
-    const float vertexData[] = {
-        // Triangle data:
-         0.0f,    0.5f, 0.0f, 1.0f, // (Vec4)
-         0.5f, -0.366f, 0.0f, 1.0f, // (Vec4)
-        -0.5f, -0.366f, 0.0f, 1.0f, // (Vec4)
-
-        // Color data:
-         1.0f,    0.0f, 0.0f, 1.0f, // (Vec4)
-         0.0f,    1.0f, 0.0f, 1.0f, // (Vec4)
-         0.0f,    0.0f, 1.0f, 1.0f, // (Vec4)
-    };
+    const float *vertexData = TriangleVertexData;
 
     // Tell OpenGL we want an object (identified by a GLuint)
     // [Buffer objects are linear arrays of memory allocated by OpenGL.
@@ -321,9 +1559,13 @@ static GLuint initialize_vertex_buffer()
     // to a location in the context, and glBufferData allocates memory and
     // fills this memory with data from the user into the buffer object.]
     glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(TriangleVertexData), vertexData, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    profiler_count(CounterBufferAllocations);
+    profiler_count(CounterUploads);
+    profiler_count(CounterUploadBytes, sizeof(TriangleVertexData));
+
     return bufferObject;
 }
 
@@ -331,22 +1573,80 @@ static GLuint initialize_vertex_buffer()
 // GLFW utilities
 //--------------------------------------------------------------
 
-static void window_size_callback(GLFWwindow* window, int width, int height)
+// Only records the size; the main loop sets the viewport and resizes
+// its targets once per frame with whatever size came in last
+static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    ResizePending = true;
+    PendingFramebufferWidth = width;
+    PendingFramebufferHeight = height;
+    ResizeEvents++;
+
+    damage_invalidate(DamageResize);
+}
+
+static void window_refresh_callback(GLFWwindow* window)
+{
+    // The window system lost (part of) our contents
+    damage_invalidate(DamageExpose);
+}
+
+static void window_focus_callback(GLFWwindow* window, int focused)
+{
+    throttle_set_focused(focused == GL_TRUE, glfwGetTime());
+}
+
+static void window_iconify_callback(GLFWwindow* window, int iconified)
 {
-    // [This function defines the current viewport transform. It defines as a
-    // region of the window, specified by the bottom-left position and a width/height.]
-    glViewport(0, 0, (GLsizei) width, (GLsizei) height);
+    throttle_set_iconified(iconified == GL_TRUE, glfwGetTime());
+
+    // Show the current scene as soon as the window comes back
+    if (!iconified)
+    {
+        damage_invalidate(DamageExpose);
+    }
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    damage_invalidate(DamageInput);
+
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
+
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+    {
+        overdraw_cycle_mode();
+    }
+
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    {
+        PulseAnimation = !PulseAnimation;
+        PulseValue = 0.0f;
+        NextPulseTime = 0.0;
+    }
+
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+    {
+        ScreenshotRequested = true;
+        damage_invalidate(DamageDebug);
+    }
 }
 
 static void error_callback(int error, const char* description)
 {
     cerr << description << endl;
 }
+
+static void save_screenshot(const ReadbackImage &image)
+{
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%llu.ppm", ScreenshotPrefix, (unsigned long long) image.tag);
+
+    if (write_ppm(filename, image.pixels, image.width, image.height))
+    {
+        cout << "Saved " << filename << endl;
+    }
+}
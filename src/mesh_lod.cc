@@ -0,0 +1,813 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// Border edges add a plane at right angles to their triangle, this
+// much heavier than the triangle's own, so the outline stays put
+const double BorderWeight = 10.0;
+
+// A collapse may not turn any triangle by more than about 45 degrees
+// (cosine), which also stops triangles folding over onto open borders
+const float MinNormalCosine = 0.7f;
+
+// A level must drop at least this share of the previous one's triangles
+const float MinLevelReduction = 0.25f;
+
+// Going coarser than last frame's level needs its error this far under the limit
+const float LodHysteresis = 0.75f;
+
+const char LodFileMagic[4] = { 'L', 'O', 'D', '1' };
+
+struct LodFileHeader
+{
+    char magic[4];
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t levelCount;
+    float radius;
+};
+
+//--------------------------------------------------------------
+// Quadrics
+//--------------------------------------------------------------
+
+// Sum of squared distances to a set of weighted planes: p'Ap + 2b.p + c
+struct Quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+static void add_plane(Quadric &q, double nx, double ny, double nz, double d, double weight)
+{
+    q.a00 += weight * nx * nx;
+    q.a01 += weight * nx * ny;
+    q.a02 += weight * nx * nz;
+    q.a11 += weight * ny * ny;
+    q.a12 += weight * ny * nz;
+    q.a22 += weight * nz * nz;
+    q.b0 += weight * nx * d;
+    q.b1 += weight * ny * d;
+    q.b2 += weight * nz * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void add_quadric(Quadric &q, const Quadric &other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// Weighted RMS distance from p to the planes, in object units
+static float quadric_distance(const Quadric &q, const Vec3 &p)
+{
+    if (q.weight <= 0.0)
+    {
+        return 0.0f;
+    }
+
+    double x = p.x, y = p.y, z = p.z;
+    double sum = x * (q.a00 * x + q.a01 * y + q.a02 * z) +
+                 y * (q.a01 * x + q.a11 * y + q.a12 * z) +
+                 z * (q.a02 * x + q.a12 * y + q.a22 * z) +
+                 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+    return (float) sqrt(max(sum, 0.0) / q.weight);
+}
+
+//--------------------------------------------------------------
+// Edge collapse
+//--------------------------------------------------------------
+
+// Collapses run on one copy of the index buffer, so a chain of levels
+// comes from a single pass and every error is measured against the
+// original planes
+class Simplifier
+{
+public:
+    Simplifier(const vector<Vec3> &positions, const vector<uint32_t> &indices);
+
+    // Returns the largest collapse error so far
+    float collapse_to(size_t targetTriangles, float maxError);
+
+    size_t triangle_count() const { return liveTriangles; }
+    void append_triangles(vector<uint32_t> &out) const;
+
+private:
+    // Moves vertex from onto vertex to; stale once either has changed
+    struct Collapse
+    {
+        float cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+        bool reversed;          // The cheaper way round was refused
+
+        // Cheapest on top of the heap
+        bool operator<(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    bool contains(uint32_t triangle, uint32_t vertex) const;
+    Collapse make_collapse(uint32_t from, uint32_t to, bool reversed) const;
+    void push_edge(uint32_t a, uint32_t b);
+    bool is_valid(const Collapse &collapse);
+    void apply(const Collapse &collapse);
+
+    const vector<Vec3> &positions;
+    vector<uint32_t> triangles;
+    vector<uint8_t> triangleAlive;
+    vector<vector<uint32_t> > vertexTriangles;
+    vector<Quadric> quadrics;
+    vector<uint32_t> versions;
+    vector<uint8_t> vertexAlive;
+    vector<uint32_t> marks;
+    uint32_t markStamp;
+    vector<Collapse> heap;
+    size_t liveTriangles;
+    float error;
+};
+
+Simplifier::Simplifier(const vector<Vec3> &positions, const vector<uint32_t> &indices)
+    : positions(positions), triangles(indices), triangleAlive(indices.size() / 3, 1),
+      vertexTriangles(positions.size()), versions(positions.size(), 0), vertexAlive(positions.size(), 1),
+      marks(positions.size(), 0), markStamp(0), liveTriangles(0), error(0.0f)
+{
+    Quadric zero;
+    memset(&zero, 0, sizeof(zero));
+    quadrics.assign(positions.size(), zero);
+
+    // Edges as (low vertex, high vertex, triangle), sorted so that border
+    // edges (one triangle) and the unique edge list come out together
+    struct Edge
+    {
+        uint64_t key;
+        uint32_t triangle;
+
+        bool operator<(const Edge &other) const { return key < other.key; }
+    };
+
+    vector<Edge> edges;
+    edges.reserve(triangles.size());
+
+    for (size_t t = 0; t < triangleAlive.size(); t++)
+    {
+        uint32_t v[3] = { triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2] };
+
+        if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2])
+        {
+            triangleAlive[t] = 0;
+            continue;
+        }
+
+        liveTriangles++;
+
+        Vec3 normal = cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+        float doubleArea = length(normal);
+
+        for (int i = 0; i < 3; i++)
+        {
+            vertexTriangles[v[i]].push_back((uint32_t) t);
+
+            uint32_t a = min(v[i], v[(i + 1) % 3]);
+            uint32_t b = max(v[i], v[(i + 1) % 3]);
+            Edge edge = { (uint64_t) a << 32 | b, (uint32_t) t };
+            edges.push_back(edge);
+        }
+
+        if (doubleArea > 0.0f)
+        {
+            Vec3 n = normal * (1.0f / doubleArea);
+            double d = -dot(n, positions[v[0]]);
+
+            for (int i = 0; i < 3; i++)
+            {
+                add_plane(quadrics[v[i]], n.x, n.y, n.z, d, doubleArea * 0.5);
+            }
+        }
+    }
+
+    sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t end = i + 1;
+
+        while (end < edges.size() && edges[end].key == edges[i].key)
+        {
+            end++;
+        }
+
+        uint32_t a = (uint32_t) (edges[i].key >> 32);
+        uint32_t b = (uint32_t) edges[i].key;
+
+        if (end - i == 1)
+        {
+            // Plane through the border edge, standing on its triangle
+            const uint32_t *v = &triangles[edges[i].triangle * 3];
+            Vec3 edge = positions[b] - positions[a];
+            Vec3 faceNormal = cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+            Vec3 n = normalize(cross(edge, faceNormal));
+
+            if (dot(n, n) > 0.0f)
+            {
+                double d = -dot(n, positions[a]);
+                double weight = BorderWeight * dot(edge, edge);
+                add_plane(quadrics[a], n.x, n.y, n.z, d, weight);
+                add_plane(quadrics[b], n.x, n.y, n.z, d, weight);
+            }
+        }
+
+        i = end;
+    }
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (i == 0 || edges[i].key != edges[i - 1].key)
+        {
+            uint32_t a = (uint32_t) (edges[i].key >> 32);
+            uint32_t b = (uint32_t) edges[i].key;
+            Collapse ab = make_collapse(a, b, false);
+            Collapse ba = make_collapse(b, a, false);
+            heap.push_back(ab.cost <= ba.cost ? ab : ba);
+        }
+    }
+
+    make_heap(heap.begin(), heap.end());
+}
+
+bool Simplifier::contains(uint32_t triangle, uint32_t vertex) const
+{
+    const uint32_t *v = &triangles[triangle * 3];
+    return v[0] == vertex || v[1] == vertex || v[2] == vertex;
+}
+
+Simplifier::Collapse Simplifier::make_collapse(uint32_t from, uint32_t to, bool reversed) const
+{
+    Quadric sum = quadrics[from];
+    add_quadric(sum, quadrics[to]);
+
+    Collapse collapse = { quadric_distance(sum, positions[to]), from, to, versions[from], versions[to], reversed };
+    return collapse;
+}
+
+// One entry per edge, the cheaper way round
+void Simplifier::push_edge(uint32_t a, uint32_t b)
+{
+    Collapse ab = make_collapse(a, b, false);
+    Collapse ba = make_collapse(b, a, false);
+    heap.push_back(ab.cost <= ba.cost ? ab : ba);
+    push_heap(heap.begin(), heap.end());
+}
+
+bool Simplifier::is_valid(const Collapse &collapse)
+{
+    uint32_t from = collapse.from;
+    uint32_t to = collapse.to;
+
+    // Neighbours of to get this stamp, common neighbours the next one
+    markStamp += 2;
+
+    for (size_t i = 0; i < vertexTriangles[to].size(); i++)
+    {
+        uint32_t t = vertexTriangles[to][i];
+        const uint32_t *v = &triangles[t * 3];
+
+        for (int k = 0; k < 3 && triangleAlive[t]; k++)
+        {
+            marks[v[k]] = markStamp;
+        }
+    }
+
+    int shared = 0;
+    int common = 0;
+
+    for (size_t i = 0; i < vertexTriangles[from].size(); i++)
+    {
+        uint32_t t = vertexTriangles[from][i];
+
+        if (!triangleAlive[t])
+        {
+            continue;
+        }
+
+        if (contains(t, to))
+        {
+            shared++;
+            continue;
+        }
+
+        const uint32_t *v = &triangles[t * 3];
+        Vec3 before[3], after[3];
+
+        for (int k = 0; k < 3; k++)
+        {
+            before[k] = positions[v[k]];
+            after[k] = v[k] == from ? positions[to] : before[k];
+
+            if (v[k] != from && marks[v[k]] == markStamp)
+            {
+                marks[v[k]] = markStamp + 1;
+                common++;
+            }
+        }
+
+        Vec3 oldNormal = cross(before[1] - before[0], before[2] - before[0]);
+        Vec3 newNormal = cross(after[1] - after[0], after[2] - after[0]);
+
+        if (dot(oldNormal, newNormal) <= MinNormalCosine * length(oldNormal) * length(newNormal))
+        {
+            return false;
+        }
+    }
+
+    // Each triangle on the edge has one opposite vertex; any other
+    // vertex next to both ends would be pinched into a non-manifold edge
+    return shared > 0 && common <= shared;
+}
+
+void Simplifier::apply(const Collapse &collapse)
+{
+    uint32_t from = collapse.from;
+    uint32_t to = collapse.to;
+
+    add_quadric(quadrics[to], quadrics[from]);
+    vertexAlive[from] = 0;
+    versions[to]++;
+
+    vector<uint32_t> &target = vertexTriangles[to];
+
+    for (size_t i = 0; i < vertexTriangles[from].size(); i++)
+    {
+        uint32_t t = vertexTriangles[from][i];
+
+        if (!triangleAlive[t])
+        {
+            continue;
+        }
+
+        if (contains(t, to))
+        {
+            triangleAlive[t] = 0;
+            liveTriangles--;
+            continue;
+        }
+
+        uint32_t *v = &triangles[t * 3];
+
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = v[k] == from ? to : v[k];
+        }
+
+        target.push_back(t);
+    }
+
+    vector<uint32_t>().swap(vertexTriangles[from]);
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < target.size(); i++)
+    {
+        if (triangleAlive[target[i]])
+        {
+            target[kept++] = target[i];
+        }
+    }
+
+    target.resize(kept);
+
+    // Every edge out of to now has a new cost
+    markStamp += 2;
+    marks[to] = markStamp;
+
+    for (size_t i = 0; i < target.size(); i++)
+    {
+        const uint32_t *v = &triangles[target[i] * 3];
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (marks[v[k]] != markStamp)
+            {
+                marks[v[k]] = markStamp;
+                push_edge(to, v[k]);
+            }
+        }
+    }
+}
+
+float Simplifier::collapse_to(size_t targetTriangles, float maxError)
+{
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        Collapse collapse = heap.front();
+
+        if (!vertexAlive[collapse.from] || !vertexAlive[collapse.to] ||
+            versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion)
+        {
+            pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+            continue;
+        }
+
+        if (collapse.cost > maxError)
+        {
+            break;
+        }
+
+        pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+
+        if (is_valid(collapse))
+        {
+            apply(collapse);
+            error = max(error, collapse.cost);
+        }
+        else if (!collapse.reversed)
+        {
+            heap.push_back(make_collapse(collapse.to, collapse.from, true));
+            push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    return error;
+}
+
+void Simplifier::append_triangles(vector<uint32_t> &out) const
+{
+    for (size_t t = 0; t < triangleAlive.size(); t++)
+    {
+        if (triangleAlive[t])
+        {
+            out.insert(out.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// Level chains
+//--------------------------------------------------------------
+
+static bool check_mesh(const vector<Vec3> &positions, const vector<uint32_t> &indices)
+{
+    if (indices.empty() || indices.size() % 3 != 0 || positions.size() > 0xffffffffu)
+    {
+        cerr << "A mesh needs whole triangles, got " << indices.size() << " indices" << endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (indices[i] >= positions.size())
+        {
+            cerr << "Index " << indices[i] << " out of range for " << positions.size() << " vertices" << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static float bounding_radius(const vector<Vec3> &positions)
+{
+    Vec3 lower = positions[0], upper = positions[0];
+
+    for (size_t i = 1; i < positions.size(); i++)
+    {
+        lower = Vec3(min(lower.x, positions[i].x), min(lower.y, positions[i].y), min(lower.z, positions[i].z));
+        upper = Vec3(max(upper.x, positions[i].x), max(upper.y, positions[i].y), max(upper.z, positions[i].z));
+    }
+
+    Vec3 center = (lower + upper) * 0.5f;
+    float radius = 0.0f;
+
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        radius = max(radius, length(positions[i] - center));
+    }
+
+    return radius;
+}
+
+bool build_lod_chain(const vector<Vec3> &positions, const vector<uint32_t> &indices, LodMesh &out,
+                     size_t minTriangles, float maxError)
+{
+    if (!check_mesh(positions, indices))
+    {
+        return false;
+    }
+
+    out.positions = positions;
+    out.indices = indices;
+    memset(&out.table, 0, sizeof(out.table));
+    out.table.radius = bounding_radius(positions);
+
+    LodLevel full = { 0, (uint32_t) indices.size(), 0.0f };
+    out.table.levels[0] = full;
+    out.table.levelCount = 1;
+
+    Simplifier simplifier(positions, indices);
+    size_t triangles = indices.size() / 3;
+    float errorLimit = maxError * out.table.radius;
+
+    while (out.table.levelCount < (uint32_t) MaxLodLevels && triangles > minTriangles)
+    {
+        float error = simplifier.collapse_to(max(triangles / 2, minTriangles), errorLimit);
+        size_t reached = simplifier.triangle_count();
+
+        if (reached > triangles * (1.0f - MinLevelReduction))
+        {
+            break;
+        }
+
+        LodLevel level = { (uint32_t) out.indices.size(), (uint32_t) reached * 3, error };
+        out.table.levels[out.table.levelCount++] = level;
+        simplifier.append_triangles(out.indices);
+        triangles = reached;
+    }
+
+    return true;
+}
+
+float simplify_mesh(const vector<Vec3> &positions, const vector<uint32_t> &indices,
+                    size_t targetIndexCount, float maxError, vector<uint32_t> &out)
+{
+    out.clear();
+
+    if (!check_mesh(positions, indices))
+    {
+        return 0.0f;
+    }
+
+    Simplifier simplifier(positions, indices);
+    float error = simplifier.collapse_to(targetIndexCount / 3, maxError);
+    simplifier.append_triangles(out);
+
+    return error;
+}
+
+//--------------------------------------------------------------
+// Selection
+//--------------------------------------------------------------
+
+float lod_pixel_scale(const Mat4 &projection, int viewportHeight)
+{
+    // The viewport spans 2 in NDC, and y lands at m[5] * y / distance
+    return projection.m[5] * viewportHeight * 0.5f;
+}
+
+int select_lod(const LodTable &table, float pixelScale, float distance, int currentLevel, float pixelError)
+{
+    float scale = pixelScale / max(distance, 1e-6f);
+    int level = 0;
+
+    for (int l = 1; l < (int) table.levelCount; l++)
+    {
+        float limit = currentLevel >= 0 && l > currentLevel ? pixelError * LodHysteresis : pixelError;
+
+        if (table.levels[l].error * scale > limit)
+        {
+            break;
+        }
+
+        level = l;
+    }
+
+    return level;
+}
+
+//--------------------------------------------------------------
+// Files
+//--------------------------------------------------------------
+
+bool load_obj(const string &filename, vector<Vec3> &positions, vector<uint32_t> &indices)
+{
+    ifstream in(filename.c_str());
+
+    if (!in)
+    {
+        cerr << "Could not open " << filename << endl;
+        return false;
+    }
+
+    positions.clear();
+    indices.clear();
+
+    string line;
+    vector<uint32_t> face;
+
+    for (int lineNumber = 1; getline(in, line); lineNumber++)
+    {
+        istringstream words(line);
+        string type;
+        words >> type;
+
+        if (type == "v")
+        {
+            Vec3 p;
+
+            if (!(words >> p.x >> p.y >> p.z))
+            {
+                cerr << filename << ":" << lineNumber << ": bad vertex" << endl;
+                return false;
+            }
+
+            positions.push_back(p);
+        }
+        else if (type == "f")
+        {
+            face.clear();
+            string corner;
+
+            // v, v/vt, v//vn or v/vt/vn; negative indices count back from the last vertex
+            while (words >> corner)
+            {
+                long index = strtol(corner.c_str(), NULL, 10);
+                long resolved = index < 0 ? (long) positions.size() + index : index - 1;
+
+                if (index == 0 || resolved < 0 || resolved >= (long) positions.size())
+                {
+                    cerr << filename << ":" << lineNumber << ": bad face index " << corner << endl;
+                    return false;
+                }
+
+                face.push_back((uint32_t) resolved);
+            }
+
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                indices.push_back(face[0]);
+                indices.push_back(face[i - 1]);
+                indices.push_back(face[i]);
+            }
+        }
+    }
+
+    if (indices.empty())
+    {
+        cerr << filename << " has no faces" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool write_lod_mesh(const string &filename, const LodMesh &mesh)
+{
+    FILE *out = fopen(filename.c_str(), "wb");
+
+    if (!out)
+    {
+        cerr << "Could not open " << filename << " for writing" << endl;
+        return false;
+    }
+
+    LodFileHeader header;
+    memcpy(header.magic, LodFileMagic, sizeof(header.magic));
+    header.vertexCount = (uint32_t) mesh.positions.size();
+    header.indexCount = (uint32_t) mesh.indices.size();
+    header.levelCount = mesh.table.levelCount;
+    header.radius = mesh.table.radius;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(mesh.table.levels, sizeof(LodLevel), header.levelCount, out) == header.levelCount &&
+              fwrite(&mesh.positions[0], sizeof(Vec3), header.vertexCount, out) == header.vertexCount &&
+              fwrite(&mesh.indices[0], sizeof(uint32_t), header.indexCount, out) == header.indexCount;
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok)
+    {
+        cerr << "Could not write " << filename << endl;
+    }
+
+    return ok;
+}
+
+bool read_lod_mesh(const string &filename, LodMesh &mesh)
+{
+    FILE *in = fopen(filename.c_str(), "rb");
+
+    if (!in)
+    {
+        cerr << "Could not open " << filename << endl;
+        return false;
+    }
+
+    LodFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 &&
+              memcmp(header.magic, LodFileMagic, sizeof(header.magic)) == 0 &&
+              header.levelCount >= 1 && header.levelCount <= (uint32_t) MaxLodLevels &&
+              header.vertexCount > 0 && header.indexCount > 0;
+
+    // The counts of a damaged header could ask for gigabytes; the
+    // data they describe has to be in the file before anything is
+    // allocated for it
+    if (ok)
+    {
+        long dataStart = ftell(in);
+        ok = dataStart >= 0 && fseek(in, 0, SEEK_END) == 0;
+
+        long fileSize = ok ? ftell(in) : -1;
+        uint64_t needed = (uint64_t) header.levelCount * sizeof(LodLevel) +
+                          (uint64_t) header.vertexCount * sizeof(Vec3) +
+                          (uint64_t) header.indexCount * sizeof(uint32_t);
+
+        ok = ok && fileSize >= dataStart && (uint64_t) (fileSize - dataStart) >= needed &&
+             fseek(in, dataStart, SEEK_SET) == 0;
+    }
+
+    if (ok)
+    {
+        memset(&mesh.table, 0, sizeof(mesh.table));
+        mesh.table.levelCount = header.levelCount;
+        mesh.table.radius = header.radius;
+        mesh.positions.resize(header.vertexCount);
+        mesh.indices.resize(header.indexCount);
+
+        ok = fread(mesh.table.levels, sizeof(LodLevel), header.levelCount, in) == header.levelCount &&
+             fread(&mesh.positions[0], sizeof(Vec3), header.vertexCount, in) == header.vertexCount &&
+             fread(&mesh.indices[0], sizeof(uint32_t), header.indexCount, in) == header.indexCount;
+    }
+
+    fclose(in);
+
+    // A damaged file must not send draws outside the buffers
+    for (uint32_t l = 0; ok && l < mesh.table.levelCount; l++)
+    {
+        const LodLevel &level = mesh.table.levels[l];
+        ok = level.indexCount % 3 == 0 && level.firstIndex <= header.indexCount &&
+             level.indexCount <= header.indexCount - level.firstIndex;
+    }
+
+    for (size_t i = 0; ok && i < mesh.indices.size(); i++)
+    {
+        ok = mesh.indices[i] < mesh.positions.size();
+    }
+
+    if (!ok)
+    {
+        cerr << "Could not read " << filename << " as a LOD mesh" << endl;
+    }
+
+    return ok;
+}
+
+bool convert_obj_to_lod(const string &source, const string &target, ostream &report)
+{
+    vector<Vec3> positions;
+    vector<uint32_t> indices;
+    LodMesh mesh;
+
+    if (!load_obj(source, positions, indices))
+    {
+        return false;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    if (!build_lod_chain(positions, indices, mesh) || !write_lod_mesh(target, mesh))
+    {
+        return false;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    report << source << ": " << positions.size() << " vertices, " << mesh.table.levelCount << " levels in "
+           << seconds * 1000.0 << " ms, radius " << mesh.table.radius << endl;
+
+    for (uint32_t l = 0; l < mesh.table.levelCount; l++)
+    {
+        const LodLevel &level = mesh.table.levels[l];
+        report << "  level " << l << ": " << level.indexCount / 3 << " triangles, error " << level.error
+               << " (" << level.error / mesh.table.radius * 100.0f << "% of the radius)" << endl;
+    }
+
+    report << "Wrote " << target << endl;
+    return true;
+}
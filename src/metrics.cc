@@ -0,0 +1,411 @@
+#include "metrics.h"
+#include "opengl.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Shared memory layout
+//--------------------------------------------------------------
+
+struct MetricsRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t slotSize;
+    atomic<uint64_t> writeIndex;
+};
+
+struct MetricsSlot
+{
+    atomic<uint64_t> sequence;
+    FrameMetrics data;
+};
+
+// The ring is read by other processes, so the atomics must not
+// need a lock that only exists in this address space
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "metrics ring needs lock-free 64-bit atomics");
+
+// How many recent frames the socket endpoint averages over
+const uint32_t MetricsAverageFrames = 60;
+
+//--------------------------------------------------------------
+// State
+//--------------------------------------------------------------
+
+static MetricsRingHeader *Ring = NULL;
+static MetricsSlot *Slots = NULL;
+static size_t RingBytes = 0;
+static string SharedMemoryName;
+static bool SharedMemoryMapped = false;
+
+static int ListenSocket = -1;
+static string SocketPath;
+static thread ServerThread;
+static atomic<bool> ServerRunning(false);
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static string expand_pid(const string &pattern)
+{
+    size_t pos = pattern.find("%d");
+
+    if (pos == string::npos)
+    {
+        return pattern;
+    }
+
+    ostringstream out;
+    out << pattern.substr(0, pos) << getpid() << pattern.substr(pos + 2);
+
+    return out.str();
+}
+
+// Consistent copy of one slot, false if it was being rewritten
+static bool read_slot(uint64_t index, FrameMetrics &out)
+{
+    MetricsSlot &slot = Slots[index % Ring->capacity];
+
+    uint64_t before = slot.sequence.load(memory_order_acquire);
+    memcpy(&out, &slot.data, sizeof(out));
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after = slot.sequence.load(memory_order_relaxed);
+
+    return before == after && (before & 1) == 0 && before == (index + 1) * 2;
+}
+
+static bool map_ring(const MetricsConfig &config)
+{
+    SharedMemoryName = expand_pid(config.sharedMemoryName);
+    RingBytes = sizeof(MetricsRingHeader) + sizeof(MetricsSlot) * config.capacity;
+
+    void *memory = NULL;
+
+    if (!SharedMemoryName.empty())
+    {
+        int fd = shm_open(SharedMemoryName.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+        if (fd < 0 || ftruncate(fd, RingBytes) != 0)
+        {
+            cerr << "Could not create metrics shared memory " << SharedMemoryName << endl;
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return false;
+        }
+
+        memory = mmap(NULL, RingBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        SharedMemoryMapped = true;
+    }
+    else
+    {
+        // Socket-only export still needs somewhere to keep the frames
+        memory = mmap(NULL, RingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (memory == MAP_FAILED)
+    {
+        cerr << "Could not map metrics ring" << endl;
+        return false;
+    }
+
+    // Fresh mappings are zero filled, so only the header needs setting
+    Ring = new (memory) MetricsRingHeader;
+    Ring->magic = MetricsRingMagic;
+    Ring->version = MetricsRingVersion;
+    Ring->capacity = config.capacity;
+    Ring->slotSize = sizeof(MetricsSlot);
+    Ring->writeIndex.store(0, memory_order_relaxed);
+
+    Slots = reinterpret_cast<MetricsSlot *>(Ring + 1);
+
+    return true;
+}
+
+static string format_prometheus()
+{
+    uint64_t written = Ring->writeIndex.load(memory_order_acquire);
+    uint64_t count = min<uint64_t>(written, min(MetricsAverageFrames, Ring->capacity - 1));
+
+    FrameMetrics latest;
+    memset(&latest, 0, sizeof(latest));
+    latest.gpuTime = -1.0;
+    latest.gpuMemoryFreeKb = -1;
+
+    double frameTimeSum = 0.0, gpuTimeSum = 0.0, frameTimeMax = 0.0;
+    uint64_t samples = 0, gpuSamples = 0;
+    bool haveLatest = false;
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        FrameMetrics frame;
+
+        if (!read_slot(written - 1 - i, frame))
+        {
+            continue;
+        }
+
+        if (!haveLatest)
+        {
+            latest = frame;
+            haveLatest = true;
+        }
+
+        frameTimeSum += frame.frameTime;
+        frameTimeMax = max(frameTimeMax, frame.frameTime);
+        samples++;
+
+        if (frame.gpuTime >= 0.0)
+        {
+            gpuTimeSum += frame.gpuTime;
+            gpuSamples++;
+        }
+    }
+
+    ostringstream out;
+
+    out << "# TYPE glfw_spike_frames_total counter\n"
+        << "glfw_spike_frames_total " << written << "\n"
+        << "# TYPE glfw_spike_frame_time_seconds gauge\n"
+        << "glfw_spike_frame_time_seconds " << latest.frameTime << "\n"
+        << "# TYPE glfw_spike_frame_time_avg_seconds gauge\n"
+        << "glfw_spike_frame_time_avg_seconds " << (samples ? frameTimeSum / samples : 0.0) << "\n"
+        << "# TYPE glfw_spike_frame_time_max_seconds gauge\n"
+        << "glfw_spike_frame_time_max_seconds " << frameTimeMax << "\n"
+        << "# TYPE glfw_spike_draw_calls gauge\n"
+        << "glfw_spike_draw_calls " << latest.drawCalls << "\n"
+        << "# TYPE glfw_spike_upload_bytes gauge\n"
+        << "glfw_spike_upload_bytes " << latest.uploadBytes << "\n"
+        << "# TYPE glfw_spike_upload_bytes_total counter\n"
+        << "glfw_spike_upload_bytes_total " << latest.uploadBytesTotal << "\n";
+
+    if (gpuSamples > 0)
+    {
+        out << "# TYPE glfw_spike_gpu_time_avg_seconds gauge\n"
+            << "glfw_spike_gpu_time_avg_seconds " << gpuTimeSum / gpuSamples << "\n";
+    }
+
+    if (latest.gpuMemoryFreeKb >= 0)
+    {
+        out << "# TYPE glfw_spike_gpu_memory_free_bytes gauge\n"
+            << "glfw_spike_gpu_memory_free_bytes " << latest.gpuMemoryFreeKb * 1024 << "\n";
+    }
+
+    return out.str();
+}
+
+static void write_all(int fd, const string &data)
+{
+    size_t sent = 0;
+
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+        if (n <= 0)
+        {
+            return;
+        }
+
+        sent += n;
+    }
+}
+
+// Answers every connection with one HTTP/1.0 response so both curl
+// and a Prometheus scraper pointed at the socket work
+static void serve_metrics()
+{
+    while (ServerRunning.load())
+    {
+        pollfd listening = { ListenSocket, POLLIN, 0 };
+
+        if (poll(&listening, 1, 250) <= 0)
+        {
+            continue;
+        }
+
+        int client = accept(ListenSocket, NULL, NULL);
+
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // Drain the request line; its contents do not matter
+        pollfd request = { client, POLLIN, 0 };
+        if (poll(&request, 1, 100) > 0)
+        {
+            char buffer[1024];
+            if (recv(client, buffer, sizeof(buffer), 0) < 0)
+            {
+                close(client);
+                continue;
+            }
+        }
+
+        string body = format_prometheus();
+        ostringstream response;
+        response << "HTTP/1.0 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4\r\n"
+                 << "Content-Length: " << body.size() << "\r\n\r\n"
+                 << body;
+
+        write_all(client, response.str());
+        close(client);
+    }
+}
+
+static bool start_server(const MetricsConfig &config)
+{
+    SocketPath = expand_pid(config.socketPath);
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (SocketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Metrics socket path too long: " << SocketPath << endl;
+        return false;
+    }
+
+    strncpy(address.sun_path, SocketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(SocketPath.c_str());
+
+    ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (ListenSocket < 0
+        || bind(ListenSocket, (sockaddr *) &address, sizeof(address)) != 0
+        || listen(ListenSocket, 4) != 0)
+    {
+        cerr << "Could not listen on metrics socket " << SocketPath << endl;
+        if (ListenSocket >= 0)
+        {
+            close(ListenSocket);
+            ListenSocket = -1;
+        }
+        return false;
+    }
+
+    ServerRunning.store(true);
+    ServerThread = thread(serve_metrics);
+
+    return true;
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+bool metrics_initialize(const MetricsConfig &config)
+{
+    if (config.capacity < 2 || (config.sharedMemoryName.empty() && config.socketPath.empty()))
+    {
+        return false;
+    }
+
+    if (!map_ring(config))
+    {
+        return false;
+    }
+
+    if (!config.socketPath.empty())
+    {
+        start_server(config);
+    }
+
+    return true;
+}
+
+void metrics_shutdown()
+{
+    if (ServerRunning.load())
+    {
+        ServerRunning.store(false);
+        ServerThread.join();
+    }
+
+    if (ListenSocket >= 0)
+    {
+        close(ListenSocket);
+        unlink(SocketPath.c_str());
+        ListenSocket = -1;
+    }
+
+    if (Ring)
+    {
+        munmap(Ring, RingBytes);
+        Ring = NULL;
+        Slots = NULL;
+    }
+
+    if (SharedMemoryMapped)
+    {
+        shm_unlink(SharedMemoryName.c_str());
+        SharedMemoryMapped = false;
+    }
+}
+
+void metrics_publish(const FrameMetrics &metrics)
+{
+    if (!Ring)
+    {
+        return;
+    }
+
+    // Single writer, so a relaxed load of our own index is enough
+    uint64_t index = Ring->writeIndex.load(memory_order_relaxed);
+    MetricsSlot &slot = Slots[index % Ring->capacity];
+
+    slot.sequence.store(index * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot.data = metrics;
+
+    slot.sequence.store(index * 2 + 2, memory_order_release);
+    Ring->writeIndex.store(index + 1, memory_order_release);
+}
+
+int64_t metrics_query_gpu_memory_kb()
+{
+    static int source = -1;
+
+    if (source < 0)
+    {
+        source = glfwExtensionSupported("GL_NVX_gpu_memory_info") ? 1
+            : glfwExtensionSupported("GL_ATI_meminfo") ? 2 : 0;
+    }
+
+    GLint values[4] = { -1, -1, -1, -1 };
+
+    if (source == 1)
+    {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, values);
+    }
+    else if (source == 2)
+    {
+        // First value is the total free memory in the pool
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, values);
+    }
+
+    return values[0];
+}
@@ -0,0 +1,549 @@
+#include "occlusion_cull.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// Tile edges are multiples of the SIMD width
+const int TileWidth = 64;
+const int TileHeight = 16;
+
+// Clip w below which a point counts as at or behind the eye; points
+// in front of the near plane (clip z < -w) are rejected too, since
+// the GPU clips those away and their window depth would be below 0
+const float NearW = 1e-4f;
+
+// Candidates per parallel test task
+const size_t OcclusionChunkSize = 4096;
+
+//--------------------------------------------------------------
+// Setup
+//--------------------------------------------------------------
+
+OcclusionCuller::OcclusionCuller(int width, int height, WorkerPool *pool)
+    : pool(pool)
+{
+    tilesX = max(1, (width + TileWidth - 1) / TileWidth);
+    tilesY = max(1, (height + TileHeight - 1) / TileHeight);
+    bufferWidth = tilesX * TileWidth;
+    bufferHeight = tilesY * TileHeight;
+    tileTriangles.resize(tilesX * tilesY);
+
+    // Halve down to a single texel
+    int levelWidth = bufferWidth;
+    int levelHeight = bufferHeight;
+
+    while (true)
+    {
+        levels.push_back(vector<float>(levelWidth * levelHeight, 1.0f));
+        levelWidths.push_back(levelWidth);
+        levelHeights.push_back(levelHeight);
+
+        if (levelWidth == 1 && levelHeight == 1)
+        {
+            break;
+        }
+
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+
+    memset(&totals, 0, sizeof(totals));
+}
+
+void OcclusionCuller::begin_frame(const Mat4 &viewProjection)
+{
+    this->viewProjection = viewProjection;
+    triangles.clear();
+
+    for (size_t t = 0; t < tileTriangles.size(); t++)
+    {
+        tileTriangles[t].clear();
+    }
+
+    fill(levels[0].begin(), levels[0].end(), 1.0f);
+    totals.frames++;
+}
+
+void OcclusionCuller::add_occluder(const Vec3 *vertices, const uint32_t *indices, size_t indexCount, const Mat4 &world)
+{
+    Mat4 transform = viewProjection * world;
+    float halfWidth = 0.5f * bufferWidth;
+    float halfHeight = 0.5f * bufferHeight;
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        float x[3], y[3], z[3];
+        bool crossesNear = false;
+
+        for (int v = 0; v < 3; v++)
+        {
+            Vec4 clip = transform * Vec4(vertices[indices[i + v]].x, vertices[indices[i + v]].y,
+                                         vertices[indices[i + v]].z, 1.0f);
+
+            if (clip.w <= NearW || clip.z < -clip.w)
+            {
+                crossesNear = true;
+                break;
+            }
+
+            float inverseW = 1.0f / clip.w;
+            x[v] = (clip.x * inverseW + 1.0f) * halfWidth;
+            y[v] = (clip.y * inverseW + 1.0f) * halfHeight;
+            z[v] = clip.z * inverseW * 0.5f + 0.5f;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+        // Back faces, and triangles no sample could land in
+        if (crossesNear || !(area > 0.0f))
+        {
+            continue;
+        }
+
+        ScreenTriangle triangle;
+        triangle.minX = max(0, (int) ceil(min(x[0], min(x[1], x[2])) - 0.5f));
+        triangle.minY = max(0, (int) ceil(min(y[0], min(y[1], y[2])) - 0.5f));
+        triangle.maxX = min(bufferWidth - 1, (int) floor(max(x[0], max(x[1], x[2])) - 0.5f));
+        triangle.maxY = min(bufferHeight - 1, (int) floor(max(y[0], max(y[1], y[2])) - 0.5f));
+
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        {
+            continue;
+        }
+
+        for (int e = 0; e < 3; e++)
+        {
+            int next = (e + 1) % 3;
+            triangle.edgeA[e] = y[e] - y[next];
+            triangle.edgeB[e] = x[next] - x[e];
+            triangle.edgeC[e] = x[e] * y[next] - x[next] * y[e];
+        }
+
+        triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        triangle.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+        uint32_t index = (uint32_t) triangles.size();
+        triangles.push_back(triangle);
+
+        for (int ty = triangle.minY / TileHeight; ty <= triangle.maxY / TileHeight; ty++)
+        {
+            for (int tx = triangle.minX / TileWidth; tx <= triangle.maxX / TileWidth; tx++)
+            {
+                tileTriangles[ty * tilesX + tx].push_back(index);
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// Rasterization
+//--------------------------------------------------------------
+
+void OcclusionCuller::rasterize()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int tiles = tilesX * tilesY;
+
+    if (pool)
+    {
+        pool->run(tiles, [this](size_t tile) { rasterize_tile((int) tile); });
+    }
+    else
+    {
+        for (int tile = 0; tile < tiles; tile++)
+        {
+            rasterize_tile(tile);
+        }
+    }
+
+    build_pyramid();
+
+    totals.triangles += triangles.size();
+    totals.rasterSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::rasterize_tile(int tile)
+{
+    int tileX0 = (tile % tilesX) * TileWidth;
+    int tileY0 = (tile / tilesX) * TileHeight;
+    float *depth = &levels[0][0];
+    const vector<uint32_t> &list = tileTriangles[tile];
+
+    for (size_t t = 0; t < list.size(); t++)
+    {
+        const ScreenTriangle &tri = triangles[list[t]];
+
+        // Whole SIMD groups; the edge functions reject the extra pixels
+        int x0 = max(tri.minX, tileX0) & ~3;
+        int x1 = min(tri.maxX, tileX0 + TileWidth - 1);
+        int y0 = max(tri.minY, tileY0);
+        int y1 = min(tri.maxY, tileY0 + TileHeight - 1);
+
+#if defined(VECMATH_SSE)
+        __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 zero = _mm_setzero_ps();
+        __m128 a0 = _mm_set1_ps(tri.edgeA[0]);
+        __m128 a1 = _mm_set1_ps(tri.edgeA[1]);
+        __m128 a2 = _mm_set1_ps(tri.edgeA[2]);
+        __m128 depthA = _mm_set1_ps(tri.depthA);
+
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            __m128 row0 = _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]);
+            __m128 row1 = _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]);
+            __m128 row2 = _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]);
+            __m128 rowDepth = _mm_set1_ps(tri.depthB * py + tri.depthC);
+            float *line = depth + y * bufferWidth;
+
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float) x), offsets);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero),
+                                                      _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero)),
+                                           _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+
+                if (!_mm_movemask_ps(inside))
+                {
+                    continue;
+                }
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+                __m128 old = _mm_load_ps(line + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_store_ps(line + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            float row[3] = { tri.edgeB[0] * py + tri.edgeC[0], tri.edgeB[1] * py + tri.edgeC[1],
+                             tri.edgeB[2] * py + tri.edgeC[2] };
+            float rowDepth = tri.depthB * py + tri.depthC;
+            float *line = depth + y * bufferWidth;
+
+            for (int x = x0; x <= (x1 | 3); x++)
+            {
+                float px = x + 0.5f;
+
+                if (tri.edgeA[0] * px + row[0] >= 0.0f && tri.edgeA[1] * px + row[1] >= 0.0f &&
+                    tri.edgeA[2] * px + row[2] >= 0.0f)
+                {
+                    line[x] = min(line[x], tri.depthA * px + rowDepth);
+                }
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::rasterize_reference(vector<float> &depth) const
+{
+    depth.assign(bufferWidth * bufferHeight, 1.0f);
+
+    for (size_t t = 0; t < triangles.size(); t++)
+    {
+        const ScreenTriangle &tri = triangles[t];
+
+        for (int y = tri.minY; y <= tri.maxY; y++)
+        {
+            for (int x = tri.minX; x <= tri.maxX; x++)
+            {
+                float px = x + 0.5f;
+                float py = y + 0.5f;
+                bool inside = true;
+
+                for (int e = 0; e < 3; e++)
+                {
+                    inside = inside && tri.edgeA[e] * px + (tri.edgeB[e] * py + tri.edgeC[e]) >= 0.0f;
+                }
+
+                if (inside)
+                {
+                    float z = tri.depthA * px + (tri.depthB * py + tri.depthC);
+                    depth[y * bufferWidth + x] = min(depth[y * bufferWidth + x], z);
+                }
+            }
+        }
+    }
+}
+
+// Each texel keeps the farthest depth of the 2x2 below it
+void OcclusionCuller::build_pyramid()
+{
+    for (size_t level = 1; level < levels.size(); level++)
+    {
+        const vector<float> &below = levels[level - 1];
+        vector<float> &above = levels[level];
+        int belowWidth = levelWidths[level - 1];
+        int belowHeight = levelHeights[level - 1];
+
+        for (int y = 0; y < levelHeights[level]; y++)
+        {
+            int y0 = 2 * y;
+            int y1 = min(y0 + 1, belowHeight - 1);
+
+            for (int x = 0; x < levelWidths[level]; x++)
+            {
+                int x0 = 2 * x;
+                int x1 = min(x0 + 1, belowWidth - 1);
+
+                above[y * levelWidths[level] + x] = max(max(below[y0 * belowWidth + x0], below[y0 * belowWidth + x1]),
+                                                        max(below[y1 * belowWidth + x0], below[y1 * belowWidth + x1]));
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// Object tests
+//--------------------------------------------------------------
+
+// Pixel containing coordinate v, kept within one pixel of [0, size);
+// clamped first so truncation can stand in for floor
+static inline int pixel_floor(float v, int size)
+{
+    return (int) (min(max(v, -1.0f), (float) size) + 1.0f) - 1;
+}
+
+bool OcclusionCuller::project_box(const Vec3 &center, const Vec3 &extents, int rect[4], float &nearestDepth) const
+{
+    // Corners as the center plus signed columns of the matrix
+    const float *m = viewProjection.m;
+    Vec4 base = viewProjection * Vec4(center.x, center.y, center.z, 1.0f);
+    Vec4 axisX = Vec4(m[0], m[1], m[2], m[3]) * extents.x;
+    Vec4 axisY = Vec4(m[4], m[5], m[6], m[7]) * extents.y;
+    Vec4 axisZ = Vec4(m[8], m[9], m[10], m[11]) * extents.z;
+
+    float minX, minY, maxX, maxY;
+
+#if defined(VECMATH_SSE)
+    // The eight corners as two groups of four, one component per register
+    __m128 signX = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+    __m128 signY = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+    __m128 clip[4][2];
+    const float baseValues[4] = { base.x, base.y, base.z, base.w };
+    const float xValues[4] = { axisX.x, axisX.y, axisX.z, axisX.w };
+    const float yValues[4] = { axisY.x, axisY.y, axisY.z, axisY.w };
+    const float zValues[4] = { axisZ.x, axisZ.y, axisZ.z, axisZ.w };
+
+    for (int c = 0; c < 4; c++)
+    {
+        __m128 planar = _mm_add_ps(_mm_add_ps(_mm_set1_ps(baseValues[c]), _mm_mul_ps(signX, _mm_set1_ps(xValues[c]))),
+                                   _mm_mul_ps(signY, _mm_set1_ps(yValues[c])));
+        clip[c][0] = _mm_sub_ps(planar, _mm_set1_ps(zValues[c]));
+        clip[c][1] = _mm_add_ps(planar, _mm_set1_ps(zValues[c]));
+    }
+
+    __m128 nearW = _mm_set1_ps(NearW);
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 behind0 = _mm_or_ps(_mm_cmple_ps(clip[3][0], nearW), _mm_cmplt_ps(clip[2][0], _mm_xor_ps(clip[3][0], signMask)));
+    __m128 behind1 = _mm_or_ps(_mm_cmple_ps(clip[3][1], nearW), _mm_cmplt_ps(clip[2][1], _mm_xor_ps(clip[3][1], signMask)));
+
+    if (_mm_movemask_ps(_mm_or_ps(behind0, behind1)))
+    {
+        return false;
+    }
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 inverseW0 = _mm_div_ps(one, clip[3][0]);
+    __m128 inverseW1 = _mm_div_ps(one, clip[3][1]);
+    __m128 x0 = _mm_mul_ps(clip[0][0], inverseW0), x1 = _mm_mul_ps(clip[0][1], inverseW1);
+    __m128 y0 = _mm_mul_ps(clip[1][0], inverseW0), y1 = _mm_mul_ps(clip[1][1], inverseW1);
+    __m128 z0 = _mm_mul_ps(clip[2][0], inverseW0), z1 = _mm_mul_ps(clip[2][1], inverseW1);
+
+    // Horizontal minimum and maximum over the eight lanes
+    __m128 lows = _mm_min_ps(_mm_unpacklo_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+                             _mm_unpackhi_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)));
+    __m128 highs = _mm_max_ps(_mm_unpacklo_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+                              _mm_unpackhi_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)));
+    __m128 depths = _mm_min_ps(z0, z1);
+    depths = _mm_min_ps(depths, _mm_movehl_ps(depths, depths));
+    depths = _mm_min_ss(depths, _mm_shuffle_ps(depths, depths, 1));
+    depths = _mm_add_ss(_mm_mul_ss(depths, half), half);
+
+    float low[4], high[4];
+    _mm_storeu_ps(low, lows);
+    _mm_storeu_ps(high, highs);
+    minX = min(low[0], low[2]);
+    minY = min(low[1], low[3]);
+    maxX = max(high[0], high[2]);
+    maxY = max(high[1], high[3]);
+    nearestDepth = min(1.0f, _mm_cvtss_f32(depths));
+#else
+    minX = minY = 1e30f;
+    maxX = maxY = -1e30f;
+    nearestDepth = 1.0f;
+
+    for (int corner = 0; corner < 8; corner++)
+    {
+        Vec4 clip = base + (corner & 1 ? axisX : axisX * -1.0f) + (corner & 2 ? axisY : axisY * -1.0f) +
+                    (corner & 4 ? axisZ : axisZ * -1.0f);
+
+        if (clip.w <= NearW || clip.z < -clip.w)
+        {
+            return false;
+        }
+
+        float inverseW = 1.0f / clip.w;
+        float x = clip.x * inverseW;
+        float y = clip.y * inverseW;
+        minX = min(minX, x);
+        maxX = max(maxX, x);
+        minY = min(minY, y);
+        maxY = max(maxY, y);
+        nearestDepth = min(nearestDepth, clip.z * inverseW * 0.5f + 0.5f);
+    }
+#endif
+
+    // Every pixel the rectangle touches, not just the covered centers
+    rect[0] = pixel_floor((minX + 1.0f) * 0.5f * bufferWidth, bufferWidth);
+    rect[1] = pixel_floor((minY + 1.0f) * 0.5f * bufferHeight, bufferHeight);
+    rect[2] = pixel_floor((maxX + 1.0f) * 0.5f * bufferWidth, bufferWidth);
+    rect[3] = pixel_floor((maxY + 1.0f) * 0.5f * bufferHeight, bufferHeight);
+    rect[0] = max(rect[0], 0);
+    rect[1] = max(rect[1], 0);
+    rect[2] = min(rect[2], bufferWidth - 1);
+    rect[3] = min(rect[3], bufferHeight - 1);
+
+    // Off screen is for frustum culling to decide
+    return rect[0] <= rect[2] && rect[1] <= rect[3];
+}
+
+bool OcclusionCuller::is_visible(const Vec3 &center, const Vec3 &extents) const
+{
+    int rect[4];
+    float nearestDepth;
+
+    if (!project_box(center, extents, rect, nearestDepth))
+    {
+        return true;
+    }
+
+    // The finest level where the rectangle spans at most 2x2 texels
+    int level = 0;
+
+    while (level + 1 < (int) levels.size() &&
+           ((rect[2] >> level) - (rect[0] >> level) > 1 || (rect[3] >> level) - (rect[1] >> level) > 1))
+    {
+        level++;
+    }
+
+    const vector<float> &texels = levels[level];
+    int levelWidth = levelWidths[level];
+
+    for (int y = rect[1] >> level; y <= rect[3] >> level; y++)
+    {
+        for (int x = rect[0] >> level; x <= rect[2] >> level; x++)
+        {
+            if (nearestDepth <= texels[y * levelWidth + x])
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool OcclusionCuller::is_visible_reference(const vector<float> &depth, const Vec3 &center, const Vec3 &extents) const
+{
+    int rect[4];
+    float nearestDepth;
+
+    if (!project_box(center, extents, rect, nearestDepth))
+    {
+        return true;
+    }
+
+    for (int y = rect[1]; y <= rect[3]; y++)
+    {
+        for (int x = rect[0]; x <= rect[2]; x++)
+        {
+            if (nearestDepth <= depth[y * bufferWidth + x])
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void OcclusionCuller::cull(const CullBounds &bounds, const vector<uint32_t> &candidates, vector<uint32_t> &visible)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t count = candidates.size();
+    size_t chunks = (count + OcclusionChunkSize - 1) / OcclusionChunkSize;
+
+    if (chunkVisible.size() < chunks)
+    {
+        chunkVisible.resize(chunks);
+    }
+
+    auto test_chunk = [this, &bounds, &candidates, count](size_t chunk)
+    {
+        vector<uint32_t> &out = chunkVisible[chunk];
+        out.clear();
+
+        for (size_t i = chunk * OcclusionChunkSize; i < min((chunk + 1) * OcclusionChunkSize, count); i++)
+        {
+            uint32_t object = candidates[i];
+            Vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+            Vec3 extents(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+
+            if (is_visible(center, extents))
+            {
+                out.push_back(object);
+            }
+        }
+    };
+
+    if (pool && chunks > 1)
+    {
+        pool->run(chunks, test_chunk);
+    }
+    else
+    {
+        for (size_t c = 0; c < chunks; c++)
+        {
+            test_chunk(c);
+        }
+    }
+
+    visible.clear();
+
+    for (size_t c = 0; c < chunks; c++)
+    {
+        visible.insert(visible.end(), chunkVisible[c].begin(), chunkVisible[c].end());
+    }
+
+    totals.tested += count;
+    totals.occluded += count - visible.size();
+    totals.testSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionCuller::report(ostream &out) const
+{
+    if (!totals.frames)
+    {
+        return;
+    }
+
+    out << "Occlusion culling (" << bufferWidth << "x" << bufferHeight << "): "
+        << totals.triangles / totals.frames << " occluder triangles, " << totals.tested / totals.frames
+        << " objects tested, " << totals.occluded / totals.frames << " occluded per frame, "
+        << totals.rasterSeconds * 1000.0 / totals.frames << " ms raster, "
+        << totals.testSeconds * 1000.0 / totals.frames << " ms testing" << endl;
+}
@@ -0,0 +1,396 @@
+#include "occlusion_queries.h"
+#include "shader_utils.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+const char* BoundsVertexShaderFilename = "shaders/vertex/bounds.glsl";
+const char* BoundsFragmentShaderFilename = "shaders/fragment/bounds.glsl";
+
+// Frames between queries once a result has held for a while. Hidden
+// objects are skipped until their next query, so they wait less.
+const int MaxVisibleInterval = 8;
+const int MaxHiddenInterval = 4;
+
+// Query objects in flight are capped so a driver that never returns
+// results cannot grow the pool without bound; objects that find none
+// free are simply drawn
+const size_t MaxQueriesInFlight = 16384;
+
+// Frames of box-pass timestamps kept in flight
+const int TimestampLatency = 4;
+
+// Shared with any caller drawing objects through bounds.glsl
+const GLfloat UnitCubeVertices[UnitCubeVertexCount * 3] = {
+    -1.0f, -1.0f, -1.0f,    1.0f, -1.0f, -1.0f,    1.0f, 1.0f, -1.0f,    -1.0f, 1.0f, -1.0f,
+    -1.0f, -1.0f, 1.0f,     1.0f, -1.0f, 1.0f,     1.0f, 1.0f, 1.0f,     -1.0f, 1.0f, 1.0f,
+};
+
+const GLubyte UnitCubeIndices[UnitCubeIndexCount] = {
+    0, 3, 2, 0, 2, 1,       // -z
+    4, 5, 6, 4, 6, 7,       // +z
+    0, 4, 7, 0, 7, 3,       // -x
+    1, 2, 6, 1, 6, 5,       // +x
+    0, 1, 5, 0, 5, 4,       // -y
+    3, 7, 6, 3, 6, 2,       // +y
+};
+
+//--------------------------------------------------------------
+// Occlusion queries
+//--------------------------------------------------------------
+
+OcclusionQueries::OcclusionQueries()
+    : program(0), viewProjectionLocation(-1), centerLocation(-1), extentsLocation(-1), vertexArray(0),
+      nearDistance(0.0f), frame(0), timestampsAvailable(false), timestampRing(TimestampLatency)
+{
+    buffers[0] = buffers[1] = 0;
+    memset(&totals, 0, sizeof(totals));
+
+    for (size_t i = 0; i < timestampRing.size(); i++)
+    {
+        timestampRing[i].pending = false;
+    }
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        freeQueries.push_back(pending[i].query);
+    }
+
+    if (!freeQueries.empty())
+    {
+        glDeleteQueries((GLsizei) freeQueries.size(), &freeQueries[0]);
+    }
+
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(2, buffers);
+
+        if (timestampsAvailable)
+        {
+            for (size_t i = 0; i < timestampRing.size(); i++)
+            {
+                glDeleteQueries(2, timestampRing[i].queries);
+            }
+        }
+    }
+}
+
+bool OcclusionQueries::initialize()
+{
+    program = create_program_from_files(BoundsVertexShaderFilename, BoundsFragmentShaderFilename);
+
+    if (!program)
+    {
+        cerr << "Could not build the occlusion query bounds program" << endl;
+        return false;
+    }
+
+    viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+    centerLocation = glGetUniformLocation(program, "center");
+    extentsLocation = glGetUniformLocation(program, "extents");
+
+    glGenVertexArrays(1, &vertexArray);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(UnitCubeVertices), UnitCubeVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(UnitCubeIndices), UnitCubeIndices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    timestampsAvailable = glfwExtensionSupported("GL_ARB_timer_query") == GL_TRUE;
+
+    if (timestampsAvailable)
+    {
+        for (size_t i = 0; i < timestampRing.size(); i++)
+        {
+            glGenQueries(2, timestampRing[i].queries);
+        }
+    }
+
+    return true;
+}
+
+void OcclusionQueries::begin_frame(const Mat4 &viewProjection, const Vec3 &eye, float nearDistance)
+{
+    this->viewProjection = viewProjection;
+    this->eye = eye;
+    this->nearDistance = nearDistance;
+    frame++;
+    totals.frames++;
+
+    collect_results();
+    collect_timestamps();
+}
+
+bool OcclusionQueries::acquire_query(GLuint &query)
+{
+    if (!freeQueries.empty())
+    {
+        query = freeQueries.back();
+        freeQueries.pop_back();
+        return true;
+    }
+
+    if (pending.size() >= MaxQueriesInFlight)
+    {
+        return false;
+    }
+
+    glGenQueries(1, &query);
+    return true;
+}
+
+// A box around the eye may be clipped away entirely by the near plane
+bool OcclusionQueries::contains_eye(const CullBounds &bounds, uint32_t object) const
+{
+    float margin = 2.0f * nearDistance;
+
+    return fabs(eye.x - bounds.centerX[object]) <= bounds.extentX[object] + margin &&
+           fabs(eye.y - bounds.centerY[object]) <= bounds.extentY[object] + margin &&
+           fabs(eye.z - bounds.centerZ[object]) <= bounds.extentZ[object] + margin;
+}
+
+void OcclusionQueries::draw(const CullBounds &bounds, const vector<uint32_t> &objects,
+                            const function<void(uint32_t)> &drawObject)
+{
+    ProfileScope zone("occlusion queries");
+
+    if (states.size() < bounds.size())
+    {
+        ObjectState fresh = { 0, 0, false, false, 0 };
+        states.resize(bounds.size(), fresh);
+    }
+
+    hiddenDue.clear();
+    totals.objects += objects.size();
+
+    // Objects that may be visible first, so they occlude the boxes
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        uint32_t object = objects[i];
+        ObjectState &state = states[object];
+        bool due = !state.known || frame >= state.nextQueryFrame;
+
+        if (contains_eye(bounds, object))
+        {
+            drawObject(object);
+            totals.drawn++;
+            continue;
+        }
+
+        if (state.known && !state.visible)
+        {
+            if (due)
+            {
+                hiddenDue.push_back(object);
+            }
+            else
+            {
+                totals.skipped++;
+            }
+
+            continue;
+        }
+
+        GLuint query;
+
+        if (due && acquire_query(query))
+        {
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+            drawObject(object);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+            PendingQuery issued = { query, object, frame, false };
+            pending.push_back(issued);
+            totals.drawQueries++;
+        }
+        else
+        {
+            drawObject(object);
+        }
+
+        totals.drawn++;
+    }
+
+    if (hiddenDue.empty())
+    {
+        return;
+    }
+
+    // Boxes of the hidden objects, in one state block
+    TimestampPair &timestamps = timestampRing[frame % timestampRing.size()];
+    bool timed = timestampsAvailable && !timestamps.pending;
+
+    if (timed)
+    {
+        glQueryCounter(timestamps.queries[0], GL_TIMESTAMP);
+    }
+
+    glUseProgram(program);
+    glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, viewProjection.m);
+    glBindVertexArray(vertexArray);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    hiddenQueries.resize(hiddenDue.size());
+
+    for (size_t i = 0; i < hiddenDue.size(); i++)
+    {
+        uint32_t object = hiddenDue[i];
+
+        if (!acquire_query(hiddenQueries[i]))
+        {
+            hiddenQueries[i] = 0;
+            continue;
+        }
+
+        glUniform3f(centerLocation, bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+        glUniform3f(extentsLocation, bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, hiddenQueries[i]);
+        glDrawElements(GL_TRIANGLES, UnitCubeIndexCount, GL_UNSIGNED_BYTE, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        PendingQuery issued = { hiddenQueries[i], object, frame, true };
+        pending.push_back(issued);
+        totals.boxQueries++;
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glBindVertexArray(0);
+
+    if (timed)
+    {
+        glQueryCounter(timestamps.queries[1], GL_TIMESTAMP);
+        timestamps.pending = true;
+    }
+
+    // The GPU drops each draw whose box showed no samples
+    for (size_t i = 0; i < hiddenDue.size(); i++)
+    {
+        if (hiddenQueries[i])
+        {
+            glBeginConditionalRender(hiddenQueries[i], GL_QUERY_NO_WAIT);
+            drawObject(hiddenDue[i]);
+            glEndConditionalRender();
+            totals.conditional++;
+        }
+        else
+        {
+            drawObject(hiddenDue[i]);
+            totals.drawn++;
+        }
+    }
+}
+
+void OcclusionQueries::collect_results()
+{
+    size_t done = 0;
+
+    // Queries complete in order: stop at the first one still running
+    for (; done < pending.size(); done++)
+    {
+        const PendingQuery &query = pending[done];
+        GLint available = 0;
+        glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            break;
+        }
+
+        GLuint passed = 0;
+        glGetQueryObjectuiv(query.query, GL_QUERY_RESULT, &passed);
+        freeQueries.push_back(query.query);
+
+        if (query.box && !passed)
+        {
+            totals.discarded++;
+        }
+
+        ObjectState &state = states[query.object];
+
+        if (query.frame < state.resultFrame)
+        {
+            continue;
+        }
+
+        bool visible = passed != 0;
+        state.stableResults = state.known && state.visible == visible ? state.stableResults + 1 : 0;
+        state.visible = visible;
+        state.known = true;
+        state.resultFrame = query.frame;
+
+        int interval = visible ? min(MaxVisibleInterval, 1 + state.stableResults)
+                               : min(MaxHiddenInterval, 1 + state.stableResults / 2);
+        state.nextQueryFrame = frame + interval - 1;
+    }
+
+    pending.erase(pending.begin(), pending.begin() + done);
+}
+
+void OcclusionQueries::collect_timestamps()
+{
+    for (size_t i = 0; i < timestampRing.size(); i++)
+    {
+        TimestampPair &timestamps = timestampRing[i];
+        GLint available = 0;
+
+        if (!timestamps.pending)
+        {
+            continue;
+        }
+
+        glGetQueryObjectiv(timestamps.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            continue;
+        }
+
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(timestamps.queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(timestamps.queries[1], GL_QUERY_RESULT, &end);
+        totals.boxGpuSeconds += (end - start) * 1e-9;
+        totals.boxGpuSamples++;
+        timestamps.pending = false;
+    }
+}
+
+void OcclusionQueries::report(ostream &out) const
+{
+    if (!totals.objects)
+    {
+        return;
+    }
+
+    out << "Occlusion queries over " << totals.frames << " frames: " << totals.objects << " objects, " << totals.drawn << " drawn, "
+        << totals.skipped << " skipped as hidden, " << totals.conditional << " conditional ("
+        << totals.discarded << " discarded by the GPU)" << endl
+        << "  " << totals.drawQueries << " queries on draws, " << totals.boxQueries << " bounding boxes drawn";
+
+    if (totals.boxGpuSamples)
+    {
+        out << ", " << totals.boxGpuSeconds * 1000.0 / totals.boxGpuSamples << " ms GPU per box pass";
+    }
+
+    out << endl;
+}
@@ -0,0 +1,287 @@
+#include "options.h"
+#include "frame_pacer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// An export pattern goes to snprintf with the frame number, so it may
+// hold exactly one %d (optionally %0Nd) and no other conversion but %%
+static bool is_frame_pattern(const string &pattern)
+{
+    int frameConversions = 0;
+
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] != '%')
+        {
+            continue;
+        }
+
+        i++;
+
+        if (i < pattern.size() && pattern[i] == '%')
+        {
+            continue;
+        }
+
+        if (i < pattern.size() && pattern[i] == '0')
+        {
+            i++;
+        }
+
+        while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9')
+        {
+            i++;
+        }
+
+        if (i >= pattern.size() || pattern[i] != 'd')
+        {
+            return false;
+        }
+
+        frameConversions++;
+    }
+
+    return frameConversions == 1;
+}
+
+static void print_usage(const char *program)
+{
+    cerr << "Usage: " << program << " [options]" << endl
+         << "  --size WxH            window or output size" << endl
+         << "  --continuous          redraw every frame even when nothing changed" << endl
+         << "  --background-fps N    frame cap while the window is unfocused (default 10," << endl
+         << "                        0 for none)" << endl
+         << "  --fps N               pace frames to N per second (default: no limit)" << endl
+         << "  --swap MODE           swap interval: default, off, vsync or adaptive" << endl
+         << "  --dynamic-resolution MS  lower the render resolution to hold MS of GPU" << endl
+         << "                        time per frame (default: off)" << endl
+         << "  --post LIST           post-processing passes in order, e.g. fxaa,tonemap" << endl
+         << "                        (tonemap, vignette, fxaa, blur)" << endl
+         << "  --export N            render N frames headlessly and write them out" << endl
+         << "  --format png|ppm|raw  export image format (default png)" << endl
+         << "  --output PATTERN      export file pattern, e.g. out/frame_%05d.png," << endl
+         << "                        or - to write raw frames to stdout" << endl
+         << "  --threads N           encoder threads (default: one per core)" << endl
+         << "  --png-level N         PNG zlib compression level 0-9 (default 1)" << endl
+         << "  --tiled WxH           render one WxH PPM image in tiles to --output" << endl
+         << "  --tile-size N         tile edge in pixels (default: largest supported)" << endl
+         << "  --golden-check DIR    compare canonical scenes with the images in DIR" << endl
+         << "  --golden-update DIR   store the canonical scenes in DIR as new goldens" << endl
+         << "  --golden-tolerance N  per-channel difference accepted (default 2)" << endl
+         << "  --occlusion-queries N draw N frames of a box grid offscreen with and" << endl
+         << "                        without GPU occlusion queries and compare" << endl
+         << "  --bench LIST          check and time CPU kernels (math, transforms," << endl
+         << "                        cull, bvh, occlusion, lod, diff, or all) and exit" << endl
+         << "  --lod FILE.obj        build the mesh's level-of-detail chain into --output" << endl
+         << "                        (default FILE.lod) and exit" << endl;
+}
+
+bool parse_options(int argc, char **argv, ProgramOptions &options)
+{
+    options.width = 0;
+    options.height = 0;
+    options.continuous = false;
+    options.backgroundFrameRate = 10.0;
+    options.targetFrameRate = 0.0;
+    options.swapMode = "default";
+    options.dynamicResolutionTarget = 0.0;
+    options.postPasses = "";
+    options.exportFrames = 0;
+    options.exportFormat = "png";
+    options.exportPath = "";
+    options.exportThreads = 0;
+    options.pngCompression = 1;
+    options.tiledWidth = 0;
+    options.tiledHeight = 0;
+    options.tileSize = 0;
+    options.goldenDirectory = "";
+    options.goldenUpdate = false;
+    options.goldenTolerance = 2;
+    options.occlusionFrames = 0;
+    options.benchmarks = "";
+    options.lodSource = "";
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (arg == "--size" && value && sscanf(value, "%dx%d", &options.width, &options.height) == 2)
+        {
+            i++;
+        }
+        else if (arg == "--continuous")
+        {
+            options.continuous = true;
+        }
+        else if (arg == "--background-fps" && value)
+        {
+            options.backgroundFrameRate = atof(value);
+            i++;
+        }
+        else if (arg == "--fps" && value)
+        {
+            options.targetFrameRate = atof(value);
+            i++;
+        }
+        else if (arg == "--swap" && value)
+        {
+            options.swapMode = value;
+            i++;
+        }
+        else if (arg == "--dynamic-resolution" && value)
+        {
+            options.dynamicResolutionTarget = atof(value) / 1000.0;
+            i++;
+        }
+        else if (arg == "--post" && value)
+        {
+            options.postPasses = value;
+            i++;
+        }
+        else if (arg == "--export" && value)
+        {
+            options.exportFrames = atoi(value);
+            i++;
+        }
+        else if (arg == "--format" && value)
+        {
+            options.exportFormat = value;
+            i++;
+        }
+        else if (arg == "--output" && value)
+        {
+            options.exportPath = value;
+            i++;
+        }
+        else if (arg == "--threads" && value)
+        {
+            options.exportThreads = atoi(value);
+            i++;
+        }
+        else if (arg == "--png-level" && value)
+        {
+            options.pngCompression = atoi(value);
+            i++;
+        }
+        else if (arg == "--tiled" && value && sscanf(value, "%dx%d", &options.tiledWidth, &options.tiledHeight) == 2)
+        {
+            i++;
+        }
+        else if (arg == "--tile-size" && value)
+        {
+            options.tileSize = atoi(value);
+            i++;
+        }
+        else if ((arg == "--golden-check" || arg == "--golden-update") && value)
+        {
+            options.goldenDirectory = value;
+            options.goldenUpdate = arg == "--golden-update";
+            i++;
+        }
+        else if (arg == "--golden-tolerance" && value)
+        {
+            options.goldenTolerance = atoi(value);
+            i++;
+        }
+        else if (arg == "--occlusion-queries" && value)
+        {
+            options.occlusionFrames = atoi(value);
+            i++;
+        }
+        else if (arg == "--bench" && value)
+        {
+            options.benchmarks = value;
+            i++;
+        }
+        else if (arg == "--lod" && value)
+        {
+            options.lodSource = value;
+            i++;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.width < 0 || options.height < 0)
+    {
+        cerr << "Invalid size " << options.width << "x" << options.height << endl;
+        return false;
+    }
+
+    if (options.backgroundFrameRate < 0.0)
+    {
+        cerr << "Invalid background frame rate " << options.backgroundFrameRate << endl;
+        return false;
+    }
+
+    SwapMode swapMode;
+
+    if (options.targetFrameRate < 0.0 || !parse_swap_mode(options.swapMode, swapMode))
+    {
+        cerr << "Invalid frame pacing " << options.targetFrameRate << " fps, swap " << options.swapMode << endl;
+        return false;
+    }
+
+    if (options.dynamicResolutionTarget < 0.0)
+    {
+        cerr << "Invalid dynamic resolution target " << options.dynamicResolutionTarget * 1000.0 << " ms" << endl;
+        return false;
+    }
+
+    if (options.exportFormat != "png" && options.exportFormat != "ppm" && options.exportFormat != "raw")
+    {
+        cerr << "Unknown export format " << options.exportFormat << endl;
+        return false;
+    }
+
+    if (options.pngCompression < 0 || options.pngCompression > 9)
+    {
+        cerr << "Invalid PNG compression level " << options.pngCompression << ", expected 0-9" << endl;
+        return false;
+    }
+
+    if (options.occlusionFrames < 0)
+    {
+        cerr << "Invalid occlusion query frame count " << options.occlusionFrames << endl;
+        return false;
+    }
+
+    if (options.tiledWidth < 0 || options.tiledHeight < 0)
+    {
+        cerr << "Invalid tiled size " << options.tiledWidth << "x" << options.tiledHeight << endl;
+        return false;
+    }
+
+    if (options.exportPath.empty() && !options.lodSource.empty())
+    {
+        size_t dot = options.lodSource.find_last_of('.');
+        size_t slash = options.lodSource.find_last_of("/\\");
+        bool extension = dot != string::npos && (slash == string::npos || dot > slash);
+        options.exportPath = options.lodSource.substr(0, extension ? dot : string::npos) + ".lod";
+    }
+    else if (options.exportPath.empty() && options.tiledWidth > 0)
+    {
+        options.exportPath = "poster.ppm";
+    }
+    else if (options.exportPath.empty())
+    {
+        options.exportPath = options.exportFormat == "raw" ? "-" : "frame_%05d." + options.exportFormat;
+    }
+
+    if (options.exportFrames > 0 && options.exportPath != "-" && !is_frame_pattern(options.exportPath))
+    {
+        cerr << "Invalid output pattern " << options.exportPath << ", it needs one %d for the frame number" << endl;
+        return false;
+    }
+
+    return true;
+}
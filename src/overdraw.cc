@@ -0,0 +1,267 @@
+#include "overdraw.h"
+#include "shader_utils.h"
+
+#include <cctype>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+const char* OverdrawFragmentShaderFilename = "shaders/fragment/overdraw.glsl";
+const char* FullscreenVertexShaderFilename = "shaders/vertex/fullscreen.glsl";
+const char* HeatmapFragmentShaderFilename = "shaders/fragment/heatmap.glsl";
+
+// Overdraw at which the heatmap saturates to white
+const float HeatmapMaxOverdraw = 8.0f;
+
+//--------------------------------------------------------------
+// State
+//--------------------------------------------------------------
+
+struct OverdrawProgram
+{
+    GLuint original;
+    GLuint counting;
+    GLint weightLocation;
+    float cost;
+};
+
+static OverdrawMode Mode = OverdrawOff;
+static bool Available = false;          // Heatmap program built
+static vector<OverdrawProgram> Programs;
+static float MaxProgramCost = 1.0f;
+
+static GLuint HeatmapProgram = 0;
+static GLint HeatmapMaxValueLocation = -1;
+static GLint HeatmapScaleLocation = -1;
+static GLuint FullscreenVertexArray = 0;
+
+// Half float keeps additive blending supported everywhere while
+// counting far beyond 8-bit precision
+static ResizableTarget CountTarget(RenderTargetDesc(0, 0, GL_R16F, false, GL_NEAREST));
+static bool FrameActive = false;
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static void apply_mode_weights()
+{
+    for (size_t i = 0; i < Programs.size(); i++)
+    {
+        float weight = Mode == OverdrawCost ? Programs[i].cost : 1.0f;
+
+        glUseProgram(Programs[i].counting);
+        glUniform1f(Programs[i].weightLocation, weight);
+    }
+
+    glUseProgram(0);
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+bool overdraw_initialize()
+{
+    HeatmapProgram = create_program_from_files(FullscreenVertexShaderFilename, HeatmapFragmentShaderFilename);
+
+    if (!HeatmapProgram)
+    {
+        cerr << "Could not build the overdraw heatmap program, overdraw visualization is off" << endl;
+        return false;
+    }
+
+    HeatmapMaxValueLocation = glGetUniformLocation(HeatmapProgram, "maxValue");
+    HeatmapScaleLocation = glGetUniformLocation(HeatmapProgram, "scale");
+
+    glUseProgram(HeatmapProgram);
+    glUniform1i(glGetUniformLocation(HeatmapProgram, "overdraw"), 0);
+    glUseProgram(0);
+
+    glGenVertexArrays(1, &FullscreenVertexArray);
+    Available = true;
+
+    return true;
+}
+
+void overdraw_shutdown()
+{
+    for (size_t i = 0; i < Programs.size(); i++)
+    {
+        glDeleteProgram(Programs[i].counting);
+    }
+    Programs.clear();
+
+    glDeleteProgram(HeatmapProgram);
+    glDeleteVertexArrays(1, &FullscreenVertexArray);
+    CountTarget.destroy();
+    Available = false;
+    Mode = OverdrawOff;
+}
+
+void overdraw_register_program(GLuint program, const std::string &vertexFilename, const std::string &fragmentFilename)
+{
+    if (!Available)
+    {
+        return;
+    }
+
+    OverdrawProgram entry;
+    entry.original = program;
+    entry.counting = create_program_from_files(vertexFilename, OverdrawFragmentShaderFilename);
+    entry.weightLocation = glGetUniformLocation(entry.counting, "weight");
+    entry.cost = estimate_shader_cost(load_shader_from_file(fragmentFilename));
+
+    MaxProgramCost = max(MaxProgramCost, entry.cost);
+    Programs.push_back(entry);
+
+    apply_mode_weights();
+}
+
+void overdraw_cycle_mode()
+{
+    static const char *ModeNames[OverdrawModeCount] = { "off", "overdraw", "shader cost" };
+
+    if (!Available)
+    {
+        cout << "Overdraw visualization unavailable" << endl;
+        return;
+    }
+
+    Mode = (OverdrawMode) ((Mode + 1) % OverdrawModeCount);
+    apply_mode_weights();
+
+    cout << "Overdraw visualization: " << ModeNames[Mode] << endl;
+}
+
+OverdrawMode overdraw_mode()
+{
+    return Mode;
+}
+
+GLuint overdraw_substitute(GLuint program)
+{
+    if (!FrameActive)
+    {
+        return program;
+    }
+
+    for (size_t i = 0; i < Programs.size(); i++)
+    {
+        if (Programs[i].original == program)
+        {
+            return Programs[i].counting;
+        }
+    }
+
+    return program;
+}
+
+void overdraw_begin_frame(int width, int height)
+{
+    if (Mode == OverdrawOff || width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    CountTarget.resize(width, height);
+
+    if (!CountTarget.target())
+    {
+        return;
+    }
+
+    CountTarget.bind();
+
+    // Every fragment adds its weight on top of what is there
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    FrameActive = true;
+}
+
+void overdraw_end_frame()
+{
+    if (!FrameActive)
+    {
+        return;
+    }
+
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    float maxValue = HeatmapMaxOverdraw * (Mode == OverdrawCost ? MaxProgramCost : 1.0f);
+
+    glUseProgram(HeatmapProgram);
+    glUniform1f(HeatmapMaxValueLocation, maxValue);
+    glUniform2f(HeatmapScaleLocation, CountTarget.scale_x(), CountTarget.scale_y());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, CountTarget.target()->colorTexture);
+    glBindVertexArray(FullscreenVertexArray);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    FrameActive = false;
+}
+
+// Counts arithmetic operators and function/constructor calls in the
+// shader body. Texture fetches are weighted higher since they cost
+// far more than an ALU op. Only meant to rank programs relative to
+// each other, not to predict actual cycle counts.
+float estimate_shader_cost(const std::string &source)
+{
+    float cost = 1.0f;
+    size_t body = source.find("main");
+
+    if (body == string::npos)
+    {
+        return cost;
+    }
+
+    bool inComment = false;
+
+    for (size_t i = source.find('{', body); i != string::npos && i < source.size(); i++)
+    {
+        char c = source[i];
+
+        if (inComment)
+        {
+            inComment = c != '\n';
+            continue;
+        }
+
+        if (c == '/' && i + 1 < source.size() && source[i + 1] == '/')
+        {
+            inComment = true;
+            continue;
+        }
+
+        if (c == '+' || c == '-' || c == '*' || c == '/')
+        {
+            cost += 1.0f;
+        }
+        else if (c == '(' && i > 0 && (isalnum((unsigned char) source[i - 1]) || source[i - 1] == '_'))
+        {
+            size_t start = i;
+            while (start > 0 && (isalnum((unsigned char) source[start - 1]) || source[start - 1] == '_'))
+            {
+                start--;
+            }
+
+            string name = source.substr(start, i - start);
+            cost += name.compare(0, 7, "texture") == 0 ? 4.0f : 1.0f;
+        }
+    }
+
+    return cost;
+}
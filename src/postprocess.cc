@@ -0,0 +1,272 @@
+#include "postprocess.h"
+#include "shader_utils.h"
+#include "profiler.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Pass table
+//--------------------------------------------------------------
+
+struct PostPassInfo
+{
+    const char *name;
+    const char *filename;
+    bool pointwise;
+};
+
+// A name may expand to several passes (the separable blur)
+const PostPassInfo PostPasses[] = {
+    { "tonemap", "shaders/post/tonemap.glsl", true },
+    { "vignette", "shaders/post/vignette.glsl", true },
+    { "fxaa", "shaders/post/fxaa.glsl", false },
+    { "blur", "shaders/post/blur_h.glsl", false },
+    { "blur", "shaders/post/blur_v.glsl", false },
+};
+
+const char* PostVertexShaderFilename = "shaders/vertex/fullscreen.glsl";
+
+// Shared by every stage: the input, which part of it is used, one
+// input pixel in uv units, and a fetch() that stays inside the image
+const char* PostStageHeader =
+    "#version 330\n"
+    "\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 scale;\n"
+    "uniform vec2 texelSize;\n"
+    "\n"
+    "smooth in vec2 texCoord;\n"
+    "\n"
+    "out vec4 outputColor;\n"
+    "\n"
+    "vec4 fetch(vec2 uv)\n"
+    "{\n"
+    "    return texture(source, clamp(uv, 0.5f * texelSize, 1.0f - 0.5f * texelSize) * scale);\n"
+    "}\n";
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static string rename_pass(string source, const string &function)
+{
+    size_t position = 0;
+
+    while ((position = source.find("PASS(", position)) != string::npos)
+    {
+        source.replace(position, 4, function);
+        position += function.size();
+    }
+
+    return source;
+}
+
+// One stage's fragment shader: the snippets of its passes, then a
+// main() feeding each pass's result to the next
+static string stage_source(const vector<const PostPassInfo *> &passes)
+{
+    ostringstream body;
+    ostringstream calls;
+
+    body << PostStageHeader;
+
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        ostringstream function;
+        function << "pass" << i;
+
+        body << "\n" << rename_pass(load_shader_from_file(passes[i]->filename), function.str());
+
+        if (passes[i]->pointwise)
+        {
+            if (i == 0)
+            {
+                calls << "    vec4 color = fetch(texCoord);\n";
+            }
+
+            calls << "    color = " << function.str() << "(color, texCoord);\n";
+        }
+        else
+        {
+            calls << "    vec4 color = " << function.str() << "(texCoord);\n";
+        }
+    }
+
+    body << "\nvoid main()\n{\n" << calls.str() << "    outputColor = color;\n}\n";
+
+    return body.str();
+}
+
+//--------------------------------------------------------------
+// Post chain
+//--------------------------------------------------------------
+
+PostChain::PostChain()
+    : passCount(0), vertexArray(0)
+{
+}
+
+PostChain::~PostChain()
+{
+    clear();
+
+    if (vertexArray)
+    {
+        glDeleteVertexArrays(1, &vertexArray);
+    }
+}
+
+void PostChain::clear()
+{
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        glDeleteProgram(stages[i].program);
+    }
+
+    stages.clear();
+    passCount = 0;
+}
+
+bool PostChain::build(const vector<string> &passNames)
+{
+    clear();
+
+    vector<const PostPassInfo *> passes;
+
+    for (size_t i = 0; i < passNames.size(); i++)
+    {
+        size_t before = passes.size();
+
+        for (size_t p = 0; p < sizeof(PostPasses) / sizeof(PostPasses[0]); p++)
+        {
+            if (passNames[i] == PostPasses[p].name)
+            {
+                passes.push_back(&PostPasses[p]);
+            }
+        }
+
+        if (passes.size() == before)
+        {
+            cerr << "Unknown post-processing pass " << passNames[i] << endl;
+            return false;
+        }
+    }
+
+    passCount = passes.size();
+
+    if (!vertexArray)
+    {
+        glGenVertexArrays(1, &vertexArray);
+    }
+
+    GLuint vertexShader = create_shader(GL_VERTEX_SHADER, load_shader_from_file(PostVertexShaderFilename));
+    size_t first = 0;
+
+    while (first < passes.size())
+    {
+        // A sampling pass needs the finished previous result, so it
+        // starts a stage; pointwise passes join the current one
+        size_t last = first + 1;
+
+        while (last < passes.size() && passes[last]->pointwise)
+        {
+            last++;
+        }
+
+        vector<const PostPassInfo *> merged(passes.begin() + first, passes.begin() + last);
+
+        Stage stage;
+        stage.name = "post";
+
+        for (size_t i = 0; i < merged.size(); i++)
+        {
+            stage.name += (i == 0 ? ":" : "+") + string(merged[i]->name);
+        }
+
+        vector<GLuint> shaderList;
+        shaderList.push_back(vertexShader);
+        shaderList.push_back(create_shader(GL_FRAGMENT_SHADER, stage_source(merged)));
+
+        stage.program = create_shader_program(shaderList);
+        glDeleteShader(shaderList[1]);
+
+        if (!stage.program)
+        {
+            cerr << "Could not build post-processing stage " << stage.name << endl;
+            glDeleteShader(vertexShader);
+            return false;
+        }
+
+        stage.sourceLocation = glGetUniformLocation(stage.program, "source");
+        stage.scaleLocation = glGetUniformLocation(stage.program, "scale");
+        stage.texelSizeLocation = glGetUniformLocation(stage.program, "texelSize");
+
+        stages.push_back(stage);
+        first = last;
+    }
+
+    glDeleteShader(vertexShader);
+
+    return true;
+}
+
+void PostChain::add_passes(FrameGraph &graph, FrameResource input, FrameResource output)
+{
+    FrameResource current = input;
+
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        FrameResource result = output;
+
+        if (i + 1 < stages.size())
+        {
+            result = graph.create_texture(stages[i].name,
+                RenderTargetDesc(graph.width(output), graph.height(output), GL_RGBA8, false, GL_LINEAR));
+        }
+
+        const Stage *stage = &stages[i];
+
+        graph.add_pass(stage->name, vector<FrameResource>(1, current), result,
+                       [this, stage, &graph, current, result]() { draw_stage(*stage, graph, current, result); });
+
+        current = result;
+    }
+}
+
+void PostChain::draw_stage(const Stage &stage, FrameGraph &graph, FrameResource input, FrameResource output)
+{
+    glUseProgram(stage.program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, graph.texture(input));
+    glUniform1i(stage.sourceLocation, 0);
+    glUniform2f(stage.scaleLocation, graph.scale_x(input), graph.scale_y(input));
+    glUniform2f(stage.texelSizeLocation, 1.0f / graph.width(output), 1.0f / graph.height(output));
+
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    profiler_count(CounterDrawCalls);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
+
+vector<string> split_pass_list(const string &list)
+{
+    vector<string> names;
+    istringstream in(list);
+    string name;
+
+    while (getline(in, name, ','))
+    {
+        if (!name.empty())
+        {
+            names.push_back(name);
+        }
+    }
+
+    return names;
+}
@@ -0,0 +1,452 @@
+#include "profiler.h"
+#include "opengl.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Profiler state
+//--------------------------------------------------------------
+
+// GPU timer results are read this many frames late so that
+// reading them never stalls the pipeline
+const int GpuQueryLatency = 4;
+const int MaxZonesPerFrame = 64;
+const int MaxZoneDepth = 16;
+
+struct ProfileZone
+{
+    const char *name;
+    int depth;
+    double start;
+    double duration;
+};
+
+struct FrameRecord
+{
+    unsigned long index;
+    double start;
+    double cpuTime;
+    double gpuTime;
+    bool hitch;
+    unsigned long counters[CounterCount];
+    int zoneCount;
+    ProfileZone zones[MaxZonesPerFrame];
+};
+
+static ProfilerConfig Config;
+static vector<FrameRecord> Frames;
+static vector<double> MedianScratch;
+static FrameRecord *CurrentFrame = NULL;
+static unsigned long FrameIndex = 0;
+
+// Counters incremented outside of a frame (e.g. during startup)
+// are attributed to the next frame
+static unsigned long PendingCounters[CounterCount];
+
+static int ZoneStack[MaxZoneDepth];
+static int ZoneDepth = 0;
+
+static bool GpuTimersAvailable = false;
+static GLuint GpuQueries[GpuQueryLatency];
+static unsigned long GpuQueryFrame[GpuQueryLatency];
+static bool GpuQueryPending[GpuQueryLatency];
+static int ActiveGpuQuery = -1;
+
+static bool DumpPending = false;
+static unsigned long DumpHitchFrame = 0;
+static unsigned long DumpUntilFrame = 0;
+
+static double LastCpuTime = -1.0;
+static double LastGpuTime = -1.0;
+static unsigned long LastCounters[CounterCount];
+
+static const char *CounterNames[CounterCount] = {
+    "shader_compiles",
+    "buffer_allocations",
+    "uploads",
+    "upload_bytes",
+    "draw_calls",
+};
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+static FrameRecord *find_frame(unsigned long index)
+{
+    if (Frames.empty() || index > FrameIndex || FrameIndex - index >= Frames.size())
+    {
+        return NULL;
+    }
+
+    FrameRecord *record = &Frames[index % Frames.size()];
+
+    return record->index == index ? record : NULL;
+}
+
+// Median of either the CPU or GPU times currently in the window,
+// or -1 when there are too few samples to judge outliers
+static double window_median(bool gpu)
+{
+    MedianScratch.clear();
+
+    for (size_t i = 0; i < Frames.size(); i++)
+    {
+        const FrameRecord &record = Frames[i];
+        double value = gpu ? record.gpuTime : record.cpuTime;
+
+        if (value >= 0.0 && record.index < FrameIndex)
+        {
+            MedianScratch.push_back(value);
+        }
+    }
+
+    if (MedianScratch.size() < Frames.size() / 4 || MedianScratch.empty())
+    {
+        return -1.0;
+    }
+
+    vector<double>::iterator middle = MedianScratch.begin() + MedianScratch.size() / 2;
+    nth_element(MedianScratch.begin(), middle, MedianScratch.end());
+
+    return *middle;
+}
+
+static void check_hitch(FrameRecord &record, bool gpu)
+{
+    double value = gpu ? record.gpuTime : record.cpuTime;
+    double median = window_median(gpu);
+
+    if (median <= 0.0 || value < Config.hitchMinimumTime || value <= median * Config.hitchFactor)
+    {
+        return;
+    }
+
+    record.hitch = true;
+
+    // Hitches close together share one trace as long as the
+    // whole range still fits inside the rolling window
+    unsigned long until = record.index + Config.neighborFrames;
+
+    if (!DumpPending)
+    {
+        DumpPending = true;
+        DumpHitchFrame = record.index;
+        DumpUntilFrame = until;
+    }
+    else if (until > DumpUntilFrame &&
+             until - DumpHitchFrame + Config.neighborFrames + GpuQueryLatency < Frames.size())
+    {
+        DumpUntilFrame = until;
+    }
+}
+
+// GPU times trail the CPU by up to GpuQueryLatency frames, so the
+// dump waits for the queries of the frames it covers
+static bool gpu_results_outstanding(unsigned long until)
+{
+    for (int q = 0; q < GpuQueryLatency; q++)
+    {
+        if (GpuQueryPending[q] && GpuQueryFrame[q] <= until)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void write_hitch_dump()
+{
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s%lu.txt", Config.dumpPrefix.c_str(), DumpHitchFrame);
+
+    FILE *out = fopen(filename, "w");
+
+    if (!out)
+    {
+        cerr << "Could not write hitch trace " << filename << endl;
+        return;
+    }
+
+    double cpuMedian = window_median(false);
+    double gpuMedian = window_median(true);
+
+    fprintf(out, "# hitch at frame %lu\n", DumpHitchFrame);
+    fprintf(out, "# median cpu %.3f ms, median gpu %.3f ms, threshold factor %.2f\n",
+            cpuMedian * 1000.0, gpuMedian * 1000.0, Config.hitchFactor);
+
+    unsigned long first = DumpHitchFrame > (unsigned long) Config.neighborFrames
+        ? DumpHitchFrame - Config.neighborFrames : 0;
+
+    for (unsigned long index = first; index <= DumpUntilFrame; index++)
+    {
+        const FrameRecord *record = find_frame(index);
+
+        if (!record)
+        {
+            continue;
+        }
+
+        fprintf(out, "\nframe %lu%s\n", record->index, record->hitch ? "  <-- hitch" : "");
+        fprintf(out, "  cpu %.3f ms  gpu %.3f ms\n", record->cpuTime * 1000.0,
+                record->gpuTime >= 0.0 ? record->gpuTime * 1000.0 : -1.0);
+
+        fprintf(out, " ");
+        for (int c = 0; c < CounterCount; c++)
+        {
+            fprintf(out, " %s=%lu", CounterNames[c], record->counters[c]);
+        }
+        fprintf(out, "\n");
+
+        for (int z = 0; z < record->zoneCount; z++)
+        {
+            const ProfileZone &zone = record->zones[z];
+            fprintf(out, "  %*s%-24s +%.3f ms  %.3f ms\n", zone.depth * 2, "", zone.name,
+                    (zone.start - record->start) * 1000.0, zone.duration * 1000.0);
+        }
+    }
+
+    fclose(out);
+
+    cerr << "Frame " << DumpHitchFrame << " hitched, trace written to " << filename << endl;
+
+    DumpPending = false;
+}
+
+// Read back any finished GPU timer queries without waiting
+static void collect_gpu_results()
+{
+    for (int q = 0; q < GpuQueryLatency; q++)
+    {
+        if (!GpuQueryPending[q])
+        {
+            continue;
+        }
+
+        GLint available = 0;
+        glGetQueryObjectiv(GpuQueries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            continue;
+        }
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(GpuQueries[q], GL_QUERY_RESULT, &elapsed);
+        GpuQueryPending[q] = false;
+
+        LastGpuTime = elapsed / 1.0e9;
+
+        FrameRecord *record = find_frame(GpuQueryFrame[q]);
+
+        if (record)
+        {
+            record->gpuTime = LastGpuTime;
+            check_hitch(*record, true);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+void profiler_initialize(const ProfilerConfig &config)
+{
+    Config = config;
+
+    Frames.assign(config.windowFrames > 0 ? config.windowFrames : 1, FrameRecord());
+    for (size_t i = 0; i < Frames.size(); i++)
+    {
+        // Mark every slot as not holding a real frame yet
+        Frames[i].index = (unsigned long) -1;
+        Frames[i].cpuTime = -1.0;
+        Frames[i].gpuTime = -1.0;
+    }
+    MedianScratch.reserve(Frames.size());
+
+    GpuTimersAvailable = glfwExtensionSupported("GL_ARB_timer_query") == GL_TRUE;
+
+    if (GpuTimersAvailable)
+    {
+        glGenQueries(GpuQueryLatency, GpuQueries);
+    }
+    else
+    {
+        cerr << "GL_ARB_timer_query not supported, GPU frame times disabled" << endl;
+    }
+
+    for (int q = 0; q < GpuQueryLatency; q++)
+    {
+        GpuQueryPending[q] = false;
+    }
+}
+
+void profiler_shutdown()
+{
+    if (DumpPending)
+    {
+        write_hitch_dump();
+    }
+
+    if (GpuTimersAvailable)
+    {
+        glDeleteQueries(GpuQueryLatency, GpuQueries);
+        GpuTimersAvailable = false;
+    }
+
+    Frames.clear();
+    CurrentFrame = NULL;
+}
+
+void profiler_begin_frame()
+{
+    if (Frames.empty())
+    {
+        return;
+    }
+
+    if (GpuTimersAvailable)
+    {
+        collect_gpu_results();
+    }
+
+    CurrentFrame = &Frames[FrameIndex % Frames.size()];
+    CurrentFrame->index = FrameIndex;
+    CurrentFrame->start = glfwGetTime();
+    CurrentFrame->cpuTime = -1.0;
+    CurrentFrame->gpuTime = -1.0;
+    CurrentFrame->hitch = false;
+    CurrentFrame->zoneCount = 0;
+
+    for (int c = 0; c < CounterCount; c++)
+    {
+        CurrentFrame->counters[c] = PendingCounters[c];
+        PendingCounters[c] = 0;
+    }
+
+    ZoneDepth = 0;
+    ActiveGpuQuery = -1;
+
+    // Skip GPU timing for this frame rather than wait on a query
+    // that the driver has not finished yet
+    int q = FrameIndex % GpuQueryLatency;
+
+    if (GpuTimersAvailable && !GpuQueryPending[q])
+    {
+        glBeginQuery(GL_TIME_ELAPSED, GpuQueries[q]);
+        GpuQueryFrame[q] = FrameIndex;
+        ActiveGpuQuery = q;
+    }
+}
+
+void profiler_end_frame()
+{
+    if (!CurrentFrame)
+    {
+        return;
+    }
+
+    if (ActiveGpuQuery >= 0)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        GpuQueryPending[ActiveGpuQuery] = true;
+        ActiveGpuQuery = -1;
+    }
+
+    while (ZoneDepth > 0)
+    {
+        profiler_end_zone();
+    }
+
+    CurrentFrame->cpuTime = glfwGetTime() - CurrentFrame->start;
+    LastCpuTime = CurrentFrame->cpuTime;
+
+    for (int c = 0; c < CounterCount; c++)
+    {
+        LastCounters[c] = CurrentFrame->counters[c];
+    }
+
+    check_hitch(*CurrentFrame, false);
+
+    if (DumpPending && FrameIndex >= DumpUntilFrame &&
+        (!gpu_results_outstanding(DumpUntilFrame) || FrameIndex >= DumpUntilFrame + GpuQueryLatency))
+    {
+        write_hitch_dump();
+    }
+
+    CurrentFrame = NULL;
+    FrameIndex++;
+}
+
+void profiler_begin_zone(const char *name)
+{
+    if (!CurrentFrame || ZoneDepth >= MaxZoneDepth)
+    {
+        return;
+    }
+
+    int slot = -1;
+
+    if (CurrentFrame->zoneCount < MaxZonesPerFrame)
+    {
+        slot = CurrentFrame->zoneCount++;
+
+        ProfileZone &zone = CurrentFrame->zones[slot];
+        zone.name = name;
+        zone.depth = ZoneDepth;
+        zone.start = glfwGetTime();
+        zone.duration = -1.0;
+    }
+
+    ZoneStack[ZoneDepth++] = slot;
+}
+
+void profiler_end_zone()
+{
+    if (!CurrentFrame || ZoneDepth == 0)
+    {
+        return;
+    }
+
+    int slot = ZoneStack[--ZoneDepth];
+
+    if (slot >= 0)
+    {
+        ProfileZone &zone = CurrentFrame->zones[slot];
+        zone.duration = glfwGetTime() - zone.start;
+    }
+}
+
+void profiler_count(ProfileCounter counter, unsigned long amount)
+{
+    if (CurrentFrame)
+    {
+        CurrentFrame->counters[counter] += amount;
+    }
+    else
+    {
+        PendingCounters[counter] += amount;
+    }
+}
+
+double profiler_last_cpu_time()
+{
+    return LastCpuTime;
+}
+
+double profiler_last_gpu_time()
+{
+    return LastGpuTime;
+}
+
+unsigned long profiler_last_counter(ProfileCounter counter)
+{
+    return LastCounters[counter];
+}
@@ -0,0 +1,156 @@
+#include "render_scale.h"
+#include "shader_utils.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+const char* UpscaleVertexShaderFilename = "shaders/vertex/fullscreen.glsl";
+const char* UpscaleFragmentShaderFilename = "shaders/fragment/upscale.glsl";
+
+// Scales snap to this step so noise in the timings does not cause
+// a stream of tiny changes (and layer cache refreshes)
+const float ScaleStep = 1.0f / 32.0f;
+
+// Grow only below this share of the budget, and at most this much
+// per decision; shrinking aims slightly under the budget
+const double GrowBelowFraction = 0.8;
+const float MaxGrowStep = 0.05f;
+const double ShrinkTargetFraction = 0.95;
+
+// Weight of a new GPU time in the running average
+const double GpuTimeSmoothing = 0.25;
+
+//--------------------------------------------------------------
+// Render scale controller
+//--------------------------------------------------------------
+
+RenderScaleController::RenderScaleController(const RenderScaleConfig &config)
+    : config(config), currentScale(config.maxScale), smoothedGpuTime(-1.0), framesSinceChange(0),
+      frames(0), changes(0), scaleSum(0.0), lowestScale(config.maxScale)
+{
+}
+
+float RenderScaleController::update(double gpuTime)
+{
+    frames++;
+    scaleSum += currentScale;
+    framesSinceChange++;
+
+    // Timings still in flight were taken at the previous scale
+    if (gpuTime <= 0.0 || framesSinceChange <= config.settleFrames / 2)
+    {
+        return currentScale;
+    }
+
+    smoothedGpuTime = smoothedGpuTime < 0.0 ? gpuTime
+                    : smoothedGpuTime + (gpuTime - smoothedGpuTime) * GpuTimeSmoothing;
+
+    if (framesSinceChange < config.settleFrames)
+    {
+        return currentScale;
+    }
+
+    float desired = currentScale;
+
+    if (smoothedGpuTime > config.targetGpuTime)
+    {
+        desired = currentScale * (float) sqrt(config.targetGpuTime * ShrinkTargetFraction / smoothedGpuTime);
+        desired = floor(desired / ScaleStep) * ScaleStep;
+    }
+    else if (smoothedGpuTime < config.targetGpuTime * GrowBelowFraction)
+    {
+        desired = currentScale * (float) sqrt(config.targetGpuTime * GrowBelowFraction / smoothedGpuTime);
+        desired = floor(min(desired, currentScale + MaxGrowStep) / ScaleStep) * ScaleStep;
+    }
+
+    desired = min(max(desired, config.minScale), config.maxScale);
+
+    if (desired != currentScale)
+    {
+        currentScale = desired;
+        lowestScale = min(lowestScale, desired);
+        smoothedGpuTime = -1.0;
+        framesSinceChange = 0;
+        changes++;
+    }
+
+    return currentScale;
+}
+
+void RenderScaleController::scaled_size(int width, int height, int &scaledWidth, int &scaledHeight) const
+{
+    scaledWidth = max(1, (int) (width * currentScale + 0.5f));
+    scaledHeight = max(1, (int) (height * currentScale + 0.5f));
+}
+
+void RenderScaleController::report(ostream &out) const
+{
+    out << "Dynamic resolution: target " << config.targetGpuTime * 1000.0 << " ms GPU, scale now "
+        << currentScale << ", average " << (frames ? scaleSum / frames : currentScale) << ", lowest "
+        << lowestScale << ", " << changes << " changes over " << frames << " frames" << endl;
+}
+
+//--------------------------------------------------------------
+// Upscaler
+//--------------------------------------------------------------
+
+Upscaler::Upscaler()
+    : program(0), sourceLocation(-1), scaleLocation(-1), vertexArray(0)
+{
+}
+
+Upscaler::~Upscaler()
+{
+    if (program)
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vertexArray);
+    }
+}
+
+bool Upscaler::initialize()
+{
+    program = create_program_from_files(UpscaleVertexShaderFilename, UpscaleFragmentShaderFilename);
+
+    if (!program)
+    {
+        cerr << "Could not build the upscale program" << endl;
+        return false;
+    }
+
+    sourceLocation = glGetUniformLocation(program, "source");
+    scaleLocation = glGetUniformLocation(program, "scale");
+    glGenVertexArrays(1, &vertexArray);
+
+    return true;
+}
+
+void Upscaler::draw(GLuint texture, float scaleX, float scaleY)
+{
+    if (!program || !texture)
+    {
+        return;
+    }
+
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(sourceLocation, 0);
+    glUniform2f(scaleLocation, scaleX, scaleY);
+
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    profiler_count(CounterDrawCalls);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
@@ -0,0 +1,409 @@
+#include "render_target.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Render targets
+//--------------------------------------------------------------
+
+static GLenum base_format(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_R8: case GL_R16F: case GL_R32F: return GL_RED;
+        case GL_RG8: case GL_RG16F: case GL_RG32F: return GL_RG;
+        default: return GL_RGBA;
+    }
+}
+
+static size_t bytes_per_pixel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_R8: return 1;
+        case GL_R16F: case GL_RG8: return 2;
+        case GL_R32F: case GL_RG16F: return 4;
+        case GL_RGBA16F: case GL_RG32F: return 8;
+        case GL_RGBA32F: return 16;
+        default: return 4;
+    }
+}
+
+bool render_target_create(RenderTarget &target, const RenderTargetDesc &desc)
+{
+    target.desc = desc;
+    target.depthRenderbuffer = 0;
+
+    glGenTextures(1, &target.colorTexture);
+    glBindTexture(GL_TEXTURE_2D, target.colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.colorFormat, desc.width, desc.height, 0,
+                 base_format(desc.colorFormat), GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.colorTexture, 0);
+
+    if (desc.depth)
+    {
+        glGenRenderbuffers(1, &target.depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, target.depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, desc.width, desc.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthRenderbuffer);
+    }
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "Render target " << desc.width << "x" << desc.height
+             << " incomplete (status 0x" << hex << status << dec << ")" << endl;
+        render_target_destroy(target);
+        return false;
+    }
+
+    return true;
+}
+
+void render_target_destroy(RenderTarget &target)
+{
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteTextures(1, &target.colorTexture);
+
+    if (target.depthRenderbuffer)
+    {
+        glDeleteRenderbuffers(1, &target.depthRenderbuffer);
+    }
+
+    target.framebuffer = 0;
+    target.colorTexture = 0;
+    target.depthRenderbuffer = 0;
+}
+
+void render_target_bind(const RenderTarget *target, int windowWidth, int windowHeight)
+{
+    if (target)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        glViewport(0, 0, target->desc.width, target->desc.height);
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+    }
+}
+
+//--------------------------------------------------------------
+// Window-sized targets
+//--------------------------------------------------------------
+
+// Storage sizes are rounded up to this many pixels, and grown by a
+// quarter on top once the window is actually being resized
+const int ResizeGranularity = 64;
+const int ResizeHeadroomDivisor = 4;
+
+static int storage_size(int needed, int headroom, int limit)
+{
+    int size = (needed + headroom + ResizeGranularity - 1) / ResizeGranularity * ResizeGranularity;
+
+    return max(needed, min(size, limit));
+}
+
+ResizableTarget::ResizableTarget(const RenderTargetDesc &desc, int shrinkAfterFrames)
+    : desc(desc), storage(NULL), usedWidth(0), usedHeight(0),
+      shrinkAfterFrames(shrinkAfterFrames), undersizedFrames(0), reallocationCount(0)
+{
+}
+
+ResizableTarget::~ResizableTarget()
+{
+    destroy();
+}
+
+bool ResizableTarget::resize(int width, int height)
+{
+    usedWidth = width;
+    usedHeight = height;
+
+    // Growing an existing target means a resize is under way, expect more
+    bool growing = storage && (width > storage->desc.width || height > storage->desc.height);
+
+    if (storage && !growing)
+    {
+        long used = (long) width * height;
+        long capacity = (long) storage->desc.width * storage->desc.height;
+
+        undersizedFrames = used * 2 < capacity ? undersizedFrames + 1 : 0;
+
+        if (undersizedFrames < shrinkAfterFrames)
+        {
+            return false;
+        }
+    }
+
+    GLint limit;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &limit);
+
+    RenderTargetDesc sized = desc;
+    sized.width = storage_size(width, growing ? width / ResizeHeadroomDivisor : 0, limit);
+    sized.height = storage_size(height, growing ? height / ResizeHeadroomDivisor : 0, limit);
+
+    destroy();
+
+    storage = new RenderTarget;
+
+    if (!render_target_create(*storage, sized))
+    {
+        delete storage;
+        storage = NULL;
+        return true;
+    }
+
+    undersizedFrames = 0;
+    reallocationCount++;
+
+    return true;
+}
+
+void ResizableTarget::destroy()
+{
+    if (storage)
+    {
+        render_target_destroy(*storage);
+        delete storage;
+        storage = NULL;
+    }
+}
+
+void ResizableTarget::bind() const
+{
+    if (storage)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, storage->framebuffer);
+        glViewport(0, 0, usedWidth, usedHeight);
+    }
+}
+
+//--------------------------------------------------------------
+// Render target pool
+//--------------------------------------------------------------
+
+RenderTargetPool::RenderTargetPool(int evictAfterFrames)
+    : evictAfterFrames(evictAfterFrames)
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    clear();
+}
+
+RenderTarget *RenderTargetPool::acquire(const RenderTargetDesc &desc)
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry &entry = entries[i];
+
+        if (!entry.inUse && entry.target->desc == desc)
+        {
+            entry.inUse = true;
+            entry.idleFrames = 0;
+            return entry.target;
+        }
+    }
+
+    RenderTarget *target = new RenderTarget;
+
+    if (!render_target_create(*target, desc))
+    {
+        delete target;
+        return NULL;
+    }
+
+    Entry entry = { target, true, 0 };
+    entries.push_back(entry);
+
+    return target;
+}
+
+void RenderTargetPool::release(RenderTarget *target)
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].target == target)
+        {
+            entries[i].inUse = false;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::end_frame()
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry &entry = entries[i];
+
+        if (!entry.inUse && ++entry.idleFrames > evictAfterFrames)
+        {
+            render_target_destroy(*entry.target);
+            delete entry.target;
+            continue;
+        }
+
+        entries[kept++] = entry;
+    }
+
+    entries.resize(kept);
+}
+
+void RenderTargetPool::clear()
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        render_target_destroy(*entries[i].target);
+        delete entries[i].target;
+    }
+
+    entries.clear();
+}
+
+size_t RenderTargetPool::allocated_bytes() const
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const RenderTargetDesc &desc = entries[i].target->desc;
+        size_t pixels = (size_t) desc.width * desc.height;
+
+        total += pixels * bytes_per_pixel(desc.colorFormat) + (desc.depth ? pixels * 4 : 0);
+    }
+
+    return total;
+}
+
+//--------------------------------------------------------------
+// Readback ring
+//--------------------------------------------------------------
+
+ReadbackRing::ReadbackRing(int depth)
+    : slots(depth > 0 ? depth : 1), head(0), inFlight(0)
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        glGenBuffers(1, &slots[i].buffer);
+        slots[i].fence = 0;
+        slots[i].capacity = 0;
+    }
+}
+
+ReadbackRing::~ReadbackRing()
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].fence)
+        {
+            glDeleteSync(slots[i].fence);
+        }
+
+        glDeleteBuffers(1, &slots[i].buffer);
+    }
+}
+
+bool ReadbackRing::request(GLuint framebuffer, int x, int y, int width, int height, uint64_t tag)
+{
+    if (inFlight == (int) slots.size())
+    {
+        return false;
+    }
+
+    Slot &slot = slots[(head + inFlight) % slots.size()];
+    size_t size = (size_t) width * height * 4;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+    if (slot.capacity < size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // With a pack buffer bound the last argument is an offset and the
+    // call only queues the copy
+    glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.tag = tag;
+
+    inFlight++;
+
+    return true;
+}
+
+void ReadbackRing::poll(const std::function<void(const ReadbackImage &)> &callback, bool wait)
+{
+    while (inFlight > 0)
+    {
+        Slot &slot = slots[head];
+
+        // The flush bit makes sure the fence actually reaches the GPU
+        GLuint64 timeout = wait ? 1000000000ull : 0;
+        GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            if (wait)
+            {
+                continue;
+            }
+            return;
+        }
+
+        // Only the oldest readback is waited for
+        wait = false;
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        if (result != GL_WAIT_FAILED)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            size_t size = (size_t) slot.width * slot.height * 4;
+            void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+            if (pixels)
+            {
+                ReadbackImage image = { (const unsigned char *) pixels, slot.width, slot.height, slot.tag };
+                callback(image);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        head = (head + 1) % slots.size();
+        inFlight--;
+    }
+}
@@ -1,8 +1,12 @@
 #include "shader_utils.h"
+#include "profiler.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
+
+using namespace std;
 
 // Adapted from http://stackoverflow.com/q/2602013/761648
 std::string load_shader_from_file(std::string filename)
@@ -28,3 +32,115 @@ std::string load_shader_from_file(std::string filename)
 
     return "";
 }
+
+// Shader link stage
+// [These functions create a working program object. glCreateProgram
+// creates an empty program object. glAttachShader attaches a shader
+// object to that program. Multiple calls attach multiple shader objects.
+// glLinkProgram links all of the previously attached shaders into a
+// complete program. glDetachShader is used to remove a shader object
+// from the program object; this does not affect the behavior of the program.]
+// Returns 0 if linking fails (a shader that failed to compile fails
+// the link too).
+GLuint create_shader_program(const std::vector<GLuint> &shaderList)
+{
+    // Create OpenGL object
+    GLuint program = glCreateProgram();
+
+    // Tell OpenGL about our shader objects
+    for(size_t iLoop = 0; iLoop < shaderList.size(); iLoop++)
+        glAttachShader(program, shaderList[iLoop]);
+
+    // Link them all into one program
+    glLinkProgram(program);
+
+    // Handle errors
+    GLint status;
+    glGetProgramiv (program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        GLint infoLogLength;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+        GLchar *strInfoLog = new GLchar[infoLogLength + 1];
+        glGetProgramInfoLog(program, infoLogLength, NULL, strInfoLog);
+
+        cerr <<  "Linker failure: " << strInfoLog << endl;
+        delete[] strInfoLog;
+    }
+
+    // The shaders are linked already, we can tell OpenGL to
+    // forget about them
+    for(size_t iLoop = 0; iLoop < shaderList.size(); iLoop++)
+        glDetachShader(program, shaderList[iLoop]);
+
+    // A program that failed to link draws nothing useful, callers
+    // test for 0 instead
+    if (status == GL_FALSE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+// Shader compile stage
+// [These functions create a working shader object. glCreateShader simply
+// creates an empty shader object of a particular shader stage.
+// glShaderSource sets strings into that object; multiple calls to this
+// function simply overwrite the previously set strings. glCompileShader
+// causes the shader object to be compiled with the previously set strings.
+// glDeleteShader causes the shader object to be deleted.]
+GLuint create_shader(GLenum eShaderType, const std::string &strShaderFile)
+{
+    // Create OpenGL object
+    GLuint shader = glCreateShader(eShaderType);
+
+    const char *strFileData = strShaderFile.c_str();
+    glShaderSource(shader, 1, &strFileData, NULL);
+
+    // Turn the text shader into a compiled binary object
+    glCompileShader(shader);
+    profiler_count(CounterShaderCompiles);
+
+    // Handle errors
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        GLint infoLogLength;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+        GLchar *strInfoLog = new GLchar[infoLogLength + 1];
+        glGetShaderInfoLog(shader, infoLogLength, NULL, strInfoLog);
+
+        const char *strShaderType = NULL;
+        switch(eShaderType)
+        {
+            case GL_VERTEX_SHADER: strShaderType = "vertex"; break;
+            case GL_GEOMETRY_SHADER: strShaderType = "geometry"; break;
+            case GL_FRAGMENT_SHADER: strShaderType = "fragment"; break;
+        }
+
+        cerr <<  "Compile failure in " << strShaderType << " shader:" << endl << strInfoLog << "%s" << endl;
+        delete[] strInfoLog;
+    }
+
+    return shader;
+}
+
+// Convenience for the common vertex + fragment pair loaded from disk
+GLuint create_program_from_files(const std::string &vertexFilename, const std::string &fragmentFilename)
+{
+    std::vector<GLuint> shaderList;
+
+    shaderList.push_back(create_shader(GL_VERTEX_SHADER, load_shader_from_file(vertexFilename)));
+    shaderList.push_back(create_shader(GL_FRAGMENT_SHADER, load_shader_from_file(fragmentFilename)));
+
+    GLuint program = create_shader_program(shaderList);
+
+    std::for_each(shaderList.begin(), shaderList.end(), glDeleteShader);
+
+    return program;
+}
@@ -0,0 +1,8 @@
+#version 330
+
+// Colour writes are masked off; only the samples passing depth count
+out vec4 outputColor;
+void main()
+{
+    outputColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+}
@@ -0,0 +1,16 @@
+#version 330
+
+uniform sampler2D layer;
+
+// Used part of the layer texture, which may be larger than the output
+uniform vec2 scale;
+
+smooth in vec2 texCoord;
+
+out vec4 outputColor;
+
+// Layers are premultiplied, blending is ONE, ONE_MINUS_SRC_ALPHA
+void main()
+{
+    outputColor = texture(layer, texCoord * scale);
+}
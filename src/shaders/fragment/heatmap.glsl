@@ -0,0 +1,38 @@
+#version 330
+
+uniform sampler2D overdraw;
+uniform float maxValue;
+
+// Used part of the count texture, which may be larger than the window
+uniform vec2 scale;
+
+smooth in vec2 texCoord;
+
+out vec4 outputColor;
+
+// black -> blue -> green -> yellow -> red -> white
+vec3 heat(float t)
+{
+    const vec3 ramp[6] = vec3[6](vec3(0.0f, 0.0f, 0.0f),
+                                 vec3(0.0f, 0.0f, 1.0f),
+                                 vec3(0.0f, 1.0f, 0.0f),
+                                 vec3(1.0f, 1.0f, 0.0f),
+                                 vec3(1.0f, 0.0f, 0.0f),
+                                 vec3(1.0f, 1.0f, 1.0f));
+
+    float scaled = clamp(t, 0.0f, 1.0f) * 5.0f;
+    int index = min(int(scaled), 4);
+
+    return mix(ramp[index], ramp[index + 1], scaled - float(index));
+}
+
+void main()
+{
+    float value = texture(overdraw, texCoord * scale).r;
+
+    // Logarithmic tone mapping keeps single overdraw visible while
+    // still separating heavy hot spots
+    float t = log2(1.0f + value) / log2(1.0f + maxValue);
+
+    outputColor = vec4(heat(t), 1.0f);
+}
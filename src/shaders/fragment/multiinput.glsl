@@ -2,9 +2,12 @@
 
 smooth in vec4 theColor;
 
+// 0 leaves the colors untouched, 1 darkens them to half
+uniform float pulse;
+
 out vec4 outputColor;
 
 void main()
 {
-    outputColor = theColor;
+    outputColor = vec4(theColor.rgb * (1.0f - 0.5f * pulse), theColor.a);
 }
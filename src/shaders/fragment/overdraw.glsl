@@ -0,0 +1,11 @@
+#version 330
+
+// Added into the overdraw target once per shaded fragment
+uniform float weight;
+
+out vec4 outputColor;
+
+void main()
+{
+    outputColor = vec4(weight, 0.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,47 @@
+#version 330
+
+uniform sampler2D source;
+
+// Used part of the source texture, which may be larger than the image
+uniform vec2 scale;
+
+smooth in vec2 texCoord;
+
+out vec4 outputColor;
+
+// Catmull-Rom bicubic filter from 9 bilinear fetches: the weights of
+// the two middle taps per axis are folded into one fetch position.
+// Much sharper than plain bilinear when upscaling.
+void main()
+{
+    vec2 size = vec2(textureSize(source, 0));
+    vec2 position = texCoord * scale * size;
+    vec2 center = floor(position - 0.5f) + 0.5f;
+    vec2 f = position - center;
+
+    vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    vec2 w3 = f * f * (-0.5f + 0.5f * f);
+    vec2 w12 = w1 + w2;
+
+    // Keep taps inside the used part, the rest of the texture is stale
+    vec2 low = 0.5f / size;
+    vec2 high = (scale * size - 0.5f) / size;
+
+    vec2 p0 = clamp((center - 1.0f) / size, low, high);
+    vec2 p12 = clamp((center + w2 / w12) / size, low, high);
+    vec2 p3 = clamp((center + 2.0f) / size, low, high);
+
+    vec4 result = texture(source, vec2(p0.x, p0.y)) * w0.x * w0.y
+                + texture(source, vec2(p12.x, p0.y)) * w12.x * w0.y
+                + texture(source, vec2(p3.x, p0.y)) * w3.x * w0.y
+                + texture(source, vec2(p0.x, p12.y)) * w0.x * w12.y
+                + texture(source, vec2(p12.x, p12.y)) * w12.x * w12.y
+                + texture(source, vec2(p3.x, p12.y)) * w3.x * w12.y
+                + texture(source, vec2(p0.x, p3.y)) * w0.x * w3.y
+                + texture(source, vec2(p12.x, p3.y)) * w12.x * w3.y
+                + texture(source, vec2(p3.x, p3.y)) * w3.x * w3.y;
+
+    outputColor = max(result, vec4(0.0f));
+}
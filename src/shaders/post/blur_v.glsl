@@ -0,0 +1,10 @@
+// 9-tap Gaussian, vertical half; linear filtering merges tap pairs
+// so it takes 5 fetches. Samples the neighbourhood.
+vec4 PASS(vec2 uv)
+{
+    vec2 offset = vec2(0.0f, texelSize.y);
+
+    return fetch(uv) * 0.2270270270f
+         + (fetch(uv + offset * 1.3846153846f) + fetch(uv - offset * 1.3846153846f)) * 0.3162162162f
+         + (fetch(uv + offset * 3.2307692308f) + fetch(uv - offset * 3.2307692308f)) * 0.0702702703f;
+}
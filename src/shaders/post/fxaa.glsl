@@ -0,0 +1,34 @@
+// FXAA (console variant): blurs along the local edge direction where
+// the luma contrast says there is one. Samples the neighbourhood.
+vec4 PASS(vec2 uv)
+{
+    const vec3 lumaWeights = vec3(0.299f, 0.587f, 0.114f);
+    const float reduceMultiplier = 1.0f / 8.0f;
+    const float reduceMinimum = 1.0f / 128.0f;
+    const float spanMaximum = 8.0f;
+
+    vec4 center = fetch(uv);
+    float lumaNW = dot(fetch(uv + vec2(-1.0f, -1.0f) * texelSize).rgb, lumaWeights);
+    float lumaNE = dot(fetch(uv + vec2( 1.0f, -1.0f) * texelSize).rgb, lumaWeights);
+    float lumaSW = dot(fetch(uv + vec2(-1.0f,  1.0f) * texelSize).rgb, lumaWeights);
+    float lumaSE = dot(fetch(uv + vec2( 1.0f,  1.0f) * texelSize).rgb, lumaWeights);
+    float lumaM = dot(center.rgb, lumaWeights);
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)),
+                            (lumaNW + lumaSW) - (lumaNE + lumaSE));
+
+    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25f * reduceMultiplier, reduceMinimum);
+    float scaleToSpan = 1.0f / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * scaleToSpan, vec2(-spanMaximum), vec2(spanMaximum)) * texelSize;
+
+    vec3 inner = 0.5f * (fetch(uv + direction * (1.0f / 3.0f - 0.5f)).rgb +
+                         fetch(uv + direction * (2.0f / 3.0f - 0.5f)).rgb);
+    vec3 outer = inner * 0.5f + 0.25f * (fetch(uv - direction * 0.5f).rgb +
+                                         fetch(uv + direction * 0.5f).rgb);
+    float lumaOuter = dot(outer, lumaWeights);
+
+    return vec4(lumaOuter < lumaMin || lumaOuter > lumaMax ? inner : outer, center.a);
+}
@@ -0,0 +1,8 @@
+// Filmic tone curve (ACES fit by Narkowicz), pointwise
+vec4 PASS(vec4 color, vec2 uv)
+{
+    vec3 x = color.rgb;
+    vec3 mapped = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+
+    return vec4(clamp(mapped, 0.0f, 1.0f), color.a);
+}
@@ -0,0 +1,8 @@
+// Darkens towards the corners, pointwise
+vec4 PASS(vec4 color, vec2 uv)
+{
+    float radius = length(uv - 0.5f) * 1.4142f;
+    float falloff = 1.0f - 0.6f * smoothstep(0.4f, 1.0f, radius);
+
+    return vec4(color.rgb * falloff, color.a);
+}
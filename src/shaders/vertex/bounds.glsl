@@ -0,0 +1,13 @@
+#version 330
+
+layout (location = 0) in vec3 position;
+
+// Unit cube corners scaled to the box (see occlusion_queries.h)
+uniform mat4 viewProjection;
+uniform vec3 center;
+uniform vec3 extents;
+
+void main()
+{
+    gl_Position = viewProjection * vec4(center + position * extents, 1.0f);
+}
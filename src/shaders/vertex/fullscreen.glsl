@@ -0,0 +1,12 @@
+#version 330
+
+// Covers the screen with a single triangle, no vertex buffer needed
+smooth out vec2 texCoord;
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+
+    texCoord = corner;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
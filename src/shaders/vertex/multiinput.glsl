@@ -3,10 +3,13 @@
 layout (location = 0) in vec4 position;
 layout (location = 1) in vec4 color;
 
+// xy scale, zw offset (see view.h)
+uniform vec4 viewTransform;
+
 smooth out vec4 theColor;
 
 void main()
 {
-    gl_Position = position;
+    gl_Position = vec4(position.xy * viewTransform.xy + viewTransform.zw * position.w, position.zw);
     theColor = color;
 }
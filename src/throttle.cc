@@ -0,0 +1,138 @@
+#include "throttle.h"
+
+using namespace std;
+
+static ThrottleConfig Config;
+
+static bool Focused = true;
+static bool Iconified = false;
+static bool Visible = true;
+
+static WindowActivity Activity = ActivityFocused;
+static double ActivityStart = 0.0;
+static double LastFrameTime = -1.0;
+
+static double ActivitySeconds[ActivityCount];
+static unsigned long ActivityFrames[ActivityCount];
+
+static const char *ActivityNames[ActivityCount] = {
+    "focused",
+    "unfocused",
+    "iconified",
+    "hidden",
+};
+
+//--------------------------------------------------------------
+// Internal helpers
+//--------------------------------------------------------------
+
+// Iconified wins over hidden wins over unfocused
+static void update_activity(double now)
+{
+    WindowActivity activity = Iconified ? ActivityIconified
+                            : !Visible ? ActivityHidden
+                            : !Focused ? ActivityUnfocused
+                            : ActivityFocused;
+
+    if (activity == Activity)
+    {
+        return;
+    }
+
+    ActivitySeconds[Activity] += now - ActivityStart;
+    Activity = activity;
+    ActivityStart = now;
+
+    // Drawing resumes at once instead of waiting out the old cap
+    LastFrameTime = -1.0;
+}
+
+//--------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------
+
+void throttle_initialize(const ThrottleConfig &config, double now)
+{
+    Config = config;
+
+    Focused = true;
+    Iconified = false;
+    Visible = true;
+    Activity = ActivityFocused;
+    ActivityStart = now;
+    LastFrameTime = -1.0;
+
+    for (int i = 0; i < ActivityCount; i++)
+    {
+        ActivitySeconds[i] = 0.0;
+        ActivityFrames[i] = 0;
+    }
+}
+
+void throttle_set_focused(bool focused, double now)
+{
+    Focused = focused;
+    update_activity(now);
+}
+
+void throttle_set_iconified(bool iconified, double now)
+{
+    Iconified = iconified;
+    update_activity(now);
+}
+
+void throttle_set_visible(bool visible, double now)
+{
+    if (visible != Visible)
+    {
+        Visible = visible;
+        update_activity(now);
+    }
+}
+
+WindowActivity throttle_activity()
+{
+    return Activity;
+}
+
+double throttle_wait_time(double now)
+{
+    if ((Activity == ActivityIconified || Activity == ActivityHidden) && Config.suspendWhenIconified)
+    {
+        return -1.0;
+    }
+
+    if (Activity == ActivityUnfocused && Config.unfocusedFrameRate > 0.0 && LastFrameTime >= 0.0)
+    {
+        double next = LastFrameTime + 1.0 / Config.unfocusedFrameRate;
+
+        return next > now ? next - now : 0.0;
+    }
+
+    return 0.0;
+}
+
+void throttle_frame_rendered(double now)
+{
+    LastFrameTime = now;
+    ActivityFrames[Activity]++;
+}
+
+void throttle_report(ostream &out, double now)
+{
+    out << "Window state:";
+
+    for (int i = 0; i < ActivityCount; i++)
+    {
+        double seconds = ActivitySeconds[i] + (i == Activity ? now - ActivityStart : 0.0);
+
+        if (seconds <= 0.0 && ActivityFrames[i] == 0)
+        {
+            continue;
+        }
+
+        out << " " << ActivityNames[i] << " " << seconds << " s (" << ActivityFrames[i] << " frames)";
+    }
+
+    out << endl;
+}
@@ -0,0 +1,117 @@
+#include "tiled_render.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+std::vector<Tile> make_tiles(int width, int height, int tileSize)
+{
+    vector<Tile> tiles;
+
+    for (int y = 0; y < height; y += tileSize)
+    {
+        for (int x = 0; x < width; x += tileSize)
+        {
+            Tile tile = { x, y, min(tileSize, width - x), min(tileSize, height - y) };
+            tiles.push_back(tile);
+        }
+    }
+
+    return tiles;
+}
+
+TiledImageWriter::TiledImageWriter()
+    : fd(-1), width(0), height(0), headerSize(0), bytesWritten(0)
+{
+}
+
+TiledImageWriter::~TiledImageWriter()
+{
+    close();
+}
+
+bool TiledImageWriter::open(const std::string &filename, int imageWidth, int imageHeight)
+{
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        cerr << "Could not open " << filename << " for writing" << endl;
+        return false;
+    }
+
+    width = imageWidth;
+    height = imageHeight;
+
+    char header[64];
+    headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    // Reserve the whole file so every tile can be written in place
+    uint64_t fileSize = headerSize + (uint64_t) width * height * 3;
+
+    if (pwrite(fd, header, headerSize, 0) != (ssize_t) headerSize || ftruncate(fd, fileSize) != 0)
+    {
+        cerr << "Could not size " << filename << " to " << fileSize << " bytes" << endl;
+        close();
+        return false;
+    }
+
+    bytesWritten = headerSize;
+
+    return true;
+}
+
+bool TiledImageWriter::write_tile(const Tile &tile, const unsigned char *pixels)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    rowBuffer.resize((size_t) tile.width * 3);
+
+    for (int row = 0; row < tile.height; row++)
+    {
+        const unsigned char *source = pixels + (size_t) row * tile.width * 4;
+
+        for (int x = 0; x < tile.width; x++)
+        {
+            rowBuffer[x * 3 + 0] = source[x * 4 + 0];
+            rowBuffer[x * 3 + 1] = source[x * 4 + 1];
+            rowBuffer[x * 3 + 2] = source[x * 4 + 2];
+        }
+
+        // PPM rows run top to bottom, GL rows bottom to top
+        uint64_t imageRow = height - 1 - (tile.y + row);
+        uint64_t offset = headerSize + (imageRow * width + tile.x) * 3;
+
+        if (pwrite(fd, &rowBuffer[0], rowBuffer.size(), offset) != (ssize_t) rowBuffer.size())
+        {
+            cerr << "Tile write failed at offset " << offset << endl;
+            return false;
+        }
+
+        bytesWritten += rowBuffer.size();
+    }
+
+    return true;
+}
+
+bool TiledImageWriter::close()
+{
+    if (fd < 0)
+    {
+        return true;
+    }
+
+    bool ok = ::close(fd) == 0;
+    fd = -1;
+
+    return ok;
+}
@@ -0,0 +1,431 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// Configuration
+//--------------------------------------------------------------
+
+// Below this many nodes a parallel update costs more than it saves
+const size_t ParallelMinimumNodes = 16384;
+
+// Subtree tasks per thread, so uneven subtrees still balance out
+const int TasksPerThread = 4;
+
+//--------------------------------------------------------------
+// Transform hierarchy
+//--------------------------------------------------------------
+
+TransformHierarchy::TransformHierarchy()
+    : unsorted(false), plannedTasks(0)
+{
+}
+
+TransformHandle TransformHierarchy::add_node(TransformHandle parent, const Vec3 &translation,
+                                             const Quat &rotation, const Vec3 &scale)
+{
+    int index = (int) parents.size();
+    int parentIndex = parent >= 0 ? handleToIndex[parent] : -1;
+
+    // Appending keeps the depth-first order only if the parent's
+    // subtree (and so all its ancestors') ends at the end
+    if (parentIndex >= 0 && subtreeEnds[parentIndex] != index)
+    {
+        unsorted = true;
+    }
+
+    for (int p = parentIndex; p >= 0 && subtreeEnds[p] == index; p = parents[p])
+    {
+        subtreeEnds[p] = index + 1;
+    }
+
+    parents.push_back(parentIndex);
+    subtreeEnds.push_back(index + 1);
+    tx.push_back(0.0f); ty.push_back(0.0f); tz.push_back(0.0f);
+    rx.push_back(0.0f); ry.push_back(0.0f); rz.push_back(0.0f); rw.push_back(1.0f);
+    sx.push_back(1.0f); sy.push_back(1.0f); sz.push_back(1.0f);
+    dirty.push_back(0);
+    dirtyBelow.push_back(0);
+    moved.push_back(0);
+    worlds.push_back(Mat4());
+
+    TransformHandle handle = (TransformHandle) handleToIndex.size();
+    handleToIndex.push_back(index);
+    indexToHandle.push_back(handle);
+    plannedTasks = 0;
+
+    set_local(handle, translation, rotation, scale);
+
+    return handle;
+}
+
+void TransformHierarchy::set_local(TransformHandle node, const Vec3 &translation, const Quat &rotation, const Vec3 &scale)
+{
+    int i = handleToIndex[node];
+
+    tx[i] = translation.x; ty[i] = translation.y; tz[i] = translation.z;
+    rx[i] = rotation.x; ry[i] = rotation.y; rz[i] = rotation.z; rw[i] = rotation.w;
+    sx[i] = scale.x; sy[i] = scale.y; sz[i] = scale.z;
+
+    mark_dirty(i);
+}
+
+void TransformHierarchy::set_translation(TransformHandle node, const Vec3 &translation)
+{
+    int i = handleToIndex[node];
+
+    tx[i] = translation.x; ty[i] = translation.y; tz[i] = translation.z;
+
+    mark_dirty(i);
+}
+
+// Ancestors already flagged have their own ancestors flagged too,
+// so the walk stops at the first one
+void TransformHierarchy::mark_dirty(int index)
+{
+    dirty[index] = 1;
+
+    for (int p = parents[index]; p >= 0 && !dirtyBelow[p]; p = parents[p])
+    {
+        dirtyBelow[p] = 1;
+    }
+}
+
+TransformUpdateStats TransformHierarchy::update(WorkerPool *pool)
+{
+    TransformUpdateStats stats = { 0, 0, 0 };
+
+    if (unsorted)
+    {
+        sort_depth_first();
+    }
+
+    int taskThreads = pool ? pool->thread_count() : 1;
+
+    if (taskThreads == 1 || parents.size() < ParallelMinimumNodes)
+    {
+        sweep(0, (int) parents.size(), stats);
+        return stats;
+    }
+
+    if (plannedTasks != taskThreads)
+    {
+        plan_parallel(taskThreads);
+        plannedTasks = taskThreads;
+    }
+
+    // Nodes above the split first; their subtrees read the results
+    for (size_t i = 0; i < serialNodes.size(); i++)
+    {
+        sweep(serialNodes[i], serialNodes[i] + 1, stats);
+    }
+
+    TransformUpdateStats empty = { 0, 0, 0 };
+    vector<TransformUpdateStats> taskStats(parallelRanges.size(), empty);
+
+    pool->run(parallelRanges.size(), [this, &taskStats](size_t task)
+    {
+        sweep(parallelRanges[task].begin, parallelRanges[task].end, taskStats[task]);
+    });
+
+    for (size_t i = 0; i < taskStats.size(); i++)
+    {
+        stats.nodesUpdated += taskStats[i].nodesUpdated;
+        stats.subtreesSkipped += taskStats[i].subtreesSkipped;
+    }
+
+    stats.parallelTasks = parallelRanges.size();
+
+    return stats;
+}
+
+// The forward sweep over [begin, end), which must be whole subtrees
+// whose parents are already up to date
+void TransformHierarchy::sweep(int begin, int end, TransformUpdateStats &stats)
+{
+    int batch[4];
+    int batched = 0;
+    int i = begin;
+
+    while (i < end)
+    {
+        int parent = parents[i];
+        bool changed = dirty[i] || (parent >= 0 && moved[parent]);
+
+        if (!changed && !dirtyBelow[i])
+        {
+            moved[i] = 0;
+            stats.subtreesSkipped++;
+            i = subtreeEnds[i];
+            continue;
+        }
+
+        moved[i] = changed;
+        dirty[i] = 0;
+        dirtyBelow[i] = 0;
+
+        if (changed)
+        {
+            batch[batched++] = i;
+            stats.nodesUpdated++;
+
+            // Children come later in the batch than their parents, and
+            // compose() works through it in order
+            if (batched == 4)
+            {
+                compose(batch, batched);
+                batched = 0;
+            }
+        }
+
+        i++;
+    }
+
+    if (batched > 0)
+    {
+        compose(batch, batched);
+    }
+}
+
+// Local TRS matrices of up to four nodes at once, then each one's
+// world matrix as parent world * local
+void TransformHierarchy::compose(const int *indices, int count)
+{
+#ifdef VECMATH_SSE
+    int n[4];
+
+    for (int k = 0; k < 4; k++)
+    {
+        n[k] = indices[min(k, count - 1)];
+    }
+
+    __m128 qx = _mm_setr_ps(rx[n[0]], rx[n[1]], rx[n[2]], rx[n[3]]);
+    __m128 qy = _mm_setr_ps(ry[n[0]], ry[n[1]], ry[n[2]], ry[n[3]]);
+    __m128 qz = _mm_setr_ps(rz[n[0]], rz[n[1]], rz[n[2]], rz[n[3]]);
+    __m128 qw = _mm_setr_ps(rw[n[0]], rw[n[1]], rw[n[2]], rw[n[3]]);
+    __m128 scaleX = _mm_setr_ps(sx[n[0]], sx[n[1]], sx[n[2]], sx[n[3]]);
+    __m128 scaleY = _mm_setr_ps(sy[n[0]], sy[n[1]], sy[n[2]], sy[n[3]]);
+    __m128 scaleZ = _mm_setr_ps(sz[n[0]], sz[n[1]], sz[n[2]], sz[n[3]]);
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+    // Same terms as mat4_trs, one node per lane; column c, row r
+    __m128 columns[4][4];
+    columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+    columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+    columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+    columns[0][3] = _mm_setzero_ps();
+    columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+    columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+    columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+    columns[1][3] = _mm_setzero_ps();
+    columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+    columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+    columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+    columns[2][3] = _mm_setzero_ps();
+    columns[3][0] = _mm_setr_ps(tx[n[0]], tx[n[1]], tx[n[2]], tx[n[3]]);
+    columns[3][1] = _mm_setr_ps(ty[n[0]], ty[n[1]], ty[n[2]], ty[n[3]]);
+    columns[3][2] = _mm_setr_ps(tz[n[0]], tz[n[1]], tz[n[2]], tz[n[3]]);
+    columns[3][3] = one;
+
+    // Lanes to nodes: afterwards columns[c][k] is column c of node k
+    for (int c = 0; c < 4; c++)
+    {
+        _MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        Mat4 local;
+
+        for (int c = 0; c < 4; c++)
+        {
+            _mm_store_ps(local.m + c * 4, columns[c][k]);
+        }
+
+        int parent = parents[n[k]];
+        worlds[n[k]] = parent >= 0 ? worlds[parent] * local : local;
+    }
+#else
+    for (int k = 0; k < count; k++)
+    {
+        int i = indices[k];
+        Mat4 local = mat4_trs(Vec3(tx[i], ty[i], tz[i]), Quat(rx[i], ry[i], rz[i], rw[i]), Vec3(sx[i], sy[i], sz[i]));
+
+        worlds[i] = parents[i] >= 0 ? worlds[parents[i]] * local : local;
+    }
+#endif
+}
+
+// Reorders storage depth-first, keeping siblings in their current order
+void TransformHierarchy::sort_depth_first()
+{
+    int count = (int) parents.size();
+    vector<int> firstChild(count, -1), nextSibling(count, -1), lastChild(count, -1);
+    vector<int> roots;
+
+    for (int i = 0; i < count; i++)
+    {
+        int p = parents[i];
+
+        if (p < 0)
+        {
+            roots.push_back(i);
+        }
+        else if (lastChild[p] < 0)
+        {
+            firstChild[p] = lastChild[p] = i;
+        }
+        else
+        {
+            nextSibling[lastChild[p]] = i;
+            lastChild[p] = i;
+        }
+    }
+
+    vector<int> order;
+    vector<int> stack(roots.rbegin(), roots.rend());
+    order.reserve(count);
+
+    while (!stack.empty())
+    {
+        int node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+
+        // Pushed in reverse so the first child is visited first
+        size_t top = stack.size();
+
+        for (int c = firstChild[node]; c >= 0; c = nextSibling[c])
+        {
+            stack.push_back(c);
+        }
+
+        reverse(stack.begin() + top, stack.end());
+    }
+
+    vector<int> newIndex(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        newIndex[order[i]] = i;
+    }
+
+    vector<int> newParents(count);
+    vector<TransformHandle> newHandles(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        int old = order[i];
+        newParents[i] = parents[old] >= 0 ? newIndex[parents[old]] : -1;
+        newHandles[i] = indexToHandle[old];
+        handleToIndex[indexToHandle[old]] = i;
+    }
+
+    parents.swap(newParents);
+    indexToHandle.swap(newHandles);
+
+    vector<float> *components[] = { &tx, &ty, &tz, &rx, &ry, &rz, &rw, &sx, &sy, &sz };
+
+    for (size_t c = 0; c < sizeof(components) / sizeof(components[0]); c++)
+    {
+        vector<float> sorted(count);
+
+        for (int i = 0; i < count; i++)
+        {
+            sorted[i] = (*components[c])[order[i]];
+        }
+
+        components[c]->swap(sorted);
+    }
+
+    // Subtree ends, children before parents
+    for (int i = count - 1; i >= 0; i--)
+    {
+        subtreeEnds[i] = i + 1;
+    }
+
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (parents[i] >= 0)
+        {
+            subtreeEnds[parents[i]] = max(subtreeEnds[parents[i]], subtreeEnds[i]);
+        }
+    }
+
+    // Everything is recomputed after a reorder
+    fill(dirty.begin(), dirty.end(), 1);
+    fill(dirtyBelow.begin(), dirtyBelow.end(), 1);
+    fill(moved.begin(), moved.end(), 0);
+
+    unsorted = false;
+    plannedTasks = 0;
+}
+
+// Splits the nodes into subtree ranges of about size / (threads *
+// TasksPerThread): small sibling subtrees are batched into one range,
+// larger ones are split at their root, which then runs serially
+void TransformHierarchy::plan_parallel(int threads)
+{
+    int count = (int) parents.size();
+    int grain = max(1, count / (threads * TasksPerThread));
+
+    serialNodes.clear();
+    parallelRanges.clear();
+
+    // Nodes whose children are to be distributed, -1 for the roots
+    vector<int> split(1, -1);
+
+    while (!split.empty())
+    {
+        int node = split.back();
+        split.pop_back();
+
+        int child = node + 1;
+        int end = node >= 0 ? subtreeEnds[node] : count;
+        Range batch = { child, child };
+
+        for (; child < end; child = subtreeEnds[child])
+        {
+            if (subtreeEnds[child] - child > grain)
+            {
+                if (batch.end > batch.begin)
+                {
+                    parallelRanges.push_back(batch);
+                }
+
+                serialNodes.push_back(child);
+                split.push_back(child);
+                batch.begin = batch.end = subtreeEnds[child];
+                continue;
+            }
+
+            batch.end = subtreeEnds[child];
+
+            if (batch.end - batch.begin >= grain)
+            {
+                parallelRanges.push_back(batch);
+                batch.begin = batch.end;
+            }
+        }
+
+        if (batch.end > batch.begin)
+        {
+            parallelRanges.push_back(batch);
+        }
+    }
+
+    sort(serialNodes.begin(), serialNodes.end());
+
+    // Largest first, so the stragglers are small
+    sort(parallelRanges.begin(), parallelRanges.end(), [](const Range &a, const Range &b)
+    {
+        return a.end - a.begin > b.end - b.begin;
+    });
+}
@@ -0,0 +1,494 @@
+#include "vecmath.h"
+
+#include <cmath>
+
+using namespace std;
+
+//--------------------------------------------------------------
+// SSE helpers
+//--------------------------------------------------------------
+
+#ifdef VECMATH_SSE
+
+// Lanes (a[i], a[j], b[k], b[l])
+#define SHUFFLE(a, b, i, j, k, l) _mm_shuffle_ps(a, b, _MM_SHUFFLE(l, k, j, i))
+
+// 2x2 matrices packed row-major as (m00, m01, m10, m11)
+
+// a * b
+static inline __m128 mat2_multiply(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, SHUFFLE(b, b, 0, 3, 0, 3)),
+                      _mm_mul_ps(SHUFFLE(a, a, 1, 0, 3, 2), SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+
+// adjugate(a) * b
+static inline __m128 mat2_adjugate_multiply(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(SHUFFLE(a, a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(SHUFFLE(a, a, 1, 1, 2, 2), SHUFFLE(b, b, 2, 3, 0, 1)));
+}
+
+// a * adjugate(b)
+static inline __m128 mat2_multiply_adjugate(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, SHUFFLE(b, b, 3, 0, 3, 0)),
+                      _mm_mul_ps(SHUFFLE(a, a, 1, 0, 3, 2), SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+
+// Four packed Vec3 (three registers) to one register per component
+static inline void deinterleave(__m128 a, __m128 b, __m128 c, __m128 &x, __m128 &y, __m128 &z)
+{
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    __m128 bc = SHUFFLE(b, c, 2, 2, 1, 1);
+    x = SHUFFLE(a, bc, 0, 3, 0, 2);
+    y = SHUFFLE(SHUFFLE(a, b, 1, 1, 0, 0), SHUFFLE(b, c, 3, 3, 2, 2), 0, 2, 0, 2);
+    z = SHUFFLE(SHUFFLE(a, b, 2, 2, 1, 1), SHUFFLE(c, c, 0, 3, 0, 3), 0, 2, 0, 1);
+}
+
+static inline void interleave(__m128 x, __m128 y, __m128 z, __m128 &a, __m128 &b, __m128 &c)
+{
+    a = SHUFFLE(SHUFFLE(x, y, 0, 0, 0, 0), SHUFFLE(z, x, 0, 0, 1, 1), 0, 2, 0, 2);
+    b = SHUFFLE(SHUFFLE(y, z, 1, 1, 1, 1), SHUFFLE(x, y, 2, 2, 2, 2), 0, 2, 0, 2);
+    c = SHUFFLE(SHUFFLE(z, x, 2, 2, 3, 3), SHUFFLE(y, z, 3, 3, 3, 3), 0, 2, 0, 2);
+}
+
+#endif
+
+//--------------------------------------------------------------
+// Matrices
+//--------------------------------------------------------------
+
+Mat4 transpose(const Mat4 &a)
+{
+    Mat4 result;
+
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            result.m[c * 4 + r] = a.m[r * 4 + c];
+        }
+    }
+
+    return result;
+}
+
+Mat4 inverse(const Mat4 &a)
+{
+#ifdef VECMATH_SSE
+    // Block inverse over the 2x2 sub-matrices | A B |
+    //                                         | C D |
+    // Works on the transpose as well, since inverse(transpose(M)) =
+    // transpose(inverse(M)), so the column-major layout needs no care.
+    __m128 c0 = _mm_load_ps(a.m);
+    __m128 c1 = _mm_load_ps(a.m + 4);
+    __m128 c2 = _mm_load_ps(a.m + 8);
+    __m128 c3 = _mm_load_ps(a.m + 12);
+
+    __m128 A = _mm_movelh_ps(c0, c1);
+    __m128 B = _mm_movehl_ps(c1, c0);
+    __m128 C = _mm_movelh_ps(c2, c3);
+    __m128 D = _mm_movehl_ps(c3, c2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 determinants = _mm_sub_ps(_mm_mul_ps(SHUFFLE(c0, c2, 0, 2, 0, 2), SHUFFLE(c1, c3, 1, 3, 1, 3)),
+                                     _mm_mul_ps(SHUFFLE(c0, c2, 1, 3, 1, 3), SHUFFLE(c1, c3, 0, 2, 0, 2)));
+    __m128 detA = SHUFFLE(determinants, determinants, 0, 0, 0, 0);
+    __m128 detB = SHUFFLE(determinants, determinants, 1, 1, 1, 1);
+    __m128 detC = SHUFFLE(determinants, determinants, 2, 2, 2, 2);
+    __m128 detD = SHUFFLE(determinants, determinants, 3, 3, 3, 3);
+
+    __m128 DC = mat2_adjugate_multiply(D, C);
+    __m128 AB = mat2_adjugate_multiply(A, B);
+
+    // Adjugates of the result blocks, scaled by |M| below
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), mat2_multiply(B, DC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), mat2_multiply(C, AB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), mat2_multiply_adjugate(D, AB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), mat2_multiply_adjugate(A, DC));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 trace = _mm_mul_ps(AB, SHUFFLE(DC, DC, 0, 2, 1, 3));
+    trace = _mm_add_ps(trace, SHUFFLE(trace, trace, 2, 3, 0, 1));
+    trace = _mm_add_ps(trace, SHUFFLE(trace, trace, 1, 0, 3, 2));
+
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+    __m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+
+    X = _mm_mul_ps(X, scale);
+    Y = _mm_mul_ps(Y, scale);
+    Z = _mm_mul_ps(Z, scale);
+    W = _mm_mul_ps(W, scale);
+
+    // The adjugate shuffle and the store layout in one
+    Mat4 result;
+    _mm_store_ps(result.m, SHUFFLE(X, Y, 3, 1, 3, 1));
+    _mm_store_ps(result.m + 4, SHUFFLE(X, Y, 2, 0, 2, 0));
+    _mm_store_ps(result.m + 8, SHUFFLE(Z, W, 3, 1, 3, 1));
+    _mm_store_ps(result.m + 12, SHUFFLE(Z, W, 2, 0, 2, 0));
+
+    return result;
+#else
+    return inverse_reference(a);
+#endif
+}
+
+Mat4 mat4_translation(const Vec3 &t)
+{
+    Mat4 result;
+    result.m[12] = t.x;
+    result.m[13] = t.y;
+    result.m[14] = t.z;
+
+    return result;
+}
+
+Mat4 mat4_scale(const Vec3 &s)
+{
+    Mat4 result;
+    result.m[0] = s.x;
+    result.m[5] = s.y;
+    result.m[10] = s.z;
+
+    return result;
+}
+
+Mat4 mat4_rotation(const Quat &q)
+{
+    return mat4_trs(Vec3(), q, Vec3(1.0f, 1.0f, 1.0f));
+}
+
+Mat4 mat4_trs(const Vec3 &t, const Quat &r, const Vec3 &s)
+{
+    float xx = r.x * r.x, yy = r.y * r.y, zz = r.z * r.z;
+    float xy = r.x * r.y, xz = r.x * r.z, yz = r.y * r.z;
+    float wx = r.w * r.x, wy = r.w * r.y, wz = r.w * r.z;
+
+    Mat4 result;
+
+    result.m[0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+    result.m[1] = 2.0f * (xy + wz) * s.x;
+    result.m[2] = 2.0f * (xz - wy) * s.x;
+
+    result.m[4] = 2.0f * (xy - wz) * s.y;
+    result.m[5] = (1.0f - 2.0f * (xx + zz)) * s.y;
+    result.m[6] = 2.0f * (yz + wx) * s.y;
+
+    result.m[8] = 2.0f * (xz + wy) * s.z;
+    result.m[9] = 2.0f * (yz - wx) * s.z;
+    result.m[10] = (1.0f - 2.0f * (xx + yy)) * s.z;
+
+    result.m[12] = t.x;
+    result.m[13] = t.y;
+    result.m[14] = t.z;
+
+    return result;
+}
+
+Mat4 mat4_perspective(float fovY, float aspect, float nearZ, float farZ)
+{
+    float f = 1.0f / tan(fovY * 0.5f);
+
+    Mat4 result;
+    result.m[0] = f / aspect;
+    result.m[5] = f;
+    result.m[10] = (farZ + nearZ) / (nearZ - farZ);
+    result.m[11] = -1.0f;
+    result.m[14] = 2.0f * farZ * nearZ / (nearZ - farZ);
+    result.m[15] = 0.0f;
+
+    return result;
+}
+
+Mat4 mat4_look_at(const Vec3 &eye, const Vec3 &target, const Vec3 &up)
+{
+    Vec3 forward = normalize(target - eye);
+    Vec3 side = normalize(cross(forward, up));
+    Vec3 upward = cross(side, forward);
+
+    Mat4 result;
+    result.at(0, 0) = side.x;
+    result.at(0, 1) = side.y;
+    result.at(0, 2) = side.z;
+    result.at(1, 0) = upward.x;
+    result.at(1, 1) = upward.y;
+    result.at(1, 2) = upward.z;
+    result.at(2, 0) = -forward.x;
+    result.at(2, 1) = -forward.y;
+    result.at(2, 2) = -forward.z;
+    result.at(0, 3) = -dot(side, eye);
+    result.at(1, 3) = -dot(upward, eye);
+    result.at(2, 3) = dot(forward, eye);
+
+    return result;
+}
+
+//--------------------------------------------------------------
+// Batch kernels
+//--------------------------------------------------------------
+
+void multiply_matrices(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = a[i] * b[i];
+    }
+}
+
+void transform_points(const Mat4 &matrix, const Vec3 *points, Vec3 *out, size_t count)
+{
+    size_t i = 0;
+
+#ifdef VECMATH_SSE
+    // Four points are three registers; transposed to x, y and z lanes
+    // each matrix element is one broadcast multiply-add. m[] skips the
+    // bottom row: columns are (0,1,2), (3,4,5), ...
+    __m128 m[12];
+
+    for (int e = 0; e < 12; e++)
+    {
+        m[e] = _mm_set1_ps(matrix.m[e + (e / 3)]);
+    }
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const float *in = &points[i].x;
+        __m128 x, y, z;
+        deinterleave(_mm_loadu_ps(in), _mm_loadu_ps(in + 4), _mm_loadu_ps(in + 8), x, y, z);
+
+        __m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), _mm_mul_ps(m[3], y)),
+                               _mm_add_ps(_mm_mul_ps(m[6], z), m[9]));
+        __m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], x), _mm_mul_ps(m[4], y)),
+                               _mm_add_ps(_mm_mul_ps(m[7], z), m[10]));
+        __m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], x), _mm_mul_ps(m[5], y)),
+                               _mm_add_ps(_mm_mul_ps(m[8], z), m[11]));
+
+        __m128 a, b, c;
+        interleave(ox, oy, oz, a, b, c);
+
+        float *result = &out[i].x;
+        _mm_storeu_ps(result, a);
+        _mm_storeu_ps(result + 4, b);
+        _mm_storeu_ps(result + 8, c);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = transform_point(matrix, points[i]);
+    }
+}
+
+void transform_points_soa(const Mat4 &matrix, const float *x, const float *y, const float *z,
+                          float *outX, float *outY, float *outZ, size_t count)
+{
+    size_t i = 0;
+
+#if defined(VECMATH_AVX)
+    const float *m = matrix.m;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+
+        for (int row = 0; row < 3; row++)
+        {
+            __m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[row]), px),
+                                     _mm256_mul_ps(_mm256_set1_ps(m[4 + row]), py));
+            r = _mm256_add_ps(r, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[8 + row]), pz),
+                                               _mm256_set1_ps(m[12 + row])));
+            _mm256_storeu_ps((row == 0 ? outX : row == 1 ? outY : outZ) + i, r);
+        }
+    }
+#elif defined(VECMATH_SSE)
+    const float *m = matrix.m;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+
+        for (int row = 0; row < 3; row++)
+        {
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[row]), px), _mm_mul_ps(_mm_set1_ps(m[4 + row]), py));
+            r = _mm_add_ps(r, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8 + row]), pz), _mm_set1_ps(m[12 + row])));
+            _mm_storeu_ps((row == 0 ? outX : row == 1 ? outY : outZ) + i, r);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        Vec3 p = transform_point(matrix, Vec3(x[i], y[i], z[i]));
+        outX[i] = p.x;
+        outY[i] = p.y;
+        outZ[i] = p.z;
+    }
+}
+
+void transform_blocks(const Mat4 &matrix, const Vec3Block *blocks, Vec3Block *out, size_t count)
+{
+    // e[] skips the bottom row: columns are (0,1,2), (3,4,5), ...
+#if defined(VECMATH_AVX)
+    __m256 e[12];
+
+    for (int i = 0; i < 12; i++)
+    {
+        e[i] = _mm256_set1_ps(matrix.m[i + i / 3]);
+    }
+
+    for (size_t b = 0; b < count; b++)
+    {
+        __m256 x = _mm256_loadu_ps(blocks[b].x);
+        __m256 y = _mm256_loadu_ps(blocks[b].y);
+        __m256 z = _mm256_loadu_ps(blocks[b].z);
+
+        __m256 ox = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e[0], x), _mm256_mul_ps(e[3], y)),
+                                  _mm256_add_ps(_mm256_mul_ps(e[6], z), e[9]));
+        __m256 oy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e[1], x), _mm256_mul_ps(e[4], y)),
+                                  _mm256_add_ps(_mm256_mul_ps(e[7], z), e[10]));
+        __m256 oz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e[2], x), _mm256_mul_ps(e[5], y)),
+                                  _mm256_add_ps(_mm256_mul_ps(e[8], z), e[11]));
+
+        _mm256_storeu_ps(out[b].x, ox);
+        _mm256_storeu_ps(out[b].y, oy);
+        _mm256_storeu_ps(out[b].z, oz);
+    }
+#elif defined(VECMATH_SSE)
+    __m128 e[12];
+
+    for (int i = 0; i < 12; i++)
+    {
+        e[i] = _mm_set1_ps(matrix.m[i + i / 3]);
+    }
+
+    for (size_t b = 0; b < count; b++)
+    {
+        for (int half = 0; half < Vec3BlockWidth; half += 4)
+        {
+            __m128 x = _mm_loadu_ps(blocks[b].x + half);
+            __m128 y = _mm_loadu_ps(blocks[b].y + half);
+            __m128 z = _mm_loadu_ps(blocks[b].z + half);
+
+            __m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], x), _mm_mul_ps(e[3], y)),
+                                   _mm_add_ps(_mm_mul_ps(e[6], z), e[9]));
+            __m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[1], x), _mm_mul_ps(e[4], y)),
+                                   _mm_add_ps(_mm_mul_ps(e[7], z), e[10]));
+            __m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[2], x), _mm_mul_ps(e[5], y)),
+                                   _mm_add_ps(_mm_mul_ps(e[8], z), e[11]));
+
+            _mm_storeu_ps(out[b].x + half, ox);
+            _mm_storeu_ps(out[b].y + half, oy);
+            _mm_storeu_ps(out[b].z + half, oz);
+        }
+    }
+#else
+    for (size_t b = 0; b < count; b++)
+    {
+        transform_points_soa(matrix, blocks[b].x, blocks[b].y, blocks[b].z,
+                             out[b].x, out[b].y, out[b].z, Vec3BlockWidth);
+    }
+#endif
+}
+
+//--------------------------------------------------------------
+// Reference implementations
+//--------------------------------------------------------------
+
+Mat4 multiply_reference(const Mat4 &a, const Mat4 &b)
+{
+    Mat4 result;
+
+    for (int r = 0; r < 4; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            float sum = 0.0f;
+
+            for (int k = 0; k < 4; k++)
+            {
+                sum += a.at(r, k) * b.at(k, c);
+            }
+
+            result.at(r, c) = sum;
+        }
+    }
+
+    return result;
+}
+
+// Cofactor expansion: each element's cofactor from the 2x2
+// determinants of the bottom and top row pairs
+Mat4 inverse_reference(const Mat4 &a)
+{
+    const float *m = a.m;
+    float inv[16];
+
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15]
+           + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15]
+           - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15]
+           + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14]
+            - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15]
+           - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15]
+           + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15]
+           - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14]
+            + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15]
+           + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15]
+           - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15]
+            + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14]
+            - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11]
+           - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11]
+           + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11]
+            - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10]
+            + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float det = 1.0f / (m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12]);
+
+    Mat4 result;
+
+    for (int i = 0; i < 16; i++)
+    {
+        result.m[i] = inv[i] * det;
+    }
+
+    return result;
+}
+
+void transform_points_reference(const Mat4 &matrix, const Vec3 *points, Vec3 *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Vec4 p = matrix * Vec4(points[i], 1.0f);
+        out[i] = Vec3(p.x, p.y, p.z);
+    }
+}
+
+const char *vecmath_instruction_set()
+{
+#if defined(VECMATH_AVX)
+    return "avx";
+#elif defined(VECMATH_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,106 @@
+#include "worker_pool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads)
+    : task(NULL), taskCount(0), nextTask(0), activeWorkers(0), generation(0), closing(false)
+{
+    if (threads <= 0)
+    {
+        threads = (int) thread::hardware_concurrency();
+    }
+
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(thread(&WorkerPool::worker_loop, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(stateMutex);
+        closing = true;
+    }
+
+    wake.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+void WorkerPool::run(size_t count, const Task &function)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Not worth a wakeup
+    if (workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            function(i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        task = &function;
+        taskCount = count;
+        nextTask.store(0);
+        activeWorkers = (int) workers.size();
+        generation++;
+    }
+
+    wake.notify_all();
+    work();
+
+    // Workers still holding a task finish it before run() may return
+    unique_lock<mutex> lock(stateMutex);
+    done.wait(lock, [this]() { return activeWorkers == 0; });
+    task = NULL;
+}
+
+void WorkerPool::work()
+{
+    size_t index;
+
+    while ((index = nextTask.fetch_add(1)) < taskCount)
+    {
+        (*task)(index);
+    }
+}
+
+void WorkerPool::worker_loop()
+{
+    unsigned long seen = 0;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wake.wait(lock, [this, seen]() { return closing || generation != seen; });
+
+            if (closing)
+            {
+                return;
+            }
+
+            seen = generation;
+        }
+
+        work();
+
+        lock_guard<mutex> lock(stateMutex);
+
+        if (--activeWorkers == 0)
+        {
+            done.notify_one();
+        }
+    }
+}